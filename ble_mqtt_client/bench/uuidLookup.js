@@ -0,0 +1,48 @@
+// uuidParse benchmark: the old regex and linear search through the databases against the
+// index, without the memo (the first lookup of a UUID) and with it (every one after)
+// needs the bluetooth-numbers-database submodule (git submodule update --init)
+// usage: node bench/uuidLookup.js [lookups]
+const bt_uuids = require('../bluetooth-numbers-database');
+const get_uuid = require('../uuidParse');
+
+const LOOKUPS = Number(process.argv[2]) || 200000;
+
+// the lookup as it was before the index, for comparison
+const linear = (uuid) => {
+    uuid = uuid.toUpperCase();
+    let uuid16 = uuid.match(/0{4}([0-9A-Z]{4})-0{4}-10{3}-80{3}-00805F9B34FB/);
+    if (uuid16) uuid = uuid16[1];
+    for (let db of Object.keys(bt_uuids.schemas)) {
+        let uuidObj = bt_uuids[db].find(d => d.uuid === uuid);
+        if (uuidObj) return uuidObj;
+    }
+    return { name: 'Custom UUID', identifier: null, uuid: uuid, source: 'custom' };
+}
+
+// what the gateway looks up: the ble_co2 characteristics, plus the first and last entries of
+// each database so the linear search's best and worst cases are both in
+const expand = (uuid) => uuid.length === 4 ? `0000${uuid}-0000-1000-8000-00805f9b34fb`.toLowerCase() : uuid.toLowerCase();
+let uuids = [
+    '00000001-0002-0003-0004-000000000001',
+    '00000001-0002-0003-0004-000000000004',
+    '00000001-0002-0003-0004-000000000006',
+    '00002a6e-0000-1000-8000-00805f9b34fb',
+    '00002a6f-0000-1000-8000-00805f9b34fb'
+];
+for (let db of Object.keys(bt_uuids.schemas)) {
+    let entries = bt_uuids[db].filter(d => d.uuid);
+    if (entries.length) uuids.push(expand(entries[0].uuid), expand(entries[entries.length - 1].uuid));
+}
+let entries = Object.keys(bt_uuids.schemas).reduce((sum, db) => sum + bt_uuids[db].length, 0);
+
+const time = (label, lookup, keys) => {
+    let start = process.hrtime.bigint();
+    for (let i = 0; i < LOOKUPS; i++) lookup(keys[i % keys.length]);
+    let ns = Number(process.hrtime.bigint() - start) / LOOKUPS;
+    console.log(`${label}: ${ns.toFixed(0)}ns per lookup`);
+}
+
+console.log(`${entries} database entries, ${uuids.length} UUIDs, ${LOOKUPS} lookups`);
+time('linear', linear, uuids);
+time('index', get_uuid.lookup, uuids);
+time('index, memoized', get_uuid, uuids);
@@ -0,0 +1,74 @@
+// write-ahead log benchmark: how fast samples are logged, and how fast a sink that was cut
+// off catches up once its backend is back
+// usage: node bench/walReplay.js [samples] [segment MB]
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { Wal } = require('../wal');
+const { SinkPipeline } = require('../sinkPipeline');
+
+const SAMPLES = Number(process.argv[2]) || 1000000;
+const SEGMENT_BYTES = (Number(process.argv[3]) || 16) * 1024 * 1024;
+
+// a sample as the gateway logs it
+const sample = (i) => ({
+  mac: 'D4:3C:2A:5B:91:07',
+  name: 'BBC micro:bit [tuzop]',
+  uuid: '00000001-0002-0003-0004-000000000001',
+  charName: 'CO2',
+  value: 400 + i % 800,
+  timestamp: 1639245495000 + i * 2000
+});
+
+const rate = (count, ms) => `${Math.round(count / ms * 1000).toLocaleString()}/s`;
+const mb = (bytes) => `${(bytes / 1024 / 1024).toFixed(1)}MB`;
+
+(async () => {
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'wal-bench-'));
+  try {
+    let wal = new Wal(dir, { segmentBytes: SEGMENT_BYTES });
+    wal.cursor('sink'); // register the sink at the start so nothing is compacted
+
+    // append in event loop sized chunks like notifications arriving, group committed per turn
+    let start = Date.now();
+    for (let i = 0; i < SAMPLES;) {
+      for (let end = Math.min(SAMPLES, i + 1000); i < end; i++) wal.append(sample(i));
+      await new Promise(resolve => setImmediate(resolve));
+    }
+    wal.fsync();
+    let appendMs = Date.now() - start;
+    let bytes = wal.segments.reduce((sum, segment) => sum + segment.bytes, 0);
+    console.log(`append: ${SAMPLES} samples, ${mb(bytes)} in ${wal.segments.length} segments, ` +
+      `${appendMs}ms, ${rate(SAMPLES, appendMs)}`);
+
+    // raw read of the whole log
+    start = Date.now();
+    let reader = wal.reader(0), read = 0;
+    for (let records; (records = reader.next(5000)).length;) read += records.length;
+    reader.close();
+    let readMs = Date.now() - start;
+    console.log(`read: ${read} samples in ${readMs}ms, ${rate(read, readMs)}, ${mb(bytes / readMs * 1000)}/s`);
+
+    // a sink catching up from its cursor through the pipeline, with a write that does nothing
+    start = Date.now();
+    let written = 0;
+    let caughtUp;
+    let done = new Promise(resolve => caughtUp = resolve);
+    let pipeline = new SinkPipeline({ wal, metricsLogMs: 0 }).addSink('sink', async samples => {
+      written += samples.length;
+      if (written >= SAMPLES) caughtUp();
+    }, { maxBatch: 5000 });
+    await done;
+    let replayMs = Date.now() - start;
+    console.log(`replay: ${written} samples through the sink in ${replayMs}ms, ${rate(written, replayMs)}`);
+    await pipeline.close();
+
+    // with the sink caught up every segment but the current one can go
+    start = Date.now();
+    wal.compact();
+    console.log(`compact: ${wal.segments.length} segment left in ${Date.now() - start}ms`);
+    wal.close();
+  } finally {
+    fs.rmSync(dir, { recursive: true, force: true });
+  }
+})();
@@ -0,0 +1,205 @@
+// BLE connection scheduling for the gateway
+// the devices the gateway should be connected to are "wanted". At most maxConnecting of them
+// are connected at once, the rest wait their turn, most recently seen first since those are
+// the likeliest to be in range. A failed attempt or a dropped connection is retried after an
+// exponential backoff with jitter, so a device that is away doesn't take a slot every second.
+// All attempts share one discovery session instead of each starting and stopping its own.
+// Given a scan cache (see scanCache.js) devices are found from it instead of polling BlueZ,
+// and a device waiting out its backoff is tried as soon as it is heard from again.
+const { EventEmitter } = require('events');
+
+const DEFAULTS = {
+  maxConnecting: 3, // connection attempts at once, BlueZ handles a few well
+  findTimeoutMs: 15000, // how long discovery may take to find a device
+  scanCache: null,
+  discovery: null, // a SharedDiscovery to use, one of its own if none
+  backoffBaseMs: 2000, // first retry delay, doubled for each failed attempt
+  backoffMaxMs: 5 * 60 * 1000,
+  discoveryLingerMs: 2000 // keep discovering this long after the last user is done
+};
+
+const sleep = (ms) => new Promise(resolve => setTimeout(resolve, ms));
+
+// one discovery session on the adapter for everyone who needs one, started by the first
+// acquire() and stopped a little after the last release()
+class SharedDiscovery {
+  constructor(adapter, lingerMs = DEFAULTS.discoveryLingerMs) {
+    this.adapter = adapter;
+    this.lingerMs = lingerMs;
+    this.users = 0;
+    this.stopTimer = null;
+    this.change = Promise.resolve(); // start and stop calls run one after another
+  }
+
+  acquire() {
+    this.users++;
+    clearTimeout(this.stopTimer);
+    this.stopTimer = null;
+    return this.set(true);
+  }
+
+  release() {
+    if (--this.users > 0) return;
+    this.stopTimer = setTimeout(() => this.set(false), this.lingerMs);
+  }
+
+  // hold discovery for ms, e.g. for a scan
+  async during(ms) {
+    await this.acquire();
+    try {
+      await sleep(ms);
+    } finally {
+      this.release();
+    }
+  }
+
+  set(on) {
+    this.change = this.change.then(async () => {
+      if (on !== this.users > 0) return; // changed its mind meanwhile
+      try {
+        if (on === await this.adapter.isDiscovering()) return;
+        if (on) await this.adapter.startDiscovery();
+        else await this.adapter.stopDiscovery();
+        console.log(`[INFO]: BLE - ${on ? 'Scanning Devices...' : 'Stopped discovery'}`);
+      } catch (err) { console.log(`[ERROR]: BLE - ${err}`) }
+    });
+    return this.change;
+  }
+}
+
+// emits 'connected' (mac, device, whatever setup returned) when a wanted device is up and
+// 'lost' (mac) when its connection drops, it is then reconnected
+class ConnectionManager extends EventEmitter {
+  // setup(mac, device) connects to and sets up a device node-ble has found, it throws if that
+  // failed and sets retry = false on the error if there is no point in trying again
+  constructor(adapter, setup, options) {
+    super();
+    this.adapter = adapter;
+    this.setup = setup;
+    this.opts = { ...DEFAULTS, ...options };
+    this.discovery = this.opts.discovery || new SharedDiscovery(adapter, this.opts.discoveryLingerMs);
+    this.devices = new Map(); // mac -> { lastSeen, attempts, state, timer, device }
+    this.connecting = 0;
+    this.pumpScheduled = false;
+    this.scanCache = this.opts.scanCache;
+    if (this.scanCache) this.scanCache.on('seen', entry => {
+      let dev = this.devices.get(entry.mac);
+      if (dev && dev.state === 'waiting') this.ready(dev);
+    });
+  }
+
+  // when the device was last heard from, by the scan cache or a connection attempt
+  lastSeen(dev) {
+    let entry = this.scanCache && this.scanCache.get(dev.mac);
+    return Math.max(dev.lastSeen, entry ? entry.lastSeen : 0);
+  }
+
+  // connect to a device and keep it connected, lastSeen (ms) puts it ahead of older ones
+  want(mac, lastSeen = 0) {
+    let dev = this.devices.get(mac);
+    if (dev) {
+      dev.lastSeen = Math.max(dev.lastSeen, lastSeen);
+      // asked again: skip the rest of the backoff
+      if (dev.state === 'waiting') this.ready(dev);
+      return;
+    }
+    dev = { mac, lastSeen, attempts: 0, state: 'ready', timer: null, device: null };
+    this.devices.set(mac, dev);
+    // on the next turn, so devices wanted together (e.g. at startup) are taken in order
+    if (!this.pumpScheduled) {
+      this.pumpScheduled = true;
+      setImmediate(() => {
+        this.pumpScheduled = false;
+        this.pump();
+      });
+    }
+  }
+
+  // stop connecting or reconnecting to a device, disconnecting is up to the caller
+  unwant(mac) {
+    let dev = this.devices.get(mac);
+    if (!dev) return;
+    clearTimeout(dev.timer);
+    this.devices.delete(mac);
+  }
+
+  wanted(mac) {
+    return this.devices.has(mac);
+  }
+
+  ready(dev) {
+    clearTimeout(dev.timer);
+    dev.state = 'ready';
+    this.pump();
+  }
+
+  // start attempts on free slots, the most recently seen ready devices first
+  pump() {
+    while (this.connecting < this.opts.maxConnecting) {
+      let next = null;
+      for (let dev of this.devices.values()) {
+        if (dev.state === 'ready' && (!next || this.lastSeen(dev) > this.lastSeen(next))) next = dev;
+      }
+      if (!next) return;
+      this.attempt(next);
+    }
+  }
+
+  async attempt(dev) {
+    dev.state = 'connecting';
+    this.connecting++;
+    let retry = true, device = null;
+    await this.discovery.acquire();
+    try {
+      if (this.scanCache) {
+        await this.scanCache.waitFor(dev.mac, this.opts.findTimeoutMs);
+        device = await this.adapter.getDevice(dev.mac);
+      } else {
+        device = await this.adapter.waitDevice(dev.mac, this.opts.findTimeoutMs);
+      }
+      dev.lastSeen = Date.now();
+      let result = await this.setup(dev.mac, device);
+      if (this.devices.get(dev.mac) !== dev) {
+        // unwanted while it was being set up
+        await device.disconnect().catch(() => { });
+        return;
+      }
+      dev.attempts = 0;
+      dev.state = 'connected';
+      dev.device = device;
+      device.once('disconnect', () => this.lost(dev));
+      this.emit('connected', dev.mac, device, result);
+    } catch (err) {
+      console.log(`[ERROR]: BLE - Connecting to ${dev.mac} failed: ${err}`);
+      retry = err.retry !== false;
+      // setup may have failed after connecting, don't leave the link up until the retry
+      if (device) await device.disconnect().catch(() => { });
+    } finally {
+      this.discovery.release();
+      this.connecting--;
+      if (dev.state === 'connecting' && this.devices.get(dev.mac) === dev) {
+        if (retry) this.backoff(dev);
+        else this.unwant(dev.mac);
+      }
+      this.pump();
+    }
+  }
+
+  lost(dev) {
+    if (this.devices.get(dev.mac) !== dev) return; // unwanted, disconnected on purpose
+    dev.device = null;
+    this.emit('lost', dev.mac);
+    this.backoff(dev);
+  }
+
+  backoff(dev) {
+    let delay = Math.min(this.opts.backoffMaxMs, this.opts.backoffBaseMs * 2 ** dev.attempts++);
+    delay = delay / 2 + Math.random() * delay / 2; // jitter so a fleet doesn't retry in step
+    dev.state = 'waiting';
+    dev.timer = setTimeout(() => this.ready(dev), delay);
+    dev.timer.unref();
+    console.log(`[INFO]: BLE - Retrying ${dev.mac} in ${Math.round(delay / 1000)}s`);
+  }
+}
+
+module.exports = { ConnectionManager, SharedDiscovery };
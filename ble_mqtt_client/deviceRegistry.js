@@ -0,0 +1,71 @@
+// the connected devices and their characteristics
+// everything about a characteristic that needs a D-Bus call (its UUID and flags) is read once
+// when the device connects, along with its name and decoder, and kept in a map by UUID.
+// Handling a command or a notification is then a map lookup instead of a getUUID() call
+// for each characteristic
+class DeviceRegistry {
+  // describe(uuid) returns { name, info, decode } for a characteristic UUID
+  constructor(describe) {
+    this.describe = describe;
+    this.devices = new Map(); // mac -> { mac, name, device, chars, listing, notifying }
+    // mac -> Set of the 128 bit UUIDs notifications were turned on for, kept while a dropped
+    // connection is reconnected so they can be turned on again
+    this.notifying = new Map();
+  }
+
+  // read the UUID and flags of each characteristic, returns a map of 128 bit UUID to
+  // { uuid, char, flags, name, info, decode }
+  async resolveChars(charObjs) {
+    let chars = new Map();
+    await Promise.all(charObjs.map(async char => {
+      let [uuid, flags] = await Promise.all([char.getUUID(), char.getFlags()]);
+      chars.set(uuid, { uuid, char, flags, ...this.describe(uuid) });
+    }));
+    return chars;
+  }
+
+  // a device is connected, chars from resolveChars()
+  add(mac, { name, device, chars }) {
+    // the reply to a characteristics listing doesn't change while the device is connected
+    let listing = [...chars.values()].map(c => ({ ...c.info, flags: c.flags }));
+    if (!this.notifying.has(mac)) this.notifying.set(mac, new Set());
+    let entry = { mac, name, device, chars, listing, notifying: this.notifying.get(mac) };
+    this.devices.set(mac, entry);
+    return entry;
+  }
+
+  // the device is no longer connected. The old characteristic objects are let go of: their
+  // listeners are removed, otherwise they would still see the values on the same D-Bus paths
+  // once a reconnect has new ones listening. keepNotifying keeps the characteristics that were
+  // notifying for the reconnect, after a dropped connection
+  remove(mac, keepNotifying = false) {
+    let entry = this.devices.get(mac);
+    if (!keepNotifying) this.notifying.delete(mac);
+    if (!entry) return false;
+    for (let { char } of entry.chars.values()) {
+      char.removeAllListeners('valuechanged');
+      char.stopNotifications().catch(() => { }); // refused once the link is gone, nothing more to do
+    }
+    return this.devices.delete(mac);
+  }
+
+  get(mac) {
+    return this.devices.get(mac);
+  }
+
+  has(mac) {
+    return this.devices.has(mac);
+  }
+
+  macs() {
+    return [...this.devices.keys()];
+  }
+
+  // a characteristic of a connected device by 128 bit UUID, undefined if there isn't one
+  char(mac, uuid) {
+    let entry = this.devices.get(mac);
+    return entry && entry.chars.get(uuid);
+  }
+}
+
+module.exports = { DeviceRegistry };
@@ -2,16 +2,32 @@
 const mqtt = require('async-mqtt');
 const { createBluetooth } = require('node-ble');
 const mariadb = require('mariadb');
-const Influx = require('influx');
 const { exit } = require('process');
 
 // import uuid function
 const get_uuid = require("./uuidParse");
+// import sample batch decoder
+const { decodeBatch, decodeValue, encodeConfig } = require("./sampleCodec");
+// import influx writer
+const { InfluxWriter } = require("./influxWriter");
+// import sensor id cache and batched sample writer
+const { SensorStore } = require("./sensorStore");
+// import sample fan-out to the mqtt, influx and mariadb sinks
+const { SinkPipeline } = require("./sinkPipeline");
+// import on-disk sample log
+const { Wal } = require("./wal");
+// import BLE connection scheduler and background scan
+const { ConnectionManager, SharedDiscovery } = require("./connectionManager");
+const { ScanCache } = require("./scanCache");
+// import registry of connected devices and their characteristics
+const { DeviceRegistry } = require("./deviceRegistry");
 
 // getting environment variables
 const ROOM = process.env.ROOM; // room number
 const MQTT_PASSWORD = process.env.MQTT_CLIENT_PASSWORD; // mqtt client password
 const DB_PASSWORD = process.env.DB_PASSWORD; // database password
+const WAL_DIR = process.env.WAL_DIR || `${__dirname}/wal`; // where samples are kept until every sink has them
+const BLE_MAX_CONNECTING = Number(process.env.BLE_MAX_CONNECTING) || 3; // connection attempts at once
 
 // database connection options
 const dbOptions = {
@@ -21,18 +37,13 @@ const dbOptions = {
   database: 'RMicrobit',
 }
 
+// influxDB options, the sink pipeline batches and retries the writes
 const influxOpts = {
   host: 'localhost',
   username: 'iotgateway',
   password: DB_PASSWORD,
   database: 'IMicrobit',
-  schema: [{
-    measurement: 'sensor_data',
-    fields: {
-      value: Influx.FieldType.INTEGER
-    },
-    tags: ['room', 'device_ID', 'device_name', 'sensor_ID', 'sensor_name']
-  }]
+  precision: 'ms'
 }
 
 // MQTT connection options
@@ -79,6 +90,13 @@ const { bluetooth } = createBluetooth();
 // Bluetooth standard environmenatal sensing uuid
 const ess_uuid = '0000181a-0000-1000-8000-00805f9b34fb';
 
+// uuids of the ble_co2 sensor characteristics
+const co2_uuid = '00000001-0002-0003-0004-000000000001';
+const batch_uuid = '00000001-0002-0003-0004-000000000004';
+const config_uuid = '00000001-0002-0003-0004-000000000006';
+const temp_uuid = '00002a6e-0000-1000-8000-00805f9b34fb';
+const hum_uuid = '00002a6f-0000-1000-8000-00805f9b34fb';
+
 // function to expand a standard 16 bit uuid to a 128 bit uuid
 const expandUUID = (uuid) => {
   // convert to lower case
@@ -93,6 +111,9 @@ const expandUUID = (uuid) => {
   return `0000${uuid}-0000-1000-8000-00805f9b34fb`;
 }
 
+// a number as an influx integer field, null (left out) if it isn't one
+const influxInt = (value) => Number.isFinite(value) ? BigInt(Math.round(value)) : null;
+
 // function to initialise client connections and get bt adapter
 async function initConnections() {
 
@@ -113,30 +134,27 @@ async function initConnections() {
 
   //connecting to influxDB
   console.log("[INFO]: DB - Creating InfluxDB client...");
-  const influx = new Influx.InfluxDB(influxOpts)
+  const influx = new InfluxWriter(influxOpts)
 
-  // connecting to mqtt broker
+  // connecting to mqtt broker, the client keeps trying in the background so the gateway
+  // starts (and logs samples) while the broker is unreachable
   console.log("[INFO]: MQTT - Starting MQTT client application...");
-  const mqttClient = await (async () => {
+  const mqttClient = mqtt.connect(mqttOptions.host, mqttOptions);
+  mqttClient.on('connect', async () => {
     try {
-      // create a client by connecting to the broker
-      let client = await mqtt.connectAsync(mqttOptions.host, mqttOptions);
       console.log("[SUCCESS]: MQTT - Connected to cloud MQTT broker");
       // publish a status message to the broker
-      await client.publish(`room/status`, JSON.stringify({
+      await mqttClient.publish(`room/status`, JSON.stringify({
         room: ROOM,
         status: 'online'
       }));
       let topics = Array.from(Object.values(sub)) //convert object to array of values
-      let resp = await client.subscribe(topics); //subscribe to all topics
+      let resp = await mqttClient.subscribe(topics); //subscribe to all topics
       console.log(`[INFO]: MQTT - Subscribed to ${resp.map(topicObj => topicObj.topic)}`)
-      return client; // return the client
-    } catch (err) {
-      // log and exit if there is an error
-      console.log(`[ERROR]: MQTT - ${err}`);
-      exit();
-    }
-  })();
+    } catch (err) { console.log(`[ERROR]: MQTT - ${err}`) } // log any error to console
+  });
+  mqttClient.on('error', err => console.log(`[ERROR]: MQTT - ${err}`));
+  mqttClient.on('offline', () => console.log("[ERROR]: MQTT - Broker unreachable, retrying..."));
 
   // get bluetoorh adapter
   console.log("[INFO]: BLE - Getting Bluetooth adapter...");
@@ -158,8 +176,15 @@ async function initConnections() {
 
 // main function
 (async () => {
-  // initialise empty array to store connected devices
-  let connectedDevices = [];
+  // connected devices, with each characteristic's name, flags and decoder resolved at connect
+  const registry = new DeviceRegistry(uuid => {
+    let info = get_uuid(uuid);
+    return {
+      info,
+      name: info.name,
+      decode: uuid === batch_uuid ? decodeBatch : buffer => decodeValue(uuid, buffer)
+    };
+  });
 
   // function to list devices
   const listDevices = async (msg) => {
@@ -176,42 +201,12 @@ async function initConnections() {
     } catch (err) { console.log(`[ERROR]: ${err}`); } // log any error to console
   }
 
-  // function to scan for devices for a given time
-  const timedScan = async (ms) => {
-    await adapter.startDiscovery() // start scanning
-    console.log("[INFO]: BLE - Scanning Devices...");
-
-    // forced delay to allow devices to be found
-    await new Promise(resolve => setTimeout(resolve, ms));
-    await adapter.stopDiscovery() // stop scanning
-    console.log("[INFO]: BLE - Stopped discovery")
-  }
-
-  // function to scan for devices
+  // function to list the devices in range, answered from the scan cache
   const scan = async (client) => {
-    // initialise empty array to store devices
-    let scannedDevices = [];
-
-    // scan for devices
-    await timedScan(3000);
-
-    // get scanned devices
-    device_list = await adapter.devices();
-
-    // for each device
-    for (let i in device_list) {
-      try {
-        // get device object
-        let devObj = await adapter.waitDevice(device_list[i]);
-        // get device name
-        let name = await devObj.getName();
-        // if device is not connected already
-        if (!connectedDevices.find(dev => dev.mac_address === device_list[i])) {
-          // add device to scanned devices array
-          scannedDevices.push({ device_name: name, mac_address: device_list[i] });
-        }
-      } catch (err) { /*pass*/ } // on error do nothing i.e. device is unnamed
-    };
+    // devices heard from recently that have a name and aren't connected already
+    let scannedDevices = scanCache.inRangeDevices()
+      .filter(dev => dev.name && !registry.has(dev.mac))
+      .map(dev => ({ device_name: dev.name, mac_address: dev.mac, rssi: dev.rssi, last_seen: dev.lastSeen }));
     try {
       // publish scanned devices
       await mqttClient.publish(`${client}/scan`, JSON.stringify({
@@ -247,77 +242,85 @@ async function initConnections() {
     } catch (err) { console.log(`[ERROR] DB - ${err}`) } // log any error to console
   }
 
-  // function to connect to a device
-  const connect = async (mac) => {
+  // function to hand a sensor value to the sinks, never waits on them. charName is the name
+  // the registry resolved for the characteristic when the device connected
+  const storeSample = (mac, name, uuid, charName, value, timestamp) => {
+    // a failed measurement (the ESS "not known" marker) is not a sample, and NaN wouldn't
+    // survive the log's JSON anyway
+    if (Number.isNaN(value)) return;
+    pipeline.push({ mac, name, uuid, charName, value, timestamp: timestamp.valueOf() });
+  }
+
+  // function to connect to a device node-ble has found and set up its characteristics, called by
+  // the connection manager. Throws if the device couldn't be set up
+  const setupDevice = async (mac, device) => {
+    let name = scanCache.get(mac)?.name || await device.getName() // get device name
+    await device.connect(); // connect to device
+    const gatt = await device.gatt(); // get devices gatt server
+
+    // if the device doesn't have an environemental sensing service
+    if (!(await gatt.services()).includes(ess_uuid)) {
+      // disconnect from device
+      await device.disconnect();
+      let err = new Error(`Device ${name} does not have ESS service`);
+      err.retry = false; // reconnecting won't change that
+      throw err;
+    }
+    console.log(`[SUCCESS]: BLE - Connected to ${name}`);
+
+    // get the environmental sensing service
+    let service = await gatt.getPrimaryService(ess_uuid);
+
+    // get the characteristic objects and resolve their uuids, flags and decoders once
+    let charObjs = await Promise.all((await service.characteristics()).map(char => service.getCharacteristic(char)));
+    let chars = await registry.resolveChars(charObjs);
+    // names of the characteristics a batch's samples are stored against
+    let [co2Name, tempName, humName] = [co2_uuid, temp_uuid, hum_uuid]
+      .map(uuid => chars.has(uuid) ? chars.get(uuid).name : get_uuid(uuid).name);
+
+    // for each characteristic add an event listener for value change i.e. notify events
+    for (let { uuid, char, decode, name: charName } of chars.values()) {
+      char.on("valuechanged", buffer => {
+        try {
+          // if the characteristic is a batch of samples
+          if (uuid === batch_uuid) {
+            // decode the batch and store each value against its own characteristic
+            for (let sample of decode(buffer)) {
+              storeSample(mac, name, co2_uuid, co2Name, sample.co2, sample.timestamp);
+              storeSample(mac, name, temp_uuid, tempName, sample.temperature, sample.timestamp);
+              storeSample(mac, name, hum_uuid, humName, sample.humidity, sample.timestamp);
+            }
+            return;
+          }
+          // convert the received buffer to a value
+          let data = decode(buffer);
+          console.log(uuid, data);
+          storeSample(mac, name, uuid, charName, data, new Date());
+        } catch (err) { console.log(`[ERROR]: MQTT - ${err}`) } // log any error to console
+      })
+    }
+    return { name, chars };
+  }
+
+  // called once a device is connected and set up
+  const connected = async (mac, device, { name, chars }) => {
     try {
-      await timedScan(500); // scan for device
-      const device = await adapter.waitDevice(mac); // get device from adapter
-      let name = await device.getName() // get device name
-      await device.connect(); // connect to device
-      const gatt = await device.gatt(); // get devices gatt server
-
-      // if the device doesn't have an environemental sensing service
-      if (!(await gatt.services()).includes(ess_uuid)) {
-        // disconnect from device
-        await device.disconnect();
-        console.log(`[ERROR]: BLE - Device ${name} does not have ESS service`); // log error
-        return; // return
+      // add device to the registry of connected devices
+      let entry = registry.add(mac, { name, device, chars });
+      // a reconnect after a dropped connection: turn the notifications that were on back on
+      for (let uuid of entry.notifying) {
+        let resolved = chars.get(uuid);
+        if (!resolved) {
+          entry.notifying.delete(uuid);
+          continue;
+        }
+        await resolved.char.startNotifications()
+          .catch(err => console.log(`[ERROR]: BLE - Notifications of ${uuid} on ${name} not turned back on: ${err}`));
       }
-      console.log(`[SUCCESS]: BLE - Connected to ${name}`);
-
-      // get the environmental sensing service
-      let service = await gatt.getPrimaryService(ess_uuid);
-
-      // for each characteristic in the service
-      let chars = await Promise.all((await service.characteristics()).map(async (char) => {
-        // get characteristic object
-        let charObj = await service.getCharacteristic(char);
-        // add event listener to characteristic for value change i.e. notify events
-        charObj.on("valuechanged", async buffer => {
-          // convert the received buffer to an int
-          let data = Buffer.from(buffer, 'hex').readInt32LE();
-          try {
-            // get characteristic name
-            let uuid = await charObj.getUUID();
-            console.log(uuid, data);
-            let charName = get_uuid(uuid).name
-            // publish the data to the mqtt broker
-
-            let sensor_id = await dbConn.query(`SELECT sensor_id FROM sensors WHERE sensor_UUID = '${expandUUID(uuid)}'`);
-            sensor_id = sensor_id.length ? sensor_id[0].sensor_id : null;
-            if (uuid === "00000001-0002-0003-0004-000000000001") charName = "CO2";
-
-            influx.writePoints([{
-              measurement: 'sensor_data',
-              tags: {
-                room: ROOM,
-                device_ID: mac,
-                device_name: name,
-                sensor_ID: uuid,
-                sensor_name: charName
-              },
-              fields: {
-                value: Number(data)
-              }
-            }],
-              {
-                database: 'IMicrobit',
-                precision: 'ms'
-              })
-            await dbConn.query(`INSERT INTO sensor_data (sensor_id, value, timestamp) VALUES ('${sensor_id}', '${Number(data)}', NOW())`);
-            await mqttClient.publish(`${pub.device}/notify`, JSON.stringify({
-              device: mac,
-              char: charName,
-              value: data.toString()
-            }));
-          } catch (err) { console.log(`[ERROR]: MQTT - ${err}`) } // log any error to console
-        })
-        return charObj; // return characteristic object to mapped array
-      }))
-      // add device to list of connected devices with object of characteristics
-      connectedDevices.push({ device_name: name, mac_address: mac, chars: chars });
       // update device activity to connected
       await updateDeviceAct(mac, 'connect', { name: name });
+      // its sensors may have been added to the database since they were last looked up
+      sensors.invalidate();
       // publish to broker that device has been connected
       await mqttClient.publish(`${pub.device}/status`, JSON.stringify({
         device: mac,
@@ -326,11 +329,34 @@ async function initConnections() {
     } catch (err) { console.log(`[ERROR]: BLE - ${err}`); } // log any error to console
   }
 
+  // called when a device drops its connection, the connection manager reconnects it
+  const lost = async (mac) => {
+    try {
+      console.log(`[ERROR]: BLE - Lost connection to ${mac}`);
+      // remove device from the registry of connected devices, remembering its notifications
+      registry.remove(mac, true);
+      // update device activity to disconnected
+      await updateDeviceAct(mac, 'disconnect');
+      // publish to broker that device has been disconnected
+      await mqttClient.publish(`${pub.device}/status`, JSON.stringify({
+        device: mac,
+        status: 'disconnected'
+      }));
+    } catch (err) { console.log(`[ERROR]: BLE - ${err}`); } // log any error to console
+  }
+
+  // function to connect to a device, and keep it connected
+  const connect = (mac, lastSeen) => connections.want(mac, lastSeen);
+
   // function to disconnect from a device
   const disconnect = async (mac) => {
+    // don't reconnect it
+    connections.unwant(mac);
     try {
-      let device = await adapter.waitDevice(mac); // get device from adapter 
-      let name = await device.getName() // get device name
+      // get device from the registry, or the adapter if it isn't connected
+      let entry = registry.get(mac);
+      let device = entry ? entry.device : await adapter.getDevice(mac);
+      let name = entry ? entry.name : await device.getName() // get device name
       await device.disconnect(); // disconnect from device
       console.log(`[SUCCESS]: BLE - Disconnected from ${name}`);
       // publish to broker that device has been disconnected
@@ -338,8 +364,8 @@ async function initConnections() {
         device: mac,
         status: 'disconnected'
       }));
-      // remove device from list of connected devices
-      connectedDevices.splice(connectedDevices.findIndex(dev => dev.mac_address === mac), 1);
+      // remove device from the registry of connected devices
+      registry.remove(mac);
       // update device activity to disconnected
       updateDeviceAct(mac, 'disconnect');
     } catch (err) { console.log(`[ERROR]: BLE - ${err}`); } // log any error to console
@@ -347,19 +373,90 @@ async function initConnections() {
 
   // initialising database connection, mqtt client and ble adapter
   const { dbConn, mqttClient, adapter, influx } = await initConnections();
+  // sensor ids and sample rows for mariadb
+  const sensors = new SensorStore(dbConn);
+
+  // every sample is logged to disk, then goes to each sink through its own queue, so a slow
+  // database doesn't hold up the live mqtt feed and an unreachable one loses nothing. The mqtt
+  // feed is live only: after a broker outage it carries on with new samples instead of
+  // replaying the old ones from the log, subscribers would take those as current
+  const wal = new Wal(WAL_DIR);
+  const pipeline = new SinkPipeline({ wal })
+    .addSink('mqtt', async samples => {
+      if (!mqttClient.connected) throw new Error('not connected to the broker');
+      // publish the data to the mqtt broker
+      await Promise.all(samples.map(s => mqttClient.publish(`${pub.device}/notify`, JSON.stringify({
+        device: s.mac,
+        char: s.charName,
+        value: s.value.toString(),
+        timestamp: s.timestamp
+      }))));
+    }, { maxQueue: 1000, maxBatch: 50, logged: false, overflow: 'drop-oldest' })
+    .addSink('influx', async samples => {
+      await influx.writeBatch(samples.map(s => ({
+        measurement: 'sensor_data',
+        tags: {
+          room: ROOM,
+          device_ID: s.mac,
+          device_name: s.name,
+          sensor_ID: s.uuid,
+          sensor_name: s.charName
+        },
+        // value has been an integer field since the first write, so it keeps the whole units
+        // and the 0.01 resolution of temperature and humidity goes in a field of its own
+        fields: {
+          value: influxInt(Number(s.value)),
+          value_centi: influxInt(Number(s.value) * 100)
+        },
+        timestamp: s.timestamp
+      })));
+    }, { maxQueue: 20000, maxBatch: 5000, maxWaitMs: 1000 })
+    .addSink('mariadb', async samples => {
+      let rows = [], skipped = 0;
+      for (let s of samples) {
+        // cached after the first sample from each sensor
+        let id = await sensors.sensorId(expandUUID(s.uuid));
+        let value = Number(s.value);
+        // a sensor missing from the sensors table or a value that isn't a number can never be
+        // inserted, leave it out rather than have the whole batch refused
+        if (id === null || !Number.isFinite(value)) skipped++;
+        else rows.push([id, value, new Date(s.timestamp)]);
+      }
+      if (skipped) console.log(`[ERROR]: DB - ${skipped} samples skipped, unknown sensor or not a number`);
+      await sensors.insert(rows);
+    }, { maxQueue: 20000, maxBatch: 1000, maxWaitMs: 1000 });
+
+  // write out any queued samples before exiting
+  ['SIGINT', 'SIGTERM'].forEach(signal => process.once(signal, async () => {
+    console.log("[INFO]: PIPE - Writing queued samples, the rest stays in the log...");
+    await pipeline.close();
+    wal.close();
+    exit();
+  }));
+
+  // discovery runs in the background and keeps a table of the devices in range
+  const discovery = new SharedDiscovery(adapter);
+  const scanCache = new ScanCache(adapter);
+  try {
+    await scanCache.start();
+  } catch (err) {
+    // log and exit if there is an error
+    console.log(`[ERROR]: BLE - ${err}`);
+    exit();
+  }
+
+  // connections go through the manager, a few at a time, finding the devices in the scan cache
+  const connections = new ConnectionManager(adapter, setupDevice, { maxConnecting: BLE_MAX_CONNECTING, scanCache, discovery });
+  connections.on('connected', connected);
+  connections.on('lost', lost);
 
   // initialise all devices in database as disconnected
   await dbConn.query(`UPDATE devices SET connected = FALSE`);
 
-  // attempt connect to all devices on startup
-  await dbConn.query(`SELECT * FROM devices`).then(async devices => {
-    devices.forEach(async device => {
-      // attempt to connect to device
-      connect(device.mac_address).catch(err => {
-        // log any error to console
-        console.log(`[ERROR]: BLE - Unable to connect to ${device.device_name}\n${err}`)
-      });
-    })
+  // attempt connect to all devices on startup, the ones last heard from most recently first
+  await dbConn.query(`SELECT d.mac_address, MAX(a.timestamp) AS last_seen FROM devices d
+    LEFT JOIN device_activity a ON a.device_id = d.device_id GROUP BY d.device_id`).then(devices => {
+    devices.forEach(device => connect(device.mac_address, device.last_seen ? device.last_seen.getTime() : 0));
   }).catch(err => { console.log(`[ERROR]: DB - ${err}`) }); // log any error to console
 
 
@@ -381,6 +478,8 @@ async function initConnections() {
     else if (topic.includes(sub.config.replace('#', ''))) {
       // get the config command
       let [, cmd] = topic.split('config/');
+      // devices coming and going may change the sensors table, look the ids up again
+      if (cmd.startsWith('connect') || cmd.startsWith('disconnect')) sensors.invalidate();
       // test the command
       switch (cmd) {
         case 'list': // if the command is list
@@ -390,14 +489,14 @@ async function initConnections() {
           scan(msg.clientID); // scan for devices
           break;
         case 'connect': // if the command is connect
-          connect(msg.device); // connect to device
+          connect(msg.device, Date.now()); // connect to device, ahead of the ones waiting to reconnect
           break;
         case 'disconnect': // if the command is disconnect
           disconnect(msg.device); // disconnect from device
           break;
         case 'disconnectAll': // if the command is disconnect all
           // disconnect from all devices
-          connectedDevices.forEach(dev => disconnect(dev.mac_address));
+          registry.macs().forEach(mac => disconnect(mac));
           break;
         default: // if none of the above log an error
           console.log(`[ERROR]: MQTT - Unknown command ${cmd}`);
@@ -415,21 +514,14 @@ async function initConnections() {
       let mac = msg.device;
       let uuid = msg.char;
       let cmd = msg.cmd;
-      // get the devices characteristic object
-      let chars = connectedDevices.find(dev => dev.mac_address === msg.device)?.chars;
+      // get the connected device
+      let entry = registry.get(mac);
       // if no uuid in the message topic
       if (!uuid) {
         try {
-          // create an array of characteristics 
-          let charResp = await Promise.all(chars.map(async char => {
-            // get the characteristic uuid object
-            let charObj = get_uuid(await char.getUUID())
-            // get the characteristic permissions
-            charObj.flags = await char.getFlags();
-            return charObj; // return characteristic object to the mapped array
-          }));
-
-          resp.chars = charResp; // set the response characteristics
+          if (!entry) throw new Error(`${mac} is not connected`);
+          // the characteristics with their permissions, resolved when the device connected
+          resp.chars = entry.listing; // set the response characteristics
           // publish the array of characteristic objects to the mqtt broker
           await mqttClient.publish(`${msg.clientID}/chars`, JSON.stringify(resp));
         }
@@ -440,21 +532,23 @@ async function initConnections() {
         uuid = expandUUID(uuid); // expand the UUID to 128 bits
 
         // get the characteristic object by uuid
-        let char = await (async () => {
-          // find the matching characteristic object
-          for (let i in chars) {
-            if (await chars[i].getUUID() === uuid) return chars[i];
-          }
-        })();
+        let resolved = registry.char(mac, uuid);
+        let char = resolved?.char;
         // if the characteristic object is not found
+        if (!char) {
+          console.log(`[ERROR]: BLE - ${mac} has no characteristic ${uuid}`);
+          await mqttClient.publish(`${msg.clientID}/cmd`, JSON.stringify({ ...resp, cmd, success: false, data: 'Unknown characteristic' }))
+            .catch(err => console.log(`[ERROR]: MQTT - ${err}`));
+          return;
+        }
 
-        resp.char = get_uuid(uuid).name; // set the response characteristic
+        resp.char = resolved.info.name; // set the response characteristic
         // if the command issued is read
         if (cmd === 'read') {
           resp.cmd = 'read'; // set the response command
           try {
-            // read the characteristic value from the device and convert to an int
-            let data = Buffer.from((await char.readValue()), 'hex').readInt32LE();
+            // read the characteristic value from the device and convert to a value
+            let data = resolved.decode(await char.readValue());
             // update the device activity database
             await updateDeviceAct(mac, `read`, { data: uuid });
             resp.data = data; // set the response data
@@ -472,8 +566,14 @@ async function initConnections() {
         else if (cmd === 'write') {
           resp.cmd = 'write'; // set the response command
           try {
-            // convert the message to a buffer and write to the characteristic
-            await char.writeValue(Buffer.from(msg.data.toString()));
+            // the config characteristic takes binary tag-length-value entries, a bare number sets the threshold
+            // anything else is written as is
+            let data = msg.data.toString();
+            if (uuid === config_uuid) {
+              let config = /^\s*\{/.test(data) ? JSON.parse(data) : data.trim();
+              await char.writeValue(encodeConfig(config));
+            }
+            else await char.writeValue(Buffer.from(data));
             // update the device activity database
             await updateDeviceAct(mac, `write`, { data: uuid });
             resp.success = true; // set the response success
@@ -494,12 +594,14 @@ async function initConnections() {
             // if the characteristic is already notifying
             if (await char.isNotifying()) {
               await char.stopNotifications(); // stop notifying
+              entry.notifying.delete(uuid);
               // update the device activity database
               await updateDeviceAct(mac, `notify off`, { data: uuid });
             }
             // if the characteristic is not already notifying
             else {
               await char.startNotifications(); // start notifying
+              entry.notifying.add(uuid); // and again after a reconnect
               // update the device activity database
               await updateDeviceAct(mac, `notify on`, { data: uuid });
             }
@@ -0,0 +1,114 @@
+// InfluxDB (1.x) writer
+// a batch of points is turned into line protocol and sent as one gzipped /write request. Batching,
+// queueing and retries are left to the caller (see sinkPipeline.js)
+const http = require('http');
+const zlib = require('zlib');
+const { promisify } = require('util');
+
+const gzip = promisify(zlib.gzip);
+
+const DEFAULTS = {
+  host: 'localhost',
+  port: 8086,
+  precision: 'ms',
+  requestTimeoutMs: 10000
+};
+
+// line protocol escaping, see https://docs.influxdata.com/influxdb/v1.8/write_protocols/line_protocol_reference/
+const escapeMeasurement = (s) => String(s).replace(/[, ]/g, '\\$&');
+const escapeTag = (s) => String(s).replace(/[,= ]/g, '\\$&');
+const escapeString = (s) => String(s).replace(/["\\]/g, '\\$&');
+
+// a number is written as a float, a bigint as an integer (the i suffix). Influx fixes a
+// field's type on the first write to a shard, so a field must keep the type it started with
+const formatField = (value) => {
+  if (value === undefined || value === null) return null;
+  if (typeof value === 'bigint') return `${value}i`;
+  if (typeof value === 'boolean') return value ? 'true' : 'false';
+  if (typeof value === 'number') return Number.isFinite(value) ? String(value) : null;
+  return `"${escapeString(value)}"`;
+}
+
+const formatTime = (timestamp, precision) => {
+  if (timestamp === undefined) return '';
+  let ms = timestamp instanceof Date ? timestamp.getTime() : Number(timestamp);
+  switch (precision) {
+    case 's': return ` ${Math.floor(ms / 1000)}`;
+    case 'us': return ` ${ms * 1000}`;
+    case 'ns': return ` ${BigInt(ms) * 1000000n}`;
+    default: return ` ${ms}`;
+  }
+}
+
+// one point to a line, tags sorted by key as influx prefers. Empty tags and null fields are
+// left out (influx rejects them), null if the point has no usable field
+const toLine = (point, precision) => {
+  let line = escapeMeasurement(point.measurement);
+  for (let key of Object.keys(point.tags || {}).sort()) {
+    let value = point.tags[key];
+    if (value === undefined || value === null || value === '') continue;
+    line += `,${escapeTag(key)}=${escapeTag(value)}`;
+  }
+  let fields = [];
+  for (let [key, value] of Object.entries(point.fields || {})) {
+    let formatted = formatField(value);
+    if (formatted !== null) fields.push(`${escapeTag(key)}=${formatted}`);
+  }
+  if (!fields.length) return null;
+  return `${line} ${fields.join(',')}${formatTime(point.timestamp, precision)}`;
+}
+
+class InfluxWriter {
+  constructor(options) {
+    this.opts = { ...DEFAULTS, ...options };
+    this.stats = { written: 0, requests: 0, rejected: 0 };
+  }
+
+  // write points in one request. Throws if they weren't written, with retry = false on an error
+  // sending them again won't fix; retrying is up to the caller, which keeps the points until then
+  async writeBatch(points) {
+    let lines = [];
+    for (let point of points) {
+      let line = toLine(point, this.opts.precision);
+      if (line === null) this.stats.rejected++;
+      else lines.push(line);
+    }
+    if (!lines.length) return;
+    let body = await gzip(lines.join('\n'));
+    this.stats.requests++;
+    await this.post(body);
+    this.stats.written += lines.length;
+  }
+
+  post(body) {
+    let { host, port, database, username, password, precision, requestTimeoutMs } = this.opts;
+    let headers = {
+      'Content-Type': 'text/plain; charset=utf-8',
+      'Content-Encoding': 'gzip',
+      'Content-Length': body.length
+    };
+    if (username) headers.Authorization = `Basic ${Buffer.from(`${username}:${password || ''}`).toString('base64')}`;
+    let path = `/write?db=${encodeURIComponent(database)}&precision=${precision}`;
+    return new Promise((resolve, reject) => {
+      let req = http.request({ host, port, path, method: 'POST', headers, timeout: requestTimeoutMs }, (res) => {
+        let text = '';
+        res.setEncoding('utf8');
+        res.on('data', chunk => text += chunk);
+        res.on('end', () => {
+          if (res.statusCode === 204 || res.statusCode === 200) return resolve();
+          let err = new Error(`HTTP ${res.statusCode} ${text.trim()}`);
+          err.retry = res.statusCode >= 500 || res.statusCode === 429;
+          reject(err);
+        });
+      });
+      req.on('timeout', () => req.destroy(new Error('request timed out')));
+      req.on('error', (err) => {
+        err.retry = true; // connection refused, reset or timed out
+        reject(err);
+      });
+      req.end(body);
+    });
+  }
+}
+
+module.exports = { InfluxWriter, toLine };
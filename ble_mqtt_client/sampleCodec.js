@@ -0,0 +1,133 @@
+// decoders for the values sent by the ble_co2 firmware
+// the sample batch wire format is documented in low_level/ble_co2/src/sample_codec.h
+
+const SAMPLE_CODEC_VERSION = 3;
+// ESS "value is not known" markers, sent for a failed measurement, see low_level/ble_co2/src/ess_fixed.h
+const TEMPERATURE_UNKNOWN = -0x8000;
+const HUMIDITY_UNKNOWN = 0xffff;
+
+// an ESS value in 0.01 units to a number, NaN for the marker
+const centi = (value, unknown) => value === unknown ? NaN : value / 100;
+
+// configuration characteristic tags, see low_level/ble_co2/src/config_tlv.h
+const CONFIG_TAGS = {
+  threshold: 1, // ppm
+  hysteresis: 2, // ppm
+  minInterval: 3, // s
+  maxInterval: 4, // s
+  slope: 5, // ppm/minute
+  deadband: 6, // ppm
+  calibration: 7 // ppm, write only
+};
+
+// read an unsigned LEB128 varint, returns [value, next offset]
+const readUVarint = (buf, pos) => {
+  let value = 0;
+  for (let shift = 0; shift < 35; shift += 7) {
+    if (pos >= buf.length) throw new Error('Truncated sample batch');
+    let byte = buf[pos++];
+    value += (byte & 0x7f) * 2 ** shift; // multiply rather than shift to stay unsigned
+    if (!(byte & 0x80)) return [value, pos];
+  }
+  throw new Error('Malformed varint in sample batch');
+}
+
+// undo the zigzag mapping 0,1,2,3,4 -> 0,-1,1,-2,2
+const zigzagDecode = (value) => (value % 2) ? -(value + 1) / 2 : value / 2;
+
+// decode a batch buffer into an array of samples in physical units
+// the seconds between samples are in the batch, timestamps are rebuilt backwards from the age
+// of the last sample
+module.exports.decodeBatch = (buffer, now = Date.now()) => {
+  let buf = Buffer.from(buffer);
+  if (buf.length < 4 || buf[0] !== SAMPLE_CODEC_VERSION) throw new Error('Unsupported sample batch');
+  let count = buf[1];
+  let age = buf.readUInt16LE(2);
+  let pos = 4;
+
+  let samples = [], offsets = []; // offsets: seconds since the first sample
+  let co2 = 0, temp = 0, hum = 0, offset = 0;
+  for (let i = 0; i < count; i++) {
+    let gap = 0;
+    if (i > 0) [gap, pos] = readUVarint(buf, pos);
+    let fields = [];
+    for (let f = 0; f < 3; f++) {
+      let value;
+      [value, pos] = readUVarint(buf, pos);
+      fields.push(value);
+    }
+    if (i === 0) { // the first sample is absolute
+      [co2, temp, hum] = [fields[0], zigzagDecode(fields[1]), fields[2]];
+    } else { // the rest are deltas from the previous sample
+      offset += gap;
+      co2 += zigzagDecode(fields[0]);
+      temp += zigzagDecode(fields[1]);
+      hum += zigzagDecode(fields[2]);
+    }
+    offsets.push(offset);
+    samples.push({
+      co2: co2, // ppm
+      temperature: centi(temp, TEMPERATURE_UNKNOWN), // degC
+      humidity: centi(hum, HUMIDITY_UNKNOWN) // %RH
+    });
+  }
+  // the last sample was taken age seconds before now
+  let first = now - (age + offset) * 1000;
+  return samples.map((sample, i) => ({ timestamp: new Date(first + offsets[i] * 1000), ...sample }));
+}
+
+// decode the configuration characteristic into an object keyed by the names in CONFIG_TAGS
+const decodeConfig = (buf) => {
+  let config = {};
+  for (let pos = 0; pos + 2 <= buf.length; pos += 2 + buf[pos + 1]) {
+    let name = Object.keys(CONFIG_TAGS).find(key => CONFIG_TAGS[key] === buf[pos]);
+    if (name && buf[pos + 1] === 2 && pos + 4 <= buf.length) config[name] = buf.readUInt16LE(pos + 2);
+  }
+  return config;
+}
+
+// encode a configuration write, either an object keyed by the names in CONFIG_TAGS
+// or a bare number which sets the co2 threshold
+module.exports.encodeConfig = (config) => {
+  if (typeof config !== 'object') config = { threshold: config };
+  let entries = Object.entries(config).map(([name, value]) => {
+    let tag = CONFIG_TAGS[name];
+    value = Number(value);
+    if (!tag) throw new Error(`Unknown config field ${name}`);
+    if (!Number.isInteger(value) || value < 0 || value > 0xffff) throw new Error(`Invalid value for ${name}`);
+    let entry = Buffer.alloc(4);
+    entry[0] = tag;
+    entry[1] = 2; // every value is a uint16
+    entry.writeUInt16LE(value, 2);
+    return entry;
+  });
+  return Buffer.concat(entries);
+}
+
+// decode a single characteristic value by uuid
+// ESS temperature is a sint16 in 0.01 degC and ESS humidity a uint16 in 0.01 %RH, NaN if not known,
+// the power characteristic is struct power_stats from low_level/lib/include/power.h, the log and diagnostics are text,
+// every other characteristic is sent as a little endian int32
+module.exports.decodeValue = (uuid, buffer) => {
+  let buf = Buffer.from(buffer);
+  switch (uuid) {
+    case '00002a6e-0000-1000-8000-00805f9b34fb': // temperature
+      return centi(buf.readInt16LE(), TEMPERATURE_UNKNOWN);
+    case '00002a6f-0000-1000-8000-00805f9b34fb': // humidity
+      return centi(buf.readUInt16LE(), HUMIDITY_UNKNOWN);
+    case '00000001-0002-0003-0004-000000000007': // recent log output
+    case '00000001-0002-0003-0004-000000000008': // diagnostics report
+      return buf.toString('utf8');
+    case '00000001-0002-0003-0004-000000000006': // configuration
+      return decodeConfig(buf);
+    case '00000001-0002-0003-0004-000000000005': // power stats
+      return {
+        activeMs: buf.readUInt32LE(0),
+        idleMs: buf.readUInt32LE(4),
+        chargeUAh: buf.readUInt32LE(8),
+        state: buf[12] ? 'idle' : 'active'
+      };
+    default:
+      return buf.readInt32LE();
+  }
+}
@@ -0,0 +1,147 @@
+// live table of the BLE devices around the gateway
+// discovery runs in the background the whole time, and the table is kept up to date from the
+// signals BlueZ sends anyway: InterfacesAdded when it finds a device, PropertiesChanged when
+// a device's RSSI, name, services or connection change (every advertisement with
+// DuplicateData on) and InterfacesRemoved when it forgets one. Lookups only read the table,
+// so answering a scan or checking whether a device is in range never waits on D-Bus.
+// The cache talks to BlueZ over a system bus connection of its own, so it only uses
+// node-ble's public API and every Variant it sees comes from this copy of dbus-next.
+const { EventEmitter } = require('events');
+const { systemBus, Message, Variant } = require('dbus-next');
+
+const DEFAULTS = {
+  staleMs: 30000 // a device not heard from for this long is out of range
+};
+
+const ADAPTER = 'org.bluez.Adapter1';
+const DEVICE = 'org.bluez.Device1';
+
+// /org/bluez/hci0/dev_AA_BB_CC_DD_EE_FF -> AA:BB:CC:DD:EE:FF
+const pathMac = (path) => {
+  let match = /\/dev_([0-9A-F_]{17})$/i.exec(path);
+  return match ? match[1].replace(/_/g, ':').toUpperCase() : null;
+}
+
+// emits 'seen' (entry) when a device shows up, or comes back after being out of range
+class ScanCache extends EventEmitter {
+  constructor(adapter, options) {
+    super();
+    this.adapter = adapter; // node-ble adapter
+    this.opts = { ...DEFAULTS, ...options };
+    this.bus = null;
+    this.prefix = null; // /org/bluez/hciN/, found by the adapter's address
+    this.devices = new Map(); // mac -> { mac, name, rssi, lastSeen, uuids, connected }
+    this.waiters = new Map(); // mac -> [resolve]
+  }
+
+  async start() {
+    let bus = this.bus = systemBus();
+    let root = await bus.getProxyObject('org.bluez', '/');
+    let objects = root.getInterface('org.freedesktop.DBus.ObjectManager');
+    let managed = await objects.GetManagedObjects();
+    let address = await this.adapter.getAddress();
+    let path = Object.keys(managed).find(path => managed[path][ADAPTER] &&
+      managed[path][ADAPTER].Address.value === address);
+    if (!path) throw new Error(`No BlueZ adapter with address ${address}`);
+    this.prefix = `${path}/`;
+
+    // every PropertiesChanged from BlueZ for this adapter, without a proxy object per device
+    await bus.call(new Message({
+      destination: 'org.freedesktop.DBus',
+      path: '/org/freedesktop/DBus',
+      interface: 'org.freedesktop.DBus',
+      member: 'AddMatch',
+      signature: 's',
+      body: [`type='signal',sender='org.bluez',interface='org.freedesktop.DBus.Properties',` +
+        `member='PropertiesChanged',path_namespace='${this.prefix.slice(0, -1)}'`]
+    }));
+    bus.on('message', msg => {
+      if (msg.member !== 'PropertiesChanged' || msg.body[0] !== DEVICE || !msg.path.startsWith(this.prefix)) return;
+      this.update(msg.path, msg.body[1], msg.body[2]);
+    });
+
+    objects.on('InterfacesAdded', (path, interfaces) => {
+      if (interfaces[DEVICE] && path.startsWith(this.prefix)) this.update(path, interfaces[DEVICE], [], true);
+    });
+    objects.on('InterfacesRemoved', (path, interfaces) => {
+      if (interfaces.includes(DEVICE)) this.devices.delete(pathMac(path));
+    });
+    // the devices BlueZ already knows, not seen until they advertise
+    for (let [path, interfaces] of Object.entries(managed)) {
+      if (interfaces[DEVICE] && path.startsWith(this.prefix)) this.update(path, interfaces[DEVICE], [], false);
+    }
+
+    // LE only, and a signal for every advertisement so lastSeen and the RSSI stay current.
+    // BlueZ keeps a discovery filter per client and applies it to that client's own session,
+    // so the cache runs its session on its own bus; BlueZ merges it with node-ble's
+    let hci = (await bus.getProxyObject('org.bluez', path)).getInterface(ADAPTER);
+    await hci.SetDiscoveryFilter({
+      Transport: new Variant('s', 'le'),
+      DuplicateData: new Variant('b', true)
+    });
+    await hci.StartDiscovery();
+    console.log(`[INFO]: BLE - Scan cache started with ${this.devices.size} known devices`);
+  }
+
+  update(path, props, invalidated = [], seen = true) {
+    let mac = pathMac(path);
+    if (!mac) return;
+    let entry = this.devices.get(mac);
+    let fresh = !entry || !this.inRange(entry);
+    if (!entry) {
+      entry = { mac, name: null, rssi: null, lastSeen: 0, uuids: [], connected: false };
+      this.devices.set(mac, entry);
+    }
+    let value = (key) => props[key] instanceof Variant ? props[key].value : props[key];
+    if ('Name' in props) entry.name = value('Name');
+    else if ('Alias' in props && !entry.name) entry.name = value('Alias');
+    if ('UUIDs' in props) entry.uuids = value('UUIDs');
+    if ('Connected' in props) entry.connected = value('Connected');
+    if ('RSSI' in props) entry.rssi = value('RSSI');
+    if (invalidated.includes('RSSI')) entry.rssi = null;
+    // RSSI, ManufacturerData and ServiceData only change when an advertisement comes in
+    if (seen && ('RSSI' in props || 'ManufacturerData' in props || 'ServiceData' in props || 'Connected' in props)) {
+      entry.lastSeen = Date.now();
+      if (fresh) this.emit('seen', entry);
+      (this.waiters.get(mac) || []).forEach(resolve => resolve(entry));
+      this.waiters.delete(mac);
+    }
+  }
+
+  inRange(entry) {
+    return entry.connected || Date.now() - entry.lastSeen < this.opts.staleMs;
+  }
+
+  get(mac) {
+    return this.devices.get(mac.toUpperCase());
+  }
+
+  // the devices heard from within staleMs, strongest signal first
+  inRangeDevices() {
+    return [...this.devices.values()]
+      .filter(entry => this.inRange(entry))
+      .sort((a, b) => (b.rssi ?? -127) - (a.rssi ?? -127));
+  }
+
+  // resolves with the entry once the device is in range, rejects after timeoutMs
+  waitFor(mac, timeoutMs) {
+    mac = mac.toUpperCase();
+    let entry = this.devices.get(mac);
+    if (entry && this.inRange(entry)) return Promise.resolve(entry);
+    return new Promise((resolve, reject) => {
+      let timer = setTimeout(() => {
+        let waiters = this.waiters.get(mac) || [];
+        waiters.splice(waiters.indexOf(done), 1);
+        reject(new Error(`${mac} not found within ${timeoutMs}ms`));
+      }, timeoutMs);
+      let done = (entry) => {
+        clearTimeout(timer);
+        resolve(entry);
+      };
+      if (!this.waiters.has(mac)) this.waiters.set(mac, []);
+      this.waiters.get(mac).push(done);
+    });
+  }
+}
+
+module.exports = { ScanCache };
@@ -0,0 +1,63 @@
+// MariaDB side of the sample path
+// sensor ids are looked up by UUID once and cached (invalidate() when the devices or their
+// sensors may have changed), sample rows are written with one batched prepared INSERT. The
+// queueing and batching of the rows is done by the MariaDB sink of the pipeline
+const INSERT_SAMPLE = 'INSERT INTO sensor_data (sensor_id, value, timestamp) VALUES (?, ?, ?)';
+// how long a uuid missing from the sensors table is taken to stay missing, so a sensor added
+// later is picked up without every sample from an unknown one costing a query
+const MISS_TTL_MS = 60000;
+
+class SensorStore {
+  constructor(pool) {
+    this.pool = pool;
+    this.ids = new Map(); // 128 bit uuid -> promise of sensor_id (or null)
+    this.misses = new Map(); // 128 bit uuid -> when it was found missing
+    this.stats = { lookups: 0, written: 0, batches: 0 };
+  }
+
+  // sensor_id for a 128 bit uuid, null if it isn't in the sensors table. Concurrent
+  // lookups of the same uuid share one query, a null is looked up again after MISS_TTL_MS
+  sensorId(uuid) {
+    let id = this.ids.get(uuid);
+    let missed = this.misses.get(uuid);
+    if (id === undefined || (missed !== undefined && Date.now() - missed >= MISS_TTL_MS)) {
+      this.stats.lookups++;
+      this.misses.delete(uuid);
+      id = this.pool.query('SELECT sensor_id FROM sensors WHERE sensor_UUID = ?', [uuid])
+        .then(rows => {
+          if (rows.length) return rows[0].sensor_id;
+          this.misses.set(uuid, Date.now());
+          return null;
+        })
+        .catch(err => {
+          this.ids.delete(uuid); // don't cache the failure
+          throw err;
+        });
+      this.ids.set(uuid, id);
+    }
+    return id;
+  }
+
+  // forget the cached ids, e.g. after a device is connected or disconnected
+  invalidate() {
+    this.ids.clear();
+    this.misses.clear();
+  }
+
+  // write [sensor_id, value, timestamp] rows in one round trip, throws if they weren't written.
+  // A data or constraint error (SQLSTATE class 22 or 23, e.g. an out of range value or an
+  // unknown sensor_id) gets retry = false, the same rows would be refused again
+  async insert(rows) {
+    if (!rows.length) return;
+    try {
+      await this.pool.batch(INSERT_SAMPLE, rows);
+    } catch (err) {
+      if (/^2[23]/.test(err.sqlState)) err.retry = false;
+      throw err;
+    }
+    this.stats.written += rows.length;
+    this.stats.batches++;
+  }
+}
+
+module.exports = { SensorStore };
@@ -0,0 +1,272 @@
+// sample fan-out for the gateway
+// samples are pushed onto one ingest queue, which is moved to every sink's own queue on the
+// next turn of the event loop so the BLE handlers never wait on a backend. Each sink has a
+// worker that takes batches off its queue and hands them to the sink's write function, one
+// batch at a time, so a slow or unreachable backend only backs up its own queue.
+//
+// With a write-ahead log (see wal.js) every sample is appended to it before it is queued and
+// a sink's cursor moves on as its batches are written. A sink whose queue overflows drops the
+// queue instead of samples and reads on from the log until it has caught up, and failed
+// batches are retried until they are written or the write function marks the error with
+// retry = false (the data will never be accepted). Without a log the overflow policy and
+// maxRetries decide what is dropped. A sink with logged = false doesn't use the log either,
+// for a live feed where a late sample is worse than a lost one.
+//
+// sink options:
+//   maxQueue    samples the sink's queue holds before the overflow policy kicks in
+//   overflow    'drop-oldest' keeps the newest samples, 'drop-newest' keeps the oldest,
+//               without a log
+//   maxBatch    samples per write
+//   maxWaitMs   longest the oldest sample waits for a batch to fill, 0 writes straight away
+//   maxRetries  times a failed batch is written again before it is dropped, without a log
+//   retryMs     first retry delay, doubled for each retry up to retryMaxMs
+//   logged      false to keep the sink off the log, it never replays old samples
+const DEFAULTS = {
+  maxQueue: 10000,
+  overflow: 'drop-oldest',
+  maxBatch: 500,
+  maxWaitMs: 0,
+  maxRetries: 5,
+  retryMs: 500,
+  retryMaxMs: 30000,
+  logged: true
+};
+
+const sleep = (ms) => new Promise(resolve => setTimeout(resolve, ms));
+
+// array backed FIFO, the consumed head is only cut off now and then instead of on every shift
+class Queue {
+  constructor() {
+    this.items = [];
+    this.head = 0;
+  }
+  get length() { return this.items.length - this.head; }
+  push(item) { this.items.push(item); }
+  peek() { return this.items[this.head]; }
+  shift() {
+    let item = this.items[this.head++];
+    this.compact();
+    return item;
+  }
+  take(n) {
+    let items = this.items.slice(this.head, this.head + n);
+    this.head += items.length;
+    this.compact();
+    return items;
+  }
+  compact() {
+    if (this.head === this.items.length) {
+      this.items = [];
+      this.head = 0;
+    } else if (this.head > 1024 && this.head * 2 > this.items.length) {
+      this.items = this.items.slice(this.head);
+      this.head = 0;
+    }
+  }
+}
+
+class Sink {
+  constructor(name, write, options, wal) {
+    this.name = name;
+    this.write = write;
+    this.opts = { ...DEFAULTS, ...options };
+    this.wal = wal;
+    this.queue = new Queue(); // { sample, time, seq } in arrival order
+    this.waiting = null; // the worker waiting for samples
+    this.closing = false;
+    this.stats = { written: 0, batches: 0, dropped: 0, spilled: 0, failed: 0, retries: 0, maxQueued: 0, latencyMs: 0 };
+    if (wal) {
+      // seq of the last sample taken off the queue or read from the log
+      this.taken = wal.cursor(name);
+      // catch up on what was logged but not written before the last shutdown
+      this.reader = this.taken < wal.lastSeq ? wal.reader(this.taken) : null;
+    }
+    this.done = this.run();
+  }
+
+  enqueue(sample, time, seq) {
+    // catching up, or already read from the log while this sample was in the ingest queue
+    if (this.reader || (this.wal && seq <= this.taken)) return;
+    if (this.queue.length >= this.opts.maxQueue) {
+      if (this.wal) return this.spill();
+      this.stats.dropped++;
+      if (this.opts.overflow === 'drop-newest') return;
+      this.queue.shift();
+    }
+    this.queue.push({ sample, time, seq });
+    if (this.queue.length > this.stats.maxQueued) this.stats.maxQueued = this.queue.length;
+    if (this.waiting && this.queue.length >= this.waiting.needed) this.waiting.resolve();
+  }
+
+  // drop the queue and read the samples from the log instead
+  spill() {
+    this.stats.spilled += this.queue.length;
+    this.queue = new Queue();
+    this.reader = this.wal.reader(this.taken);
+    if (this.waiting) this.waiting.resolve();
+  }
+
+  // wait until the queue holds needed samples, the timeout runs out or the sink is closed
+  until(needed, timeoutMs) {
+    return new Promise(resolve => {
+      let timer = timeoutMs === undefined ? null : setTimeout(() => done(), timeoutMs);
+      let done = () => {
+        clearTimeout(timer);
+        this.waiting = null;
+        resolve();
+      };
+      this.waiting = { needed, resolve: done };
+    });
+  }
+
+  async run() {
+    for (;;) {
+      if (this.reader) {
+        // whatever is left stays in the log for the next start
+        if (this.closing) return this.reader.close();
+        let records = this.reader.next(this.opts.maxBatch);
+        this.stats.dropped += this.reader.skipped;
+        this.reader.skipped = 0;
+        if (!records.length) {
+          // caught up, from here on the samples come through the queue
+          this.reader.close();
+          this.reader = null;
+          continue;
+        }
+        this.taken = records[records.length - 1].seq;
+        await this.deliver(records);
+        continue;
+      }
+      if (!this.queue.length) {
+        if (this.closing) return;
+        await this.until(1);
+        continue;
+      }
+      let age = Date.now() - this.queue.peek().time;
+      if (this.queue.length < this.opts.maxBatch && age < this.opts.maxWaitMs && !this.closing) {
+        await this.until(this.opts.maxBatch, this.opts.maxWaitMs - age);
+        continue; // the queue may have been spilled meanwhile
+      }
+      let batch = this.queue.take(this.opts.maxBatch);
+      if (this.wal) this.taken = batch[batch.length - 1].seq;
+      await this.deliver(batch);
+    }
+  }
+
+  async deliver(batch) {
+    for (let attempt = 0; ; attempt++) {
+      try {
+        await this.write(batch.map(entry => entry.sample));
+        this.stats.written += batch.length;
+        this.stats.batches++;
+        // replayed samples have no arrival time
+        if (batch[0].time) this.stats.latencyMs = Date.now() - batch[0].time;
+        if (this.wal) this.wal.ack(this.name, batch[batch.length - 1].seq);
+        return;
+      } catch (err) {
+        this.stats.failed++;
+        // with a log an unwritten batch is kept unless it can never be written,
+        // on shutdown it is left to the next start
+        let keep = this.wal && err.retry !== false;
+        if (keep && this.closing) return;
+        if (!keep && (attempt >= this.opts.maxRetries || this.closing || err.retry === false)) {
+          this.stats.dropped += batch.length;
+          console.log(`[ERROR]: PIPE - ${this.name} dropped ${batch.length} samples: ${err}`);
+          if (this.wal) this.wal.ack(this.name, batch[batch.length - 1].seq);
+          return;
+        }
+        if (!attempt) console.log(`[ERROR]: PIPE - ${this.name} write failed, retrying: ${err}`);
+        this.stats.retries++;
+        await sleep(Math.min(this.opts.retryMaxMs, this.opts.retryMs * 2 ** attempt));
+      }
+    }
+  }
+
+  metrics() {
+    let oldest = this.queue.peek();
+    return {
+      ...this.stats,
+      queued: this.queue.length,
+      lagMs: oldest ? Date.now() - oldest.time : 0, // age of the oldest sample not yet written
+      behind: this.wal ? this.wal.lastSeq - this.wal.cursor(this.name) : this.queue.length // samples not yet written
+    };
+  }
+
+  // write what is queued and stop the worker, failed batches are no longer retried
+  close() {
+    this.closing = true;
+    if (this.waiting) this.waiting.resolve();
+    return this.done;
+  }
+}
+
+class SinkPipeline {
+  // options.wal is an open Wal to log the samples to, none to only keep them in memory
+  constructor(options) {
+    this.opts = { maxIngest: 10000, metricsLogMs: 60000, ...options };
+    this.wal = this.opts.wal;
+    this.sinks = [];
+    this.ingest = new Queue();
+    this.ingestDropped = 0;
+    this.scheduled = false;
+    if (this.opts.metricsLogMs) {
+      this.timer = setInterval(() => this.logMetrics(), this.opts.metricsLogMs);
+      this.timer.unref(); // don't keep the process alive just for the log
+    }
+  }
+
+  // add a sink, write(samples) is awaited and should throw if the samples weren't written
+  addSink(name, write, options) {
+    let logged = this.wal && (!options || options.logged !== false);
+    // a cursor left from when the sink was logged would keep the segments from being deleted
+    if (this.wal && !logged) this.wal.forget(name);
+    this.sinks.push(new Sink(name, write, options, logged ? this.wal : null));
+    return this;
+  }
+
+  // log a sample and queue it for every sink, never blocks
+  push(sample) {
+    let seq = this.wal ? this.wal.append(sample) : undefined;
+    if (this.ingest.length >= this.opts.maxIngest) {
+      // the logged sinks pick it up from the log, the rest miss it
+      if (this.wal) this.sinks.forEach(sink => sink.wal ? sink.reader || sink.spill() : sink.stats.dropped++);
+      else this.ingestDropped++;
+      return;
+    }
+    this.ingest.push({ sample, time: Date.now(), seq });
+    if (!this.scheduled) {
+      this.scheduled = true;
+      setImmediate(() => this.fanOut());
+    }
+  }
+
+  fanOut() {
+    this.scheduled = false;
+    while (this.ingest.length) {
+      let { sample, time, seq } = this.ingest.shift();
+      for (let sink of this.sinks) sink.enqueue(sample, time, seq);
+    }
+  }
+
+  metrics() {
+    let sinks = {};
+    for (let sink of this.sinks) sinks[sink.name] = sink.metrics();
+    return { ingest: { queued: this.ingest.length, dropped: this.ingestDropped }, sinks };
+  }
+
+  logMetrics() {
+    for (let [name, m] of Object.entries(this.metrics().sinks)) {
+      console.log(`[INFO]: PIPE - ${name} queued ${m.queued} (max ${m.maxQueued}), behind ${m.behind}, lag ${m.lagMs}ms, ` +
+        `latency ${m.latencyMs}ms, written ${m.written}, dropped ${m.dropped}, failed ${m.failed}`);
+    }
+  }
+
+  // deliver everything queued and stop the sink workers
+  async close() {
+    clearInterval(this.timer);
+    this.fanOut();
+    await Promise.all(this.sinks.map(sink => sink.close()));
+  }
+}
+
+module.exports = { SinkPipeline };
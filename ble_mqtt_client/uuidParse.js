@@ -2,37 +2,72 @@
 // https://github.com/NordicSemiconductor/bluetooth-numbers-database.git
 const bt_uuids = require('./bluetooth-numbers-database');
 
-// funtion to convert a 128 bit UUID to a 16 bit UUID used in the database
+// suffix of 16 bit UUIDs expanded to 128 bits with the Bluetooth base UUID
+const BASE_SUFFIX = '-0000-1000-8000-00805F9B34FB';
+// lookups remembered before the memo is cleared, the gateway only sees a few dozen UUIDs
+const MEMO_MAX = 1024;
+
+// the characteristics of the project's own devices (see low_level/ble_co2), not in the database
+const custom_uuids = [
+    [1, 'CO2', 'co2'],
+    [4, 'Sample Batch', 'sample_batch'],
+    [5, 'Power Stats', 'power_stats'],
+    [6, 'Configuration', 'configuration'],
+    [7, 'Log Output', 'log_output'],
+    [8, 'Diagnostics', 'diagnostics'],
+    [9, 'Benchmark', 'benchmark']
+].map(([n, name, id]) => ({
+    name: name,
+    identifier: `iotlab.characteristic.${id}`,
+    uuid: `00000001-0002-0003-0004-${n.toString(16).padStart(12, '0').toUpperCase()}`,
+    source: 'iotlab'
+}));
+
+// index of every entry in the databases by UUID (16 bit or 128 bit, upper case), built once
+// at startup. Where a UUID is in several databases the first one wins, as the search did
+const index = new Map();
+for (let entry of custom_uuids) index.set(entry.uuid, Object.freeze(entry));
+for (let db of Object.keys(bt_uuids.schemas)) {
+    for (let entry of bt_uuids[db]) {
+        if (entry.uuid && !index.has(entry.uuid)) index.set(entry.uuid, Object.freeze(entry));
+    }
+}
+
+// function to convert a 128 bit UUID to a 16 bit UUID used in the database
 const parse_uuid = (uuid128) => {
     // convert the UUID to upper case
     uuid128 = uuid128.toUpperCase();
-    // use a regex to extract the 16bit UUID from the 128 bit UUID
-    let uuid16 = uuid128.match(/0{4}([0-9A-Z]{4})-0{4}-10{3}-80{3}-00805F9B34FB/);
-
-    if (uuid16) // if the UUID was found
-        return uuid16[1]; // return the 16bit UUID
+    // a 16 bit UUID on the base UUID is 0000xxxx-0000-1000-8000-00805F9B34FB
+    if (uuid128.length === 36 && uuid128.startsWith('0000') && uuid128.endsWith(BASE_SUFFIX))
+        return uuid128.substring(4, 8); // return the 16bit UUID
     else
         return uuid128; // return the 128bit UUID
 }
 
-// function to get the uuid object from the database by UUID
-module.exports = get_uuid = (uuid) => {
+// function to look a UUID up in the index, without the memo
+const lookup = (uuid) => {
     // convert the UUID to a 16 bit UUID where possible
-    uuid = parse_uuid(uuid);
-    // get the UUID databases
-    let uuidDB = Object.keys(bt_uuids.schemas)
-    // loop through the UUID databases
-    for (let i in uuidDB) {
-        // attempt to find the UUID in the database
-        let uuidObj = bt_uuids[uuidDB[i]].find(d => d.uuid === uuid)
-        // if the UUID was found return the object
-        if (uuidObj) return uuidObj;
-    };
+    let parsed = parse_uuid(uuid);
     // if the UUID was not found return a custom object
-    return {
+    return index.get(parsed) || Object.freeze({
         name: 'Custom UUID',
         identifier: null,
-        uuid: uuid,
+        uuid: parsed,
         source: 'custom'
-    };
-}
\ No newline at end of file
+    });
+}
+
+// lookups by the UUID as given, so a repeated lookup doesn't even parse it
+const memo = new Map();
+
+// function to get the uuid object from the database by UUID. The objects are shared and frozen,
+// copy one to add to it
+module.exports = get_uuid = (uuid) => {
+    let uuidObj = memo.get(uuid);
+    if (uuidObj) return uuidObj;
+    uuidObj = lookup(uuid);
+    if (memo.size >= MEMO_MAX) memo.clear();
+    memo.set(uuid, uuidObj);
+    return uuidObj;
+}
+module.exports.lookup = lookup;
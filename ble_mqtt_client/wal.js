@@ -0,0 +1,322 @@
+// append-only write-ahead log of samples on the gateway's disk
+// every sample is appended here before it is handed to the sinks, and each sink keeps a
+// cursor, the sequence number of the last sample it has written. A sink that falls behind
+// (its backend is down or its queue overflowed) reads the log from its cursor until it has
+// caught up, so an outage of a backend or the backhaul loses nothing.
+//
+// The log is a directory of segment files named after the sequence number of their first
+// record, a new segment is started once the current one reaches segmentBytes. A record is
+// a 4 byte length, the crc32 of the payload and the payload (the sample as JSON), all
+// little endian. Appends are collected and written once per turn of the event loop, and
+// the file is fsynced every fsyncMs, so a crash loses at most the appends of the last turn
+// and a power cut those of the last fsyncMs. A torn record at the end of the last segment
+// is cut off when the log is opened.
+//
+// Cursors are kept in cursors.json, saved every cursorSaveMs and on close: after a crash
+// a sink can see the samples of the last cursorSaveMs again. Segments every cursor has
+// passed are deleted when a segment is started or the cursors are saved, and past maxBytes
+// the oldest segments are deleted even if a sink still needs them.
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+
+const DEFAULTS = {
+  segmentBytes: 16 * 1024 * 1024,
+  maxBytes: 1024 * 1024 * 1024, // disk the log may take, the oldest samples go past this
+  fsyncMs: 1000,
+  cursorSaveMs: 1000,
+  readBytes: 1024 * 1024 // chunk size readers read the segments in
+};
+
+const HEADER = 8;
+const SEGMENT = /^(\d{16})\.log$/;
+const CURSORS = 'cursors.json';
+
+// zlib.crc32 is only in node 20.15 and later
+const crc32 = zlib.crc32 || (() => {
+  let table = new Int32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    table[n] = c;
+  }
+  return (buf) => {
+    let crc = -1;
+    for (let i = 0; i < buf.length; i++) crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >>> 8);
+    return (crc ^ -1) >>> 0;
+  };
+})();
+
+const segmentName = (seq) => `${String(seq).padStart(16, '0')}.log`;
+
+const encode = (sample) => {
+  let payload = Buffer.from(JSON.stringify(sample));
+  let record = Buffer.allocUnsafe(HEADER + payload.length);
+  record.writeUInt32LE(payload.length, 0);
+  record.writeUInt32LE(crc32(payload), 4);
+  payload.copy(record, HEADER);
+  return record;
+}
+
+// records in buf from offset, stops at the end of the buffer or at a bad record.
+// Returns the payloads and the offset after the last good record
+const decode = (buf, offset, max) => {
+  let payloads = [];
+  while (payloads.length < max && offset + HEADER <= buf.length) {
+    let len = buf.readUInt32LE(offset);
+    if (offset + HEADER + len > buf.length) break;
+    let payload = buf.subarray(offset + HEADER, offset + HEADER + len);
+    if (crc32(payload) !== buf.readUInt32LE(offset + 4)) break;
+    payloads.push(payload);
+    offset += HEADER + len;
+  }
+  return { payloads, offset };
+}
+
+class Wal {
+  constructor(dir, options) {
+    this.dir = dir;
+    this.opts = { ...DEFAULTS, ...options };
+    this.pending = []; // encoded records not written yet
+    this.scheduled = false;
+    this.dirty = false; // written since the last fsync
+    fs.mkdirSync(dir, { recursive: true });
+    this.segments = this.listSegments(); // [{ seq, bytes }] oldest first
+    this.cursors = this.loadCursors();
+    this.recover();
+    this.timers = [
+      setInterval(() => this.fsync(), this.opts.fsyncMs),
+      setInterval(() => this.saveCursors(), this.opts.cursorSaveMs)
+    ];
+    this.timers.forEach(timer => timer.unref());
+  }
+
+  listSegments() {
+    return fs.readdirSync(this.dir)
+      .map(name => SEGMENT.exec(name))
+      .filter(match => match)
+      .map(match => ({ seq: Number(match[1]), bytes: fs.statSync(path.join(this.dir, match[0])).size }))
+      .sort((a, b) => a.seq - b.seq);
+  }
+
+  loadCursors() {
+    try {
+      return JSON.parse(fs.readFileSync(path.join(this.dir, CURSORS), 'utf8'));
+    } catch (err) {
+      if (err.code !== 'ENOENT') console.log(`[ERROR]: WAL - Unreadable cursors, sinks replay what is on disk: ${err}`);
+      return {};
+    }
+  }
+
+  // count the records of the last segment and cut off anything after the last good one
+  recover() {
+    if (!this.segments.length) this.segments.push({ seq: 1, bytes: 0 });
+    let last = this.segments[this.segments.length - 1];
+    let file = path.join(this.dir, segmentName(last.seq));
+    let buf = fs.existsSync(file) ? fs.readFileSync(file) : Buffer.alloc(0);
+    let { payloads, offset } = decode(buf, 0, Infinity);
+    if (offset < buf.length) {
+      console.log(`[ERROR]: WAL - Cut ${buf.length - offset} bytes of torn records off ${segmentName(last.seq)}`);
+      fs.truncateSync(file, offset);
+    }
+    last.bytes = offset;
+    this.lastSeq = last.seq + payloads.length - 1; // sequence number of the last record appended
+    this.fd = fs.openSync(file, 'a');
+  }
+
+  // append a sample, returns its sequence number
+  append(sample) {
+    this.pending.push(encode(sample));
+    if (!this.scheduled) {
+      this.scheduled = true;
+      setImmediate(() => this.writePending());
+    }
+    return ++this.lastSeq;
+  }
+
+  writePending() {
+    this.scheduled = false;
+    if (!this.pending.length) return;
+    let seq = this.lastSeq - this.pending.length + 1; // sequence number of pending[0]
+    let start = 0;
+    while (start < this.pending.length) {
+      let segment = this.segments[this.segments.length - 1];
+      if (segment.bytes >= this.opts.segmentBytes) {
+        this.roll(seq);
+        continue;
+      }
+      // fill the current segment up to its size, at least one record
+      let end = start, bytes = 0;
+      while (end < this.pending.length && (end === start || segment.bytes + bytes < this.opts.segmentBytes)) {
+        bytes += this.pending[end++].length;
+      }
+      fs.writeSync(this.fd, Buffer.concat(this.pending.slice(start, end), bytes));
+      segment.bytes += bytes;
+      seq += end - start;
+      start = end;
+    }
+    this.pending = [];
+    this.dirty = true;
+  }
+
+  roll(seq) {
+    this.fsync();
+    fs.closeSync(this.fd);
+    this.segments.push({ seq, bytes: 0 });
+    this.fd = fs.openSync(path.join(this.dir, segmentName(seq)), 'a');
+    this.compact();
+  }
+
+  fsync() {
+    if (!this.dirty) return;
+    fs.fdatasyncSync(this.fd);
+    this.dirty = false;
+  }
+
+  // sequence number of the oldest record still on disk
+  firstSeq() {
+    return this.segments[0].seq;
+  }
+
+  // the cursor of a sink, new sinks start with what is still on disk
+  cursor(name) {
+    if (this.cursors[name] === undefined) this.cursors[name] = this.firstSeq() - 1;
+    return this.cursors[name];
+  }
+
+  // a sink no longer reads the log, its cursor stops holding segments back
+  forget(name) {
+    delete this.cursors[name];
+  }
+
+  // a sink has written everything up to and including seq
+  ack(name, seq) {
+    if (seq > (this.cursors[name] || 0)) this.cursors[name] = seq;
+  }
+
+  saveCursors() {
+    let file = path.join(this.dir, CURSORS);
+    let json = JSON.stringify(this.cursors);
+    if (json === this.savedCursors) return;
+    // the cursors must not be saved ahead of the records they point at
+    this.writePending();
+    this.fsync();
+    fs.writeFileSync(`${file}.tmp`, json);
+    fs.renameSync(`${file}.tmp`, file);
+    this.savedCursors = json;
+    if (this.segments.length > 1) this.compact();
+  }
+
+  // delete the segments every sink is done with, and the oldest ones while over maxBytes
+  compact() {
+    let done = Math.min(...Object.values(this.cursors), this.lastSeq);
+    let total = this.segments.reduce((sum, segment) => sum + segment.bytes, 0);
+    while (this.segments.length > 1) {
+      let [oldest, next] = this.segments;
+      let needed = next.seq - 1 > done;
+      if (needed && total <= this.opts.maxBytes) break;
+      if (needed) console.log(`[ERROR]: WAL - Over ${this.opts.maxBytes} bytes, dropped samples ${oldest.seq} to ${next.seq - 1}`);
+      fs.unlinkSync(path.join(this.dir, segmentName(oldest.seq)));
+      total -= oldest.bytes;
+      this.segments.shift();
+    }
+  }
+
+  // records after seq, see WalReader
+  reader(seq) {
+    return new WalReader(this, seq);
+  }
+
+  close() {
+    this.timers.forEach(timer => clearInterval(timer));
+    this.writePending();
+    this.saveCursors();
+    this.fsync();
+    fs.closeSync(this.fd);
+  }
+}
+
+// reads the log from a cursor onwards in large chunks, for catching up a sink
+class WalReader {
+  constructor(wal, after) {
+    this.wal = wal;
+    this.seq = after + 1; // next record to return
+    this.fd = null;
+    this.skipped = 0;
+  }
+
+  // up to max records as { seq, sample }, empty once the reader has caught up. skipped
+  // counts the records that were deleted (or unreadable) before the reader got to them
+  next(max) {
+    let wal = this.wal;
+    let records = [];
+    wal.writePending(); // so the reader sees every append
+    if (this.seq < wal.firstSeq()) {
+      this.skipped += wal.firstSeq() - this.seq;
+      this.close();
+      this.seq = wal.firstSeq();
+    }
+    while (records.length < max && this.seq <= wal.lastSeq) {
+      if (this.fd === null && !this.open()) break;
+      let { payloads, offset } = decode(this.buf, this.offset, max - records.length);
+      for (let payload of payloads) records.push({ seq: this.seq++, sample: JSON.parse(payload) });
+      this.offset = offset;
+      if (records.length >= max || this.fill()) continue;
+      // end of the file: stay on the last segment for the next appends, or move on
+      let next = wal.segments.find(segment => segment.seq > this.segmentSeq);
+      if (!next) break;
+      if (this.seq < next.seq) {
+        console.log(`[ERROR]: WAL - Skipped unreadable samples ${this.seq} to ${next.seq - 1}`);
+        this.skipped += next.seq - this.seq;
+        this.seq = next.seq;
+      }
+      this.close();
+    }
+    return records;
+  }
+
+  // open the segment holding this.seq and read up to it
+  open() {
+    let segment = [...this.wal.segments].reverse().find(s => s.seq <= this.seq);
+    if (!segment) return false;
+    try {
+      this.fd = fs.openSync(path.join(this.wal.dir, segmentName(segment.seq)), 'r');
+    } catch (err) {
+      return false; // compacted away meanwhile, next() skips to the first segment
+    }
+    this.segmentSeq = segment.seq;
+    this.pos = 0;
+    this.buf = Buffer.alloc(0);
+    this.offset = 0;
+    for (let seq = segment.seq; seq < this.seq;) {
+      if (this.offset + HEADER > this.buf.length || this.offset + HEADER + this.buf.readUInt32LE(this.offset) > this.buf.length) {
+        if (this.fill()) continue;
+        // the segment ends before this.seq (not written out yet, or cut short), try again
+        // from the start next time rather than read on from the wrong record
+        this.close();
+        return false;
+      }
+      this.offset += HEADER + this.buf.readUInt32LE(this.offset);
+      seq++;
+    }
+    return true;
+  }
+
+  // keep the unread part of the buffer and read the next chunk behind it
+  fill() {
+    let chunk = Buffer.allocUnsafe(this.wal.opts.readBytes);
+    let read = fs.readSync(this.fd, chunk, 0, chunk.length, this.pos);
+    if (!read) return false;
+    this.pos += read;
+    this.buf = Buffer.concat([this.buf.subarray(this.offset), chunk.subarray(0, read)]);
+    this.offset = 0;
+    return true;
+  }
+
+  close() {
+    if (this.fd !== null) fs.closeSync(this.fd);
+    this.fd = null;
+  }
+}
+
+module.exports = { Wal };
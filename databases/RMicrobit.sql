@@ -78,7 +78,7 @@ DROP TABLE IF EXISTS `sensor_data`;
 /*!40101 SET character_set_client = utf8 */;
 CREATE TABLE `sensor_data` (
   `sensor_id` int(11) DEFAULT NULL,
-  `value` int(11) DEFAULT NULL,
+  `value` decimal(10,2) DEFAULT NULL,
   `timestamp` datetime DEFAULT NULL
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
 /*!40101 SET character_set_client = @saved_cs_client */;
@@ -106,7 +106,8 @@ CREATE TABLE `sensors` (
   `sensor_name` varchar(36) DEFAULT NULL,
   `sensor_UUID` varchar(36) DEFAULT NULL,
   `units` varchar(5) DEFAULT NULL,
-  PRIMARY KEY (`sensor_id`)
+  PRIMARY KEY (`sensor_id`),
+  KEY `sensor_UUID` (`sensor_UUID`)
 ) ENGINE=InnoDB AUTO_INCREMENT=4 DEFAULT CHARSET=utf8mb4;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
@@ -0,0 +1,3 @@
+-- index the gateway's sensor id lookup (SELECT sensor_id FROM sensors WHERE sensor_UUID = ?)
+-- on an existing RMicrobit database, RMicrobit.sql already creates it
+CREATE INDEX IF NOT EXISTS `sensor_UUID` ON `sensors` (`sensor_UUID`);
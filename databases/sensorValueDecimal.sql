@@ -0,0 +1,4 @@
+-- keep the 0.01 resolution of the temperature (0.01 degC) and humidity (0.01 %RH) samples
+-- on an existing RMicrobit database, they were truncated to whole units by the int column.
+-- RMicrobit.sql already creates the column as decimal, existing rows keep their values
+ALTER TABLE `sensor_data` MODIFY `value` decimal(10,2) DEFAULT NULL;
@@ -0,0 +1,156 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "compass.h"
+
+#define SCALE_ONE 256
+#define SCALE_MIN (SCALE_ONE / 4)	// a stored calibration outside this range is treated as corrupt
+#define SCALE_MAX (SCALE_ONE * 4)
+#define CORDIC_STEPS 16
+#define CORDIC_MAX_INPUT (1 << 28)	// the CORDIC gain (1.65) must not overflow int32
+#define ACCEL_MIN 200			// lsm303_ll units (cm/s^2), below this the board is in free fall
+
+// atan(2^-i) in millidegrees
+static const int32_t cordic_angle[CORDIC_STEPS] = {
+	45000, 26565, 14036, 7125, 3576, 1790, 895, 448, 224, 112, 56, 28, 14, 7, 3, 2,
+};
+
+static uint64_t isqrt64(uint64_t v)
+{
+	uint64_t root = 0, bit = 1ULL << 62;
+
+	while (bit > v) bit >>= 2;
+	while (bit) {
+		if (v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+static int64_t abs64(int64_t v)
+{
+	return v < 0 ? -v : v;
+}
+
+void compass_cal_default(struct compass_cal *cal)
+{
+	for (int i = 0; i < 3; i++) {
+		cal->offset[i] = 0;
+		cal->scale[i] = SCALE_ONE;
+	}
+}
+
+bool compass_cal_valid(const struct compass_cal *cal)
+{
+	for (int i = 0; i < 3; i++) {
+		if (cal->scale[i] < SCALE_MIN || cal->scale[i] > SCALE_MAX) return false;
+	}
+	return true;
+}
+
+void compass_cal_start(struct compass_cal_run *run)
+{
+	for (int i = 0; i < 3; i++) {
+		run->min[i] = INT16_MAX;
+		run->max[i] = INT16_MIN;
+	}
+	run->samples = 0;
+}
+
+void compass_cal_add(struct compass_cal_run *run, const int mag[3])
+{
+	for (int i = 0; i < 3; i++) {
+		if (mag[i] < run->min[i]) run->min[i] = mag[i];
+		if (mag[i] > run->max[i]) run->max[i] = mag[i];
+	}
+	run->samples++;
+}
+
+// -EAGAIN if the board wasn't turned far enough on some axis, cal is left alone
+int compass_cal_finish(const struct compass_cal_run *run, struct compass_cal *cal)
+{
+	int32_t radius[3], mean = 0;
+
+	if (!run->samples) return -EAGAIN;
+	for (int i = 0; i < 3; i++) {
+		int32_t span = run->max[i] - run->min[i];
+
+		if (span < COMPASS_CAL_MIN_SPAN) return -EAGAIN;
+		radius[i] = span / 2;
+		mean += radius[i];
+	}
+	mean /= 3;
+	for (int i = 0; i < 3; i++) {
+		cal->offset[i] = (run->max[i] + run->min[i]) / 2;
+		cal->scale[i] = mean * SCALE_ONE / radius[i];
+	}
+	return compass_cal_valid(cal) ? 0 : -EINVAL;
+}
+
+void compass_apply(const struct compass_cal *cal, const int mag[3], int out[3])
+{
+	for (int i = 0; i < 3; i++) {
+		out[i] = (mag[i] - cal->offset[i]) * cal->scale[i] / SCALE_ONE;
+	}
+}
+
+// CORDIC in vectoring mode, returns the angle of (x, y) in tenths of a degree, -1800..1800
+int32_t compass_atan2(int64_t y, int64_t x)
+{
+	int32_t angle = 0, cx, cy;
+
+	if (!x && !y) return 0;
+	while (abs64(x) >= CORDIC_MAX_INPUT || abs64(y) >= CORDIC_MAX_INPUT) {
+		x /= 2;
+		y /= 2;
+	}
+	// CORDIC converges for -90..90 degrees, fold the left half plane over
+	if (x < 0) {
+		angle = y >= 0 ? 180000 : -180000;
+		x = -x;
+		y = -y;
+	}
+	cx = x;
+	cy = y;
+	for (int i = 0; i < CORDIC_STEPS; i++) {
+		int32_t nx;
+
+		if (cy > 0) {
+			nx = cx + (cy >> i);
+			cy -= cx >> i;
+			angle += cordic_angle[i];
+		} else {
+			nx = cx - (cy >> i);
+			cy += cx >> i;
+			angle -= cordic_angle[i];
+		}
+		cx = nx;
+	}
+	return angle >= 0 ? (angle + 50) / 100 : (angle - 50) / 100;
+}
+
+// heading of the +y axis in tenths of a degree, 0..3599 clockwise from magnetic north
+// accel in any unit, mag already calibrated. -EINVAL without a usable gravity or field direction
+int compass_heading(const int accel[3], const int mag[3])
+{
+	int64_t a[3] = { accel[0], accel[1], accel[2] };
+	int64_t e[3], north_y, a_len;
+	int32_t heading;
+
+	a_len = isqrt64(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+	if (a_len < ACCEL_MIN) return -EINVAL;
+	// east = mag x gravity
+	e[0] = mag[1] * a[2] - mag[2] * a[1];
+	e[1] = mag[2] * a[0] - mag[0] * a[2];
+	e[2] = mag[0] * a[1] - mag[1] * a[0];
+	if (!e[0] && !e[1] && !e[2]) return -EINVAL;
+	// y component of north = gravity x east, |north| = |gravity| * |east| so scale east_y to match
+	north_y = a[2] * e[0] - a[0] * e[2];
+	heading = compass_atan2(e[1] * a_len, north_y);
+	return heading < 0 ? heading + 3600 : heading % 3600;
+}
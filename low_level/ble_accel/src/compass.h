@@ -0,0 +1,41 @@
+#ifndef __COMPASS_H
+#define __COMPASS_H
+#include <stdint.h>
+#include <stdbool.h>
+/*
+ * Magnetometer calibration and tilt compensated heading, all in integer arithmetic.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * Calibration is min/max: while the board is turned through every orientation the
+ * extremes seen on each axis are tracked. Their midpoint is the hard iron offset and the
+ * half ranges, scaled to their mean, correct the soft iron stretch along each axis.
+ *
+ * The heading uses the accelerometer as the down reference, so the board doesn't need
+ * to be held flat: east = mag x gravity, north = gravity x east, and the heading is the
+ * angle of the board's +y axis from north towards east. The LSM303AGR accelerometer and
+ * magnetometer axes are aligned so both vectors come straight from lsm303_ll.
+ */
+#define COMPASS_CAL_MIN_SPAN 200	// mgauss, smallest range on each axis for a usable calibration
+#define COMPASS_HEADING_INVALID 0xffff
+
+// packed so it can be stored and returned as is from a GATT read
+struct compass_cal {
+	int16_t offset[3];	// hard iron offset, mgauss
+	uint16_t scale[3];	// soft iron scale per axis, 256 = 1.0
+} __attribute__((packed));
+
+struct compass_cal_run {
+	int16_t min[3];
+	int16_t max[3];
+	uint32_t samples;
+};
+
+void compass_cal_default(struct compass_cal *cal);
+bool compass_cal_valid(const struct compass_cal *cal);
+void compass_cal_start(struct compass_cal_run *run);
+void compass_cal_add(struct compass_cal_run *run, const int mag[3]);
+int compass_cal_finish(const struct compass_cal_run *run, struct compass_cal *cal);
+void compass_apply(const struct compass_cal *cal, const int mag[3], int out[3]);
+int32_t compass_atan2(int64_t y, int64_t x);
+int compass_heading(const int accel[3], const int mag[3]);
+#endif
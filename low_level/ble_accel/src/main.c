@@ -31,6 +31,18 @@
 #include <stdio.h>
 #include <math.h>
 #include "lsm303_ll.h"
+#include "compass.h"
+#include "sched.h"
+#include "power.h"
+#include "log_ram.h"
+#include "diag.h"
+#include <logging/log.h>
+#ifdef CONFIG_SOC_FAMILY_NRF
+#include <pm/pm.h>
+#include <hal/nrf_gpio.h>
+#endif
+
+LOG_MODULE_REGISTER(app, CONFIG_APP_LOG_LEVEL);
 
 
 // ********************[ Start of First characteristic ]**************************************
@@ -42,7 +54,7 @@ static ssize_t write_char(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 // Callback that is activated when the characteristic is read by central
 static ssize_t read_char(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a read %p\n",attr);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a read %p", attr);
 	// Could use 'const char *value =  attr->user_data' also here if there is the char value is being maintained with the BLE STACK
 	const char *value = (const char *)&char_value; // point at the value in memory
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(char_value)); // pass the value back up through the BLE stack
@@ -53,12 +65,10 @@ static ssize_t write_char(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 			 uint8_t flags)
 {
 	uint8_t *value = attr->user_data;
-	char test[len+1];
-	memcpy(test, buf, len);
-	test[len]=0; //null terminating the buffer string
-	printf("Got a write %s\n",test);
+	if (offset + len > sizeof(char_value)) return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	LOG_HEXDUMP_DBG(buf, len, "Got a write"); // copied now, formatted later on the logging thread
 
-	memcpy(value, buf, len); // copy the incoming value in the memory occupied by our characateristic variable
+	memcpy(value + offset, buf, len); // copy the incoming value in the memory occupied by our characateristic variable
 	return len;
 }
 // Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
@@ -73,7 +83,7 @@ uint32_t y_accel;
 static ssize_t read_y_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 static ssize_t read_y_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a y_accel read %d\n",y_accel);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a y_accel read %d", y_accel);
 	const char *value = (const char *)&y_accel;
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(y_accel)); // pass the value back up through the BLE stack
 	return 0;
@@ -89,7 +99,7 @@ uint32_t x_accel;
 static ssize_t read_x_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 static ssize_t read_x_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a x_accel read %d\n",x_accel);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a x_accel read %d", x_accel);
 	const char *value = (const char *)&x_accel;
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(x_accel)); // pass the value back up through the BLE stack
 	return 0;
@@ -105,7 +115,7 @@ uint32_t z_accel;
 static ssize_t read_z_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 static ssize_t read_z_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a z_accel read %d\n",z_accel);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a z_accel read %d", z_accel);
 	const char *value = (const char *)&z_accel;
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(z_accel)); // pass the value back up through the BLE stack
 	return 0;
@@ -115,6 +125,187 @@ static ssize_t read_z_accel(struct bt_conn *conn, const struct bt_gatt_attr *att
 // ********************[ End of Second characteristic ]**************************************
 
 
+// ********************[ Start of Fifth characteristic ]**************************************
+// Time spent in each power state and the estimated charge used, see power.h
+#define BT_UUID_POWER_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)4)
+static struct bt_uuid_128 power_id=BT_UUID_INIT_128(BT_UUID_POWER_ID); // the 128 bit UUID for this gatt value
+static ssize_t read_power(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t read_power(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	struct power_stats stats;
+	power_get_stats(&stats); // snapshot, includes the time spent so far in the current state
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats)); // pass the value back up through the BLE stack
+}
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR5 BT_GATT_CHARACTERISTIC(&power_id.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, read_power, NULL, NULL)
+// ********************[ End of Fifth characteristic ]**************************************
+
+
+// ********************[ Start of Sixth characteristic ]**************************************
+// Most recent log output as text, see log_ram.h. Read it with a long read to get the whole snapshot
+#define BT_UUID_LOG_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)6)
+static struct bt_uuid_128 log_id=BT_UUID_INIT_128(BT_UUID_LOG_ID); // the 128 bit UUID for this gatt value
+static uint8_t log_value[512]; // snapshot taken when a read starts, 512 is the longest attribute value
+static uint16_t log_value_len;
+static ssize_t read_log(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t read_log(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	// the rest of a long read comes back with an offset, keep serving the same snapshot
+	if (offset == 0) log_value_len = log_ram_read(log_value, sizeof(log_value));
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, log_value, log_value_len); // pass the value back up through the BLE stack
+}
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR6 BT_GATT_CHARACTERISTIC(&log_id.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, read_log, NULL, log_value)
+// ********************[ End of Sixth characteristic ]**************************************
+
+// ********************[ Start of Seventh characteristic ]**************************************
+// Diagnostics as text: driver call timings in us, notification counters and stack usage, see diag.h
+// the same report (with histograms) is printed by the "diag show" shell command
+#define BT_UUID_DIAG_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)7)
+static struct bt_uuid_128 diag_id=BT_UUID_INIT_128(BT_UUID_DIAG_ID); // the 128 bit UUID for this gatt value
+enum { T_LSM303, T_NOTIFY, T_HEADING, T_COUNT };
+static struct diag_timer diag_timers[T_COUNT] = {
+	[T_LSM303] = DIAG_TIMER_INIT("lsm303_read_xyz"),
+	[T_NOTIFY] = DIAG_TIMER_INIT("bt_gatt_notify"),
+	[T_HEADING] = DIAG_TIMER_INIT("compass_heading"),
+};
+enum { C_NOTIFY_OK, C_NOTIFY_FAILED, C_COUNT };
+static struct diag_counter diag_counters[C_COUNT] = {
+	[C_NOTIFY_OK] = DIAG_COUNTER_INIT("notify_ok"),
+	[C_NOTIFY_FAILED] = DIAG_COUNTER_INIT("notify_failed"),
+};
+// main returns once everything is set up, the sampling runs on the scheduler thread
+static struct diag_thread diag_threads[] = {
+	{ .name = "sched" },
+};
+static char diag_value[512]; // snapshot taken when a read starts, 512 is the longest attribute value
+static uint16_t diag_value_len;
+static ssize_t read_diag(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t read_diag(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	// the rest of a long read comes back with an offset, keep serving the same snapshot
+	if (offset == 0) diag_value_len = diag_format(diag_value, sizeof(diag_value), false);
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, diag_value, diag_value_len); // pass the value back up through the BLE stack
+}
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR7 BT_GATT_CHARACTERISTIC(&diag_id.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, read_diag, NULL, diag_value)
+// ********************[ End of Seventh characteristic ]**************************************
+
+
+// ********************[ Start of Eighth characteristic ]**************************************
+// Tilt compensated heading, uint16 in tenths of a degree clockwise from magnetic north,
+// 0xffff while the magnetometer can't be read. Notified at the rate set with the ninth characteristic
+#define BT_UUID_HEADING_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)8)
+static struct bt_uuid_128 heading_id=BT_UUID_INIT_128(BT_UUID_HEADING_ID); // the 128 bit UUID for this gatt value
+static uint16_t heading_value = COMPASS_HEADING_INVALID;
+static ssize_t read_heading(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t read_heading(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	uint16_t value = sys_cpu_to_le16(heading_value);
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &value, sizeof(value)); // pass the value back up through the BLE stack
+}
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR8 BT_GATT_CHARACTERISTIC(&heading_id.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, read_heading, NULL, &heading_value), \
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+// ********************[ End of Eighth characteristic ]**************************************
+
+// ********************[ Start of Ninth characteristic ]**************************************
+// Compass settings. A write is a struct compass_config: the heading notify period in ms
+// (0 leaves it alone) and a calibration command. To calibrate, write COMPASS_CAL_START, turn
+// the board slowly through every orientation, then write COMPASS_CAL_SAVE. A read returns a
+// struct compass_status with the calibration in use. Both are stored with the settings subsystem
+#define BT_UUID_COMPASS_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)9)
+static struct bt_uuid_128 compass_id=BT_UUID_INIT_128(BT_UUID_COMPASS_ID); // the 128 bit UUID for this gatt value
+#define HEADING_PERIOD_MS 200 // default heading rate
+#define HEADING_PERIOD_MIN_MS 100 // the magnetometer runs at 10Hz
+#define HEADING_PERIOD_MAX_MS 60000
+enum compass_command {
+	COMPASS_CAL_NONE,
+	COMPASS_CAL_START,	// clear the min/max and start collecting
+	COMPASS_CAL_SAVE,	// finish, apply and store the calibration
+	COMPASS_CAL_CANCEL,	// stop collecting, keep the calibration in use
+	COMPASS_CAL_RESET,	// go back to the uncalibrated defaults
+};
+struct compass_config {
+	uint16_t period_ms;
+	uint8_t command;
+} __attribute__((packed));
+struct compass_status {
+	uint16_t period_ms;
+	uint8_t calibrating;
+	struct compass_cal cal;
+} __attribute__((packed));
+// owned by the scheduler thread
+static struct compass_cal compass_cal;
+static struct compass_cal_run compass_cal_run;
+static bool compass_calibrating;
+static uint16_t heading_period_ms = HEADING_PERIOD_MS;
+K_MSGQ_DEFINE(compass_msgq, sizeof(struct compass_config), 2, 2); // written configs waiting for the compass job
+static struct sched_job compass_job; // event: applies written configs on the scheduler thread
+static ssize_t read_compass(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t write_compass(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static ssize_t read_compass(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	struct compass_status status = {
+		.period_ms = sys_cpu_to_le16(heading_period_ms),
+		.calibrating = compass_calibrating,
+	};
+	for (int i = 0; i < 3; i++) {
+		status.cal.offset[i] = sys_cpu_to_le16(compass_cal.offset[i]);
+		status.cal.scale[i] = sys_cpu_to_le16(compass_cal.scale[i]);
+	}
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &status, sizeof(status)); // pass the value back up through the BLE stack
+}
+// The write is checked here and handed to the compass job, nothing is changed from the BT thread
+static ssize_t write_compass(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 const void *buf, uint16_t len, uint16_t offset,
+			 uint8_t flags)
+{
+	struct compass_config config;
+	if (offset) return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	if (len != sizeof(config)) return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	memcpy(&config, buf, sizeof(config));
+	config.period_ms = sys_le16_to_cpu(config.period_ms);
+	if (config.period_ms && (config.period_ms < HEADING_PERIOD_MIN_MS || config.period_ms > HEADING_PERIOD_MAX_MS)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	if (config.command > COMPASS_CAL_RESET) return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	if (k_msgq_put(&compass_msgq, &config, K_NO_WAIT)) return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+	sched_job_trigger(&compass_job);
+	return len;
+}
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR9 BT_GATT_CHARACTERISTIC(&compass_id.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, read_compass, write_compass, NULL)
+// ********************[ End of Ninth characteristic ]**************************************
+
+// settings "compass/cal" and "compass/period", loaded once from main before the jobs start
+static int compass_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	ssize_t n;
+	if (settings_name_steq(name, "cal", &next) && !next) {
+		struct compass_cal cal;
+		if (len != sizeof(cal)) return -EINVAL;
+		n = read_cb(cb_arg, &cal, sizeof(cal));
+		if (n < 0) return n;
+		if (!compass_cal_valid(&cal)) return -EINVAL;
+		compass_cal = cal;
+		return 0;
+	}
+	if (settings_name_steq(name, "period", &next) && !next) {
+		uint16_t period_ms;
+		if (len != sizeof(period_ms)) return -EINVAL;
+		n = read_cb(cb_arg, &period_ms, sizeof(period_ms));
+		if (n < 0) return n;
+		if (period_ms < HEADING_PERIOD_MIN_MS || period_ms > HEADING_PERIOD_MAX_MS) return -EINVAL;
+		heading_period_ms = period_ms;
+		return 0;
+	}
+	return -ENOENT;
+}
+SETTINGS_STATIC_HANDLER_DEFINE(compass, "compass", NULL, compass_settings_set, NULL, NULL);
+
+
 // ********************[ Service definition ]********************
 #define BT_UUID_CUSTOM_SERVICE_VAL BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)0)
 static struct bt_uuid_128 my_service_uuid = BT_UUID_INIT_128( BT_UUID_CUSTOM_SERVICE_VAL);
@@ -125,8 +316,25 @@ BT_GATT_SERVICE_DEFINE(my_service_svc,
 		BT_GATT_CHAR1,
 		BT_GATT_CHAR2,
 		BT_GATT_CHAR3,
-		BT_GATT_CHAR4		
+		BT_GATT_CHAR4,
+		BT_GATT_CHAR5,
+		BT_GATT_CHAR6,
+		BT_GATT_CHAR7,
+		BT_GATT_CHAR8,
+		BT_GATT_CHAR9
 );
+// attribute indices of the characteristic values within my_service_svc
+#define CHAR_ATTR_IDX 2
+#define HEADING_ATTR_IDX 16
+
+// notify the central (if there is one), timed and counted for the diagnostics
+static void notify_attr(int attr_idx, const void *data, uint16_t len)
+{
+	int err;
+	if (!active_conn) return;
+	DIAG_TIME(&diag_timers[T_NOTIFY], err = bt_gatt_notify(active_conn, &my_service_svc.attrs[attr_idx], data, len));
+	diag_count(&diag_counters[err ? C_NOTIFY_FAILED : C_NOTIFY_OK]);
+}
 // ********************[ Advertising configuration ]********************
 /* The bt_data structure type:
  * {
@@ -157,28 +365,37 @@ static const struct bt_data ad[] = {
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err) {
-		printf("Connection failed (err 0x%02x)\n", err);
+		LOG_WRN("Connection failed (err 0x%02x)", err);
 	} else {
-		printf("Connected\n");
+		LOG_INF("Connected");
 		active_conn = conn;
+		power_request(POWER_ACTIVE);
 	}
 }
 // Callback that is activated when a connection with a central device is taken down
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	printk("Disconnected (reason 0x%02x)\n", reason);
+	LOG_INF("Disconnected (reason 0x%02x)", reason);
 	active_conn = NULL;
+	power_request(POWER_IDLE);
 }
 // structure used to pass connection callback handlers to the BLE stack
 static struct bt_conn_cb conn_callbacks = {
 	.connected = connected,
 	.disconnected = disconnected,
 };
+// Advertising used while no central is connected. Connectable advertising resumes at the fast
+// interval after a disconnect so it is restarted with this once the device goes idle.
+// BT_GAP_ADV_SLOW_INT_MIN/MAX set the interval to between 1 and 1.2s
+#define BT_LE_ADV_CONN_NAME_SLOW BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | \
+					BT_LE_ADV_OPT_USE_NAME, \
+					BT_GAP_ADV_SLOW_INT_MIN, \
+					BT_GAP_ADV_SLOW_INT_MAX, NULL)
 // This is called when the BLE stack has finished initializing
 static void bt_ready(void)
 {
 	int err;
-	printf("Bluetooth initialized\n");
+	LOG_INF("Bluetooth initialized");
 
 // start advertising see https://developer.nordicsemi.com/nRF_Connect_SDK/doc/latest/zephyr/reference/bluetooth/gap.html
 /*
@@ -192,50 +409,214 @@ static void bt_ready(void)
  Also see : zephyr/include/bluetooth/gap.h for BT_GAP_ADV.... These set the advertising interval to between 100 and 150ms
  
  */
-// Start BLE advertising using the ad array defined above
-	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME, ad, ARRAY_SIZE(ad), NULL, 0);
+// Start BLE advertising using the ad array defined above, slow since the device boots idle
+	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME_SLOW, ad, ARRAY_SIZE(ad), NULL, 0);
+	if (err) {
+		LOG_ERR("Advertising failed to start (err %d)", err);
+		return;
+	}
+	LOG_INF("Advertising successfully started");
+}
+
+// sampling jobs, run on the scheduler thread
+#define ACCEL_PERIOD_MS 100 // accelerometer sample rate
+#define NOTIFY_PERIOD_MS 1000 // rate at which the central is notified
+static struct sched_job accel_job;
+static struct sched_job notify_job;
+static struct sched_job heading_job; // heading_period_ms, set with the ninth characteristic
+static struct sched_job off_job; // runs once the device has been idle for IDLE_SYSTEM_OFF_MS
+
+// accel job: read all three axes in one burst
+static void accel_fn(struct sched_job *job)
+{
+	int x, y, z, err;
+	uint32_t start = diag_cycles();
+	err = lsm303_ll_readAccel(&x, &y, &z);
+	diag_record(&diag_timers[T_LSM303], diag_cycles() - start);
+	if (err) {
+		LOG_RATELIMIT(10000, LOG_ERR, "Error reading the accelerometer: %d", err);
+		return;
+	}
+	x_accel = x;
+	y_accel = y;
+	z_accel = z;
+}
+
+// notify job: send the counter characteristic to the central
+static void notify_fn(struct sched_job *job)
+{
+	char_value++;
+	// Send a notifiy signal to a central device (if there is one)
+	// int bt_gatt_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *data, u16_t len)
+	// conn: Connection object. (NULL for all)
+	// attr: Characteristic Value Descriptor attribute.
+	// data: Pointer to Attribute data.
+	// len: Attribute value length.				
+	notify_attr(CHAR_ATTR_IDX, &char_value, sizeof(char_value));
+}
+
+// heading job: burst read accel and mag, feed the calibration if one is running and notify the heading
+static void heading_fn(struct sched_job *job)
+{
+	int accel[3], mag[3], cal_mag[3], heading, err;
+	uint16_t value;
+	uint32_t start;
+	err = lsm303_ll_readAccel(&accel[0], &accel[1], &accel[2]);
+	if (!err) err = lsm303_ll_readMag(&mag[0], &mag[1], &mag[2]);
 	if (err) {
-		printf("Advertising failed to start (err %d)\n", err);
+		// no magnetometer (e.g. a native_posix build without one), report the heading as unknown
+		LOG_RATELIMIT(10000, LOG_ERR, "Error reading the compass: %d", err);
+		heading_value = COMPASS_HEADING_INVALID;
 		return;
 	}
-	printf("Advertising successfully started\n");
+	if (compass_calibrating) compass_cal_add(&compass_cal_run, mag);
+	start = diag_cycles();
+	compass_apply(&compass_cal, mag, cal_mag);
+	heading = compass_heading(accel, cal_mag);
+	diag_record(&diag_timers[T_HEADING], diag_cycles() - start);
+	heading_value = heading < 0 ? COMPASS_HEADING_INVALID : heading;
+	value = sys_cpu_to_le16(heading_value);
+	notify_attr(HEADING_ATTR_IDX, &value, sizeof(value));
+}
+
+// compass job: apply the configs written to the ninth characteristic
+static void compass_fn(struct sched_job *job)
+{
+	struct compass_config config;
+	int err;
+	while (k_msgq_get(&compass_msgq, &config, K_NO_WAIT) == 0) {
+		if (config.period_ms && config.period_ms != heading_period_ms) {
+			heading_period_ms = config.period_ms;
+			sched_job_set_period(&heading_job, heading_period_ms);
+			err = settings_save_one("compass/period", &heading_period_ms, sizeof(heading_period_ms));
+			if (err) LOG_ERR("Error saving the heading period: %d", err);
+			LOG_INF("Heading every %ums", heading_period_ms);
+		}
+		switch (config.command) {
+		case COMPASS_CAL_START:
+			compass_cal_start(&compass_cal_run);
+			compass_calibrating = true;
+			LOG_INF("Compass calibration started, turn the board through every orientation");
+			break;
+		case COMPASS_CAL_SAVE:
+			if (!compass_calibrating) break;
+			compass_calibrating = false;
+			err = compass_cal_finish(&compass_cal_run, &compass_cal);
+			if (err) {
+				LOG_WRN("Compass calibration rejected (%d), the board needs turning further on every axis", err);
+				break;
+			}
+			err = settings_save_one("compass/cal", &compass_cal, sizeof(compass_cal));
+			if (err) LOG_ERR("Error saving the compass calibration: %d", err);
+			LOG_INF("Compass calibrated from %u samples: offset %d %d %d mgauss, scale %u %u %u /256",
+				compass_cal_run.samples, compass_cal.offset[0], compass_cal.offset[1], compass_cal.offset[2],
+				compass_cal.scale[0], compass_cal.scale[1], compass_cal.scale[2]);
+			break;
+		case COMPASS_CAL_CANCEL:
+			compass_calibrating = false;
+			break;
+		case COMPASS_CAL_RESET:
+			compass_calibrating = false;
+			compass_cal_default(&compass_cal);
+			err = settings_delete("compass/cal");
+			if (err) LOG_ERR("Error deleting the compass calibration: %d", err);
+			LOG_INF("Compass calibration reset");
+			break;
+		}
+	}
+}
+
+// power states
+#define IDLE_SYSTEM_OFF_MS (10 * 60 * 1000) // go to system off after 10 minutes without a central
+#define BTN_A 14 // button A wakes the board from system off
+// rough average current in each power state (uA) for the charge estimate
+static const uint32_t power_current_ua[POWER_STATE_COUNT] = {
+	[POWER_ACTIVE] = 1000,
+	[POWER_IDLE] = 60,
+};
+
+// off job: nobody has connected for a long time, turn everything off until button A is pressed
+// waking from system off is a reset so main() runs again from the start
+static void off_fn(struct sched_job *job)
+{
+	// never with a central connected, e.g. one that connected just as the timer ran out:
+	// power_changed() stops this job once the connection has been applied
+	if (active_conn) return;
+#ifdef CONFIG_SOC_FAMILY_NRF
+	LOG_INF("No central for %d s, entering system off, press A to wake", IDLE_SYSTEM_OFF_MS / 1000);
+	LOG_PANIC(); // flush the deferred log before everything stops
+	lsm303_ll_setPowerMode(LSM303_POWER_DOWN);
+	nrf_gpio_cfg_sense_input(BTN_A, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_SENSE_LOW); // button A has an external pull up
+	pm_power_state_force((struct pm_state_info){PM_STATE_SOFT_OFF, 0, 0});
+#else
+	// no system off on this board (e.g. native_posix), stay idle until the next disconnect starts the timer again
+	LOG_INF("No central for %d s, system off isn't available", IDLE_SYSTEM_OFF_MS / 1000);
+	sched_job_stop(job);
+#endif
+}
+
+// power state changes, run on the scheduler thread
+static void power_changed(enum power_state state)
+{
+	int err;
+	if (state == POWER_ACTIVE) {
+		sched_job_stop(&off_job);
+		lsm303_ll_setPowerMode(LSM303_NORMAL);
+		sched_job_start(&accel_job);
+		sched_job_start(&notify_job);
+		sched_job_start(&heading_job);
+		return;
+	}
+	// nothing reads the accelerometer or the compass without a central, stop sampling and power it down
+	sched_job_stop(&accel_job);
+	sched_job_stop(&notify_job);
+	sched_job_stop(&heading_job);
+	compass_calibrating = false;
+	lsm303_ll_setPowerMode(LSM303_POWER_DOWN);
+	sched_job_start(&off_job);
+	// the stack resumed advertising at the fast interval after the disconnect, slow it down
+	bt_le_adv_stop();
+	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME_SLOW, ad, ARRAY_SIZE(ad), NULL, 0);
+	if (err) LOG_ERR("Slow advertising failed to start (err %d)", err);
 }
 
 void main(void)
 {
 	int err;
-	float x,y;
-	x = sine(1.2f);
 	err = lsm303_ll_begin();
 	if (err < 0)
 	{
-		 printf("\nError initializing lsm303.  Error code = %d\n",err);  
+		 LOG_ERR("Error initializing lsm303.  Error code = %d",err);  
          while(1);
 
 	}
+	// compass calibration and heading rate from flash, the defaults are kept if there are none
+	compass_cal_default(&compass_cal);
+	err = settings_subsys_init();
+	if (!err) err = settings_load();
+	if (err) LOG_ERR("Error loading settings (err %d)", err);			
+	// each job runs at its own rate, main returns and the CPU idles between jobs
+	// the device boots idle, the sampling jobs start when a central connects.
+	// set up the jobs and the power state before bluetooth, a central can connect as soon as advertising starts
+	sched_begin();
+	diag_threads[0].tid = sched_thread();
+	diag_begin(diag_timers, T_COUNT, diag_counters, C_COUNT, diag_threads, ARRAY_SIZE(diag_threads));
+	sched_job_init(&accel_job, "accel", accel_fn, ACCEL_PERIOD_MS);
+	sched_job_init(&notify_job, "notify", notify_fn, NOTIFY_PERIOD_MS);
+	sched_job_init(&heading_job, "heading", heading_fn, heading_period_ms);
+	sched_job_init(&compass_job, "compass", compass_fn, 0);
+	sched_job_init(&off_job, "off", off_fn, IDLE_SYSTEM_OFF_MS);
+	power_begin(power_changed, power_current_ua);
+	lsm303_ll_setPowerMode(LSM303_POWER_DOWN);
+	sched_job_start(&off_job);
+
 	err = bt_enable(NULL);
 	if (err) {
-		printk("Bluetooth init failed (err %d)\n", err);
-		return;
-	}
-	bt_ready(); // This function starts advertising
-	bt_conn_cb_register(&conn_callbacks);
-	printf("Zephyr Microbit V2 minimal BLE example! %s\n", CONFIG_BOARD);			
-	while (1) {
-		k_sleep(K_SECONDS(1));
-		char_value++;
-		y_accel = lsm303_ll_readAccelY();
-		x_accel = lsm303_ll_readAccelY();
-		z_accel = lsm303_ll_readAccelY();
-		// Send a notifiy signal to a central device (if there is one)
-		// int bt_gatt_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *data, u16_t len)
-		// conn: Connection object. (NULL for all)
-		// attr: Characteristic Value Descriptor attribute.
-		// data: Pointer to Attribute data.
-		// len: Attribute value length.				
-		if (active_conn)
-		{
-			bt_gatt_notify(active_conn,&my_service_svc.attrs[2], &char_value,sizeof(char_value));			
-		}	
+		// carry on without BLE so the sensor and power handling can still be exercised (native_posix has no radio)
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+	} else {
+		bt_conn_cb_register(&conn_callbacks); // before advertising so no connection is missed
+		bt_ready(); // This function starts advertising
 	}
+	LOG_INF("Zephyr Microbit V2 minimal BLE example! %s", CONFIG_BOARD);
 }
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Convert the recorded data in databases/ into traces for co2_replay
+# One csv per device: unix_s,co2_ppm,temp_centi,hum_centi
+# Temperature and humidity are only logged now and then, the last value seen is carried forward
+import argparse
+import csv
+import json
+import os
+import re
+from datetime import datetime, timezone
+
+DEFAULT_TEMP_CENTI = 2100  # used until a device reports a temperature
+DEFAULT_HUM_CENTI = 4500
+
+# sensor_data rows in the MariaDB dump: (sensor_id, value, 'YYYY-MM-DD HH:MM:SS')
+SQL_ROW = re.compile(r"\((\d+),(-?\d+),'([0-9-]+ [0-9:]+)'\)")
+# sensors rows: (sensor_id, device_id, 'name', 'uuid', 'units')
+SQL_SENSOR = re.compile(r"\((\d+),(\d+),'([^']*)','[^']*','[^']*'\)")
+
+
+def influx_points(path):
+    with open(path) as f:
+        for point in json.load(f):
+            # influx drops the fraction when it is zero
+            when = datetime.fromisoformat(point["time"].replace("Z", "+00:00"))
+            yield point["tags"]["device_ID"], point["tags"]["sensor_name"], int(when.timestamp()), point["fields"]["value"]
+
+
+def mariadb_points(path):
+    with open(path, encoding="utf8") as f:
+        dump = f.read()
+    # the dump has sensor_data before sensors, look the sensors up first
+    sensors = {}
+    for line in re.findall(r"^INSERT INTO `sensors` .*$", dump, re.M):
+        for sensor_id, device_id, name in SQL_SENSOR.findall(line):
+            sensors[sensor_id] = (device_id, name)
+    for line in re.findall(r"^INSERT INTO `sensor_data` .*$", dump, re.M):
+        for sensor_id, value, stamp in SQL_ROW.findall(line):
+            device_id, name = sensors[sensor_id]
+            when = datetime.strptime(stamp, "%Y-%m-%d %H:%M:%S").replace(tzinfo=timezone.utc)
+            yield device_id, name, int(when.timestamp()), int(value)
+
+
+def write_traces(points, prefix, out_dir):
+    traces = {}
+    latest = {}
+    for device, name, when, value in sorted(points, key=lambda p: p[2]):
+        temp, hum = latest.get(device, (DEFAULT_TEMP_CENTI, DEFAULT_HUM_CENTI))
+        if name == "Temperature":
+            latest[device] = (value * 100, hum)
+        elif name == "Humidity":
+            latest[device] = (temp, value * 100)
+        elif name == "CO2":
+            traces.setdefault(device, []).append((when, value, temp, hum))
+    for device, rows in traces.items():
+        path = os.path.join(out_dir, "%s_%s.csv" % (prefix, re.sub(r"[^0-9A-Za-z]", "", device)))
+        with open(path, "w", newline="") as f:
+            csv.writer(f).writerows(rows)
+        print("%s: %d samples" % (path, len(rows)))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    databases = os.path.join(here, "..", "..", "..", "databases")
+    parser = argparse.ArgumentParser(description="Convert the recorded data into co2_replay traces")
+    parser.add_argument("--influx", default=os.path.join(databases, "IMicrobit.json"))
+    parser.add_argument("--mariadb", default=os.path.join(databases, "RMicrobit.sql"))
+    parser.add_argument("--out", default=".")
+    args = parser.parse_args()
+    write_traces(influx_points(args.influx), "influx", args.out)
+    write_traces(mariadb_points(args.mariadb), "mariadb", args.out)
+
+
+if __name__ == "__main__":
+    main()
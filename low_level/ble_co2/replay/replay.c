@@ -0,0 +1,354 @@
+/* replay.c - run the ble_co2 application logic on a recorded trace
+ *
+ * Links the same co2_pipeline, sampler, co2_alarm and sample_codec sources as the firmware
+ * and stands in for the drivers: the scd30 returns the trace, notifications, matrix writes
+ * and interval changes are counted. A virtual clock steps through the trace at whatever
+ * interval the sampler asks for, so days of data run in well under a second.
+ *
+ * The CPU estimate multiplies the counted driver calls by per-call costs. The defaults are
+ * rough figures for the micro:bit v2, replace them with the means "diag show" reports on the
+ * board (--cost-scd30, --cost-notify, --cost-matrix).
+ */
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "co2_pipeline.h"
+
+// same as main.c
+#define IDLE_INTERVAL_SECONDS 30
+#define ALARM_BAND_PPM 400
+#define ALARM_HYSTERESIS_PPM 50
+#define ALARM_DWELL_S 10
+#define DISPLAY_TIMEOUT_MS 5000
+#define RENDER_PERIOD_MS 15	// three rows with a 5ms sleep after each
+static const struct sampler_config sampler_defaults = {
+	.min_interval_s = 2,
+	.max_interval_s = 120,
+	.slope_ppm_min = 30,
+	.deadband_ppm = 20,
+};
+
+#define GAP_S 300		// the device was off, jump over gaps longer than this in the trace
+#define MAX_PRESSES 32
+#define DEFAULT_MTU 247		// CONFIG_BT_L2CAP_TX_MTU
+
+struct trace_point {
+	int64_t ms;
+	struct sample s;
+};
+
+struct press {
+	int64_t ms;		// from the start of the trace
+	int step;		// +100 for button b, -100 for button a
+};
+
+// per call costs in us
+static struct {
+	uint32_t scd30;
+	uint32_t notify;
+	uint32_t matrix;
+} cost = { .scd30 = 6500, .notify = 150, .matrix = 20 };
+
+static struct {
+	uint32_t measurements;
+	uint32_t batches;
+	uint32_t batch_bytes;
+	uint32_t batch_samples;
+	uint32_t alarm_notifies;
+	uint32_t alarm_changes[CO2_LEVEL_COUNT];
+	uint32_t interval_changes;
+	uint32_t matrix_puts;
+	uint32_t display_changes;
+	uint32_t threshold_changes;
+} stats;
+
+static bool events;		// print every notification and display change
+static bool connected = true;	// notifications only go out while connected
+static uint16_t mtu = DEFAULT_MTU;
+static int64_t now_ms;		// virtual clock
+static int64_t start_ms;
+static int start_threshold = 700;
+static bool display_on;
+static int digit_rows[3];	// threshold digit, left as it was for a threshold with no digit
+static int64_t display_since_ms;	// renderer writes up to here are counted
+static int64_t display_off_ms;
+static int shown_pattern = -1;	// matrix row pattern on show, -1 when off
+static struct co2_pipeline co2_pipe;
+
+static void event(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void event(const char *fmt, ...)
+{
+	va_list args;
+
+	if (!events) return;
+	printf("%9.1fs ", (now_ms - start_ms) / 1000.0);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	putchar('\n');
+}
+
+// stand in for the matrix, only a change of pattern counts as a display change
+static void matrix_show(int pattern, const char *what)
+{
+	if (pattern != shown_pattern) {
+		stats.display_changes++;
+		event("display %s", what);
+	}
+	shown_pattern = pattern;
+}
+
+static void send_batch(const uint8_t *buf, uint16_t len)
+{
+	if (!connected) return;
+	stats.batches++;
+	stats.batch_bytes += len;
+	stats.batch_samples += buf[1];
+	event("notify batch %u samples %u bytes", buf[1], len);
+}
+
+static uint16_t batch_max_len(void)
+{
+	if (!connected) return SAMPLE_CODEC_MAX_BATCH_LEN;
+	return mtu - 3;
+}
+
+static void set_interval(uint16_t seconds)
+{
+	stats.interval_changes++;
+	event("interval %us", seconds);
+}
+
+static void alarm_changed(enum co2_level level, uint32_t co2_ppm)
+{
+	stats.alarm_changes[level]++;
+	if (connected) stats.alarm_notifies++;
+	event("alarm %s at %uppm", co2_level_name(level), co2_ppm);
+	if (level == CO2_LEVEL_NORMAL && !display_on) matrix_show(-1, "off");
+}
+
+static const struct co2_pipeline_ops ops = {
+	.send_batch = send_batch,
+	.batch_max_len = batch_max_len,
+	.set_interval = set_interval,
+	.alarm_changed = alarm_changed,
+};
+
+// update_alarm() in main.c
+static void update_alarm(uint32_t co2_ppm)
+{
+	co2_pipeline_alarm(&co2_pipe, co2_ppm, now_ms);
+	if (co2_pipe.alarm.level != CO2_LEVEL_NORMAL && !display_on) {
+		stats.matrix_puts++;
+		matrix_show(co2_alarm_rows[co2_pipe.alarm.level], co2_level_name(co2_pipe.alarm.level));
+	}
+}
+
+// count the digit rows the renderer has put on the matrix since the last count
+static void renderer_count(int64_t until_ms)
+{
+	if (display_on) stats.matrix_puts += 3 * ((until_ms - display_since_ms) / RENDER_PERIOD_MS);
+	display_since_ms = until_ms;
+}
+
+// the renderer runs until the display times out, then clears the matrix and the alarm job puts
+// the alarm pattern back for the latest measurement
+static void display_update(int64_t until_ms, uint32_t co2_ppm)
+{
+	int64_t ms = now_ms;
+
+	if (!display_on || display_off_ms > until_ms) return;
+	renderer_count(display_off_ms);
+	display_on = false;
+	now_ms = display_off_ms; // for the events
+	matrix_show(-1, "off");
+	update_alarm(co2_ppm);
+	now_ms = ms;
+}
+
+// button callbacks and alarm_fn() in main.c
+static void press(int step, uint32_t co2_ppm)
+{
+	int threshold = co2_threshold_step(co2_pipe.alarm.cfg.threshold_ppm, step, display_on);
+
+	if (threshold != co2_pipe.alarm.cfg.threshold_ppm) {
+		if (co2_pipeline_set_threshold(&co2_pipe, threshold)) event("threshold %d rejected", threshold);
+		else stats.threshold_changes++;
+	}
+	co2_threshold_digit(co2_pipe.alarm.cfg.threshold_ppm, digit_rows);
+	event("button %c, threshold %u", step > 0 ? 'b' : 'a', co2_pipe.alarm.cfg.threshold_ppm);
+	// a digit can't be mistaken for an alarm pattern, those only use the first five bits
+	matrix_show(digit_rows[0] << 10 | digit_rows[1] << 5 | digit_rows[2], "threshold digit");
+	renderer_count(now_ms);
+	display_on = true;
+	display_off_ms = now_ms + DISPLAY_TIMEOUT_MS;
+	update_alarm(co2_ppm);
+}
+
+static struct trace_point *read_trace(const char *path, size_t *count)
+{
+	FILE *f = fopen(path, "r");
+	struct trace_point *points = NULL;
+	size_t n = 0, size = 0;
+	char line[128];
+
+	if (!f) return NULL;
+	while (fgets(line, sizeof(line), f)) {
+		long long unix_s;
+		long co2, temp = 2100, hum = 4500;
+
+		if (sscanf(line, "%lld,%ld,%ld,%ld", &unix_s, &co2, &temp, &hum) < 2) continue; // header or blank
+		if (n == size) {
+			size = size ? size * 2 : 1024;
+			points = realloc(points, size * sizeof(*points));
+			if (!points) break;
+		}
+		points[n].ms = unix_s * 1000;
+		points[n].s.co2_ppm = co2 < 0 ? 0 : co2;
+		points[n].s.temp_centi = temp;
+		points[n].s.hum_centi = hum < 0 ? 0 : hum;
+		n++;
+	}
+	fclose(f);
+	*count = n;
+	return points;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [options] trace.csv\n"
+		"  trace lines are unix_s,co2_ppm[,temp_centi,hum_centi], see export_traces.py\n"
+		"  --threshold <ppm>        starting co2 threshold (700)\n"
+		"  --press <s>:<a|b>        press a button this many seconds into the trace, repeatable\n"
+		"  --idle                   replay with no central connected, interval floor %us\n"
+		"  --mtu <bytes>            ATT MTU of the connection (%u)\n"
+		"  --cost-scd30 <us>        time per measurement read (%u)\n"
+		"  --cost-notify <us>       time per bt_gatt_notify (%u)\n"
+		"  --cost-matrix <us>       time per matrix_put_pattern (%u)\n"
+		"  --events                 print every notification and display change\n",
+		name, IDLE_INTERVAL_SECONDS, DEFAULT_MTU, cost.scd30, cost.notify, cost.matrix);
+}
+
+int main(int argc, char **argv)
+{
+	struct press presses[MAX_PRESSES];
+	size_t press_count = 0, next_press = 0;
+	struct trace_point *trace;
+	size_t count, i = 0;
+	const char *path = NULL;
+	struct timespec host_start, host_end;
+	int64_t gap_ms = 0, sample_ms;
+	double host_s, cpu_ms, trace_s;
+
+	for (int a = 1; a < argc; a++) {
+		const char *arg = argv[a];
+		const char *val = a + 1 < argc ? argv[a + 1] : NULL;
+		char button;
+		double at;
+
+		if (!strcmp(arg, "--events")) events = true;
+		else if (!strcmp(arg, "--idle")) connected = false;
+		else if (arg[0] != '-') path = arg;
+		else if (!val) {
+			usage(argv[0]);
+			return 1;
+		} else {
+			a++;
+			if (!strcmp(arg, "--threshold")) start_threshold = atoi(val);
+			else if (!strcmp(arg, "--mtu")) mtu = atoi(val);
+			else if (!strcmp(arg, "--cost-scd30")) cost.scd30 = atoi(val);
+			else if (!strcmp(arg, "--cost-notify")) cost.notify = atoi(val);
+			else if (!strcmp(arg, "--cost-matrix")) cost.matrix = atoi(val);
+			else if (!strcmp(arg, "--press") && press_count < MAX_PRESSES &&
+				 sscanf(val, "%lf:%c", &at, &button) == 2 && (button == 'a' || button == 'b')) {
+				presses[press_count].ms = at * 1000;
+				presses[press_count].step = button == 'b' ? CO2_THRESHOLD_STEP_PPM : -CO2_THRESHOLD_STEP_PPM;
+				press_count++;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+	if (!path || mtu < 23) {
+		usage(argv[0]);
+		return 1;
+	}
+	trace = read_trace(path, &count);
+	if (!trace || !count) {
+		fprintf(stderr, "%s: no samples\n", path);
+		return 1;
+	}
+	// presses are taken in order
+	for (size_t p = 1; p < press_count; p++) {
+		for (size_t q = p; q && presses[q - 1].ms > presses[q].ms; q--) {
+			struct press tmp = presses[q];
+			presses[q] = presses[q - 1];
+			presses[q - 1] = tmp;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &host_start);
+	start_ms = now_ms = trace[0].ms;
+	co2_pipeline_init(&co2_pipe, &ops, &sampler_defaults, connected ? 0 : IDLE_INTERVAL_SECONDS, &(struct co2_alarm_config){
+		.threshold_ppm = start_threshold,
+		.band_ppm = ALARM_BAND_PPM,
+		.hysteresis_ppm = ALARM_HYSTERESIS_PPM,
+		.dwell_s = ALARM_DWELL_S,
+	});
+	while (now_ms <= trace[count - 1].ms) {
+		// the scd30 reads the latest point in the trace
+		while (i + 1 < count && trace[i + 1].ms <= now_ms) i++;
+		if (trace[i].ms + GAP_S * 1000 < now_ms) {
+			event("gap of %llds", (long long)(trace[i + 1].ms - now_ms) / 1000);
+			gap_ms += trace[i + 1].ms - now_ms;
+			now_ms = trace[++i].ms;
+		}
+		// buttons pressed since the last measurement, the clock goes back to each press for the events
+		sample_ms = now_ms;
+		while (next_press < press_count && start_ms + presses[next_press].ms <= sample_ms) {
+			now_ms = start_ms + presses[next_press].ms;
+			display_update(now_ms, trace[i].s.co2_ppm);
+			press(presses[next_press++].step, trace[i].s.co2_ppm);
+		}
+		now_ms = sample_ms;
+		display_update(now_ms, trace[i].s.co2_ppm);
+
+		stats.measurements++;
+		co2_pipeline_sample(&co2_pipe, &trace[i].s, now_ms);
+		update_alarm(trace[i].s.co2_ppm);
+		now_ms += co2_pipe.interval_s * 1000;
+	}
+	display_update(INT64_MAX, trace[i].s.co2_ppm);
+	clock_gettime(CLOCK_MONOTONIC, &host_end);
+	host_s = (host_end.tv_sec - host_start.tv_sec) + (host_end.tv_nsec - host_start.tv_nsec) / 1e9;
+	trace_s = (now_ms - start_ms - gap_ms) / 1000.0; // only the time the device was recording
+
+	cpu_ms = ((double)stats.measurements * cost.scd30 +
+		  (double)(stats.batches + stats.alarm_notifies) * cost.notify +
+		  (double)stats.matrix_puts * cost.matrix) / 1000;
+	printf("trace          %s, %zu points over %.1fh, %.1fh of gaps skipped, %s\n", path, count, trace_s / 3600,
+	       gap_ms / 3600000.0, connected ? "connected" : "idle");
+	printf("measurements   %u (%.1f per trace point)\n", stats.measurements, (double)stats.measurements / count);
+	printf("batches        %u notified, %u bytes, %.1f samples and %.1f bytes each\n", stats.batches, stats.batch_bytes,
+	       stats.batches ? (double)stats.batch_samples / stats.batches : 0,
+	       stats.batches ? (double)stats.batch_bytes / stats.batches : 0);
+	printf("alarm          %u notified, normal %u elevated %u high %u critical %u\n", stats.alarm_notifies,
+	       stats.alarm_changes[CO2_LEVEL_NORMAL], stats.alarm_changes[CO2_LEVEL_ELEVATED],
+	       stats.alarm_changes[CO2_LEVEL_HIGH], stats.alarm_changes[CO2_LEVEL_CRITICAL]);
+	printf("interval       %u changes, %us at the end\n", stats.interval_changes, co2_pipe.interval_s);
+	printf("display        %u changes, %u matrix writes, threshold %d (%u changes)\n", stats.display_changes,
+	       stats.matrix_puts, co2_pipe.alarm.cfg.threshold_ppm, stats.threshold_changes);
+	printf("cpu estimate   %.1fms, %.4f%% of the trace (scd30 %uus, notify %uus, matrix %uus per call)\n", cpu_ms,
+	       trace_s ? cpu_ms / 10 / trace_s : 0, cost.scd30, cost.notify, cost.matrix);
+	printf("host           %.0fus, %.0fx real time\n", host_s * 1e6, host_s ? trace_s / host_s : 0);
+	free(trace);
+	return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef __TEST_H
+#define __TEST_H
+#include <stdio.h>
+/*
+ * Minimal checks for the host tests, each test is a program that returns non-zero on failure.
+ * CHECK_EQ takes integers, the failing values are printed with the expression.
+ */
+static int test_failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		test_failures++; \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+	} \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+	long long _a = (long long)(actual), _e = (long long)(expected); \
+	if (_a != _e) { \
+		test_failures++; \
+		printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+	} \
+} while (0)
+
+// return this from main
+#define TEST_RESULT() (printf("%s: %d failures\n", __FILE__, test_failures), test_failures ? 1 : 0)
+#endif
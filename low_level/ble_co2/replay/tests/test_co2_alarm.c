@@ -0,0 +1,143 @@
+/* test_co2_alarm.c - alarm levels, hysteresis, dwell and config validation */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "co2_alarm.h"
+#include "test.h"
+
+// elevated from 700ppm, high from 1000ppm, critical from 1300ppm, each left 50ppm below its start
+static const struct co2_alarm_config cfg = {
+	.threshold_ppm = 700,
+	.band_ppm = 300,
+	.hysteresis_ppm = 50,
+	.dwell_s = 0,
+};
+
+static void test_levels(void)
+{
+	struct co2_alarm a;
+
+	co2_alarm_init(&a, &cfg);
+	CHECK_EQ(a.level, CO2_LEVEL_NORMAL);
+	CHECK(!co2_alarm_update(&a, 699, 0));
+	CHECK(co2_alarm_update(&a, 700, 1));
+	CHECK_EQ(a.level, CO2_LEVEL_ELEVATED);
+	CHECK(!co2_alarm_update(&a, 999, 2));
+	CHECK(co2_alarm_update(&a, 1000, 3));
+	CHECK_EQ(a.level, CO2_LEVEL_HIGH);
+	CHECK(co2_alarm_update(&a, 1300, 4));
+	CHECK_EQ(a.level, CO2_LEVEL_CRITICAL);
+	CHECK(!co2_alarm_update(&a, 40000, 5));
+
+	// straight from normal to critical and back
+	co2_alarm_init(&a, &cfg);
+	CHECK(co2_alarm_update(&a, 1500, 0));
+	CHECK_EQ(a.level, CO2_LEVEL_CRITICAL);
+	CHECK(co2_alarm_update(&a, 400, 1));
+	CHECK_EQ(a.level, CO2_LEVEL_NORMAL);
+}
+
+static void test_hysteresis(void)
+{
+	struct co2_alarm a;
+
+	co2_alarm_init(&a, &cfg);
+	co2_alarm_update(&a, 1300, 0);
+	CHECK_EQ(a.level, CO2_LEVEL_CRITICAL);
+	CHECK(!co2_alarm_update(&a, 1250, 1));	// inside the hysteresis
+	CHECK(co2_alarm_update(&a, 1249, 2));
+	CHECK_EQ(a.level, CO2_LEVEL_HIGH);
+	CHECK(!co2_alarm_update(&a, 1299, 3));	// not back up until the band start
+	CHECK(!co2_alarm_update(&a, 950, 4));
+	CHECK(co2_alarm_update(&a, 949, 5));
+	CHECK_EQ(a.level, CO2_LEVEL_ELEVATED);
+	CHECK(!co2_alarm_update(&a, 650, 6));
+	CHECK(co2_alarm_update(&a, 649, 7));
+	CHECK_EQ(a.level, CO2_LEVEL_NORMAL);
+
+	// a drop from critical takes only the bands the hysteresis lets go of
+	co2_alarm_init(&a, &cfg);
+	co2_alarm_update(&a, 1300, 0);
+	CHECK(co2_alarm_update(&a, 960, 1));
+	CHECK_EQ(a.level, CO2_LEVEL_HIGH);
+}
+
+static void test_dwell(void)
+{
+	struct co2_alarm_config slow = cfg;
+	struct co2_alarm a;
+
+	slow.dwell_s = 60;
+	co2_alarm_init(&a, &slow);
+	CHECK(!co2_alarm_update(&a, 800, 1000));
+	CHECK(!co2_alarm_update(&a, 800, 1059));
+	CHECK(co2_alarm_update(&a, 800, 1060));
+	CHECK_EQ(a.level, CO2_LEVEL_ELEVATED);
+
+	// jitter back into the current level restarts the dwell
+	CHECK(!co2_alarm_update(&a, 600, 1100));
+	CHECK(!co2_alarm_update(&a, 800, 1110));
+	CHECK(!co2_alarm_update(&a, 600, 1170));
+	CHECK(!co2_alarm_update(&a, 600, 1229));
+	CHECK(co2_alarm_update(&a, 600, 1230));
+	CHECK_EQ(a.level, CO2_LEVEL_NORMAL);
+
+	// a rise that keeps going keeps its start time
+	CHECK(!co2_alarm_update(&a, 800, 2000));
+	CHECK(!co2_alarm_update(&a, 1400, 2030));
+	CHECK(co2_alarm_update(&a, 1400, 2060));
+	CHECK_EQ(a.level, CO2_LEVEL_CRITICAL);
+
+	// turning around restarts it
+	co2_alarm_init(&a, &slow);
+	co2_alarm_update(&a, 800, 0);
+	co2_alarm_update(&a, 800, 60);
+	CHECK_EQ(a.level, CO2_LEVEL_ELEVATED);
+	CHECK(!co2_alarm_update(&a, 1400, 100));
+	CHECK(!co2_alarm_update(&a, 400, 130));
+	CHECK(!co2_alarm_update(&a, 400, 189));
+	CHECK(co2_alarm_update(&a, 400, 190));
+	CHECK_EQ(a.level, CO2_LEVEL_NORMAL);
+}
+
+static void test_config(void)
+{
+	struct co2_alarm_config bad;
+	struct co2_alarm a;
+
+	co2_alarm_init(&a, &cfg);
+	CHECK(co2_alarm_config_valid(&cfg));
+
+	bad = cfg;
+	bad.hysteresis_ppm = bad.threshold_ppm;
+	CHECK_EQ(co2_alarm_set_config(&a, &bad), -EINVAL);
+	bad = cfg;
+	bad.band_ppm = 0;
+	CHECK_EQ(co2_alarm_set_config(&a, &bad), -EINVAL);
+	bad = cfg;
+	bad.threshold_ppm = 0;
+	CHECK_EQ(co2_alarm_set_config(&a, &bad), -EINVAL);
+	CHECK(!memcmp(&a.cfg, &cfg, sizeof(cfg)));	// rejected configs leave it alone
+
+	// the level is kept until the next measurement is checked against the new config
+	co2_alarm_update(&a, 800, 0);
+	bad = cfg;
+	bad.threshold_ppm = 900;
+	CHECK_EQ(co2_alarm_set_config(&a, &bad), 0);
+	CHECK_EQ(a.cfg.threshold_ppm, 900);
+	CHECK_EQ(a.level, CO2_LEVEL_ELEVATED);
+	CHECK(co2_alarm_update(&a, 800, 1));
+	CHECK_EQ(a.level, CO2_LEVEL_NORMAL);
+}
+
+int main(void)
+{
+	test_levels();
+	test_hysteresis();
+	test_dwell();
+	test_config();
+	CHECK(!strcmp(co2_level_name(CO2_LEVEL_CRITICAL), "critical"));
+	CHECK(!strcmp(co2_level_name(CO2_LEVEL_COUNT), "?"));
+	return TEST_RESULT();
+}
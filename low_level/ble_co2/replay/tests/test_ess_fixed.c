@@ -0,0 +1,119 @@
+/* test_ess_fixed.c - integer float to fixed-point conversion against libm rounding */
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "ess_fixed.h"
+#include "test.h"
+
+// the SCD30 sends floats as big-endian words
+static void float_bytes(float f, uint8_t bytes[4])
+{
+	uint32_t bits;
+
+	memcpy(&bits, &f, sizeof(bits));
+	bytes[0] = bits >> 24;
+	bytes[1] = bits >> 16;
+	bytes[2] = bits >> 8;
+	bytes[3] = bits;
+}
+
+static int32_t to_fixed(float f, uint32_t scale)
+{
+	uint8_t bytes[4];
+
+	float_bytes(f, bytes);
+	return ess_float_to_fixed(bytes, scale);
+}
+
+static int16_t temperature(float f)
+{
+	uint8_t bytes[4];
+
+	float_bytes(f, bytes);
+	return ess_temperature_from_raw(bytes);
+}
+
+static uint16_t humidity(float f)
+{
+	uint8_t bytes[4];
+
+	float_bytes(f, bytes);
+	return ess_humidity_from_raw(bytes);
+}
+
+static uint32_t co2(float f)
+{
+	uint8_t bytes[4];
+
+	float_bytes(f, bytes);
+	return ess_co2_from_raw(bytes);
+}
+
+// xorshift32, the same values on every run
+static uint32_t rng_state = 2463534242u;
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+int main(void)
+{
+	int i;
+
+	// exact values and rounding, half up on the magnitude
+	CHECK_EQ(to_fixed(0.0f, 100), 0);
+	CHECK_EQ(to_fixed(-0.0f, 100), 0);
+	CHECK_EQ(to_fixed(1.0f, 100), 100);
+	CHECK_EQ(to_fixed(21.5f, 100), 2150);
+	CHECK_EQ(to_fixed(-21.5f, 100), -2150);
+	CHECK_EQ(to_fixed(0.125f, 100), 13);	// 12.5 exactly
+	CHECK_EQ(to_fixed(-0.125f, 100), -13);
+	CHECK_EQ(to_fixed(812.4f, 1), 812);
+	CHECK_EQ(to_fixed(812.5f, 1), 813);
+	CHECK_EQ(to_fixed(1e-30f, 100), 0);	// far below the resolution
+	CHECK_EQ(to_fixed(1e-40f, 100), 0);	// denormal
+
+	// saturation
+	CHECK_EQ(to_fixed(INFINITY, 100), INT32_MAX);
+	CHECK_EQ(to_fixed(-INFINITY, 100), INT32_MIN);
+	CHECK_EQ(to_fixed(NAN, 100), INT32_MAX);
+	CHECK_EQ(to_fixed(3e7f, 100), INT32_MAX);
+	CHECK_EQ(to_fixed(-3e7f, 100), INT32_MIN);
+	CHECK_EQ(to_fixed(1e30f, 1), INT32_MAX);
+
+	// the ESS ranges
+	CHECK_EQ(temperature(21.53f), 2153);
+	CHECK_EQ(temperature(-12.34f), -1234);
+	CHECK_EQ(temperature(-300.0f), -27315);
+	CHECK_EQ(temperature(400.0f), INT16_MAX);
+	CHECK_EQ(temperature(INFINITY), INT16_MAX);
+	CHECK_EQ(temperature(NAN), ESS_TEMPERATURE_UNKNOWN);	// a failed measurement
+	CHECK_EQ(temperature(-NAN), ESS_TEMPERATURE_UNKNOWN);
+	CHECK_EQ(humidity(45.67f), 4567);
+	CHECK_EQ(humidity(-1.0f), 0);
+	CHECK_EQ(humidity(100.5f), 10000);
+	CHECK_EQ(humidity(INFINITY), 10000);
+	CHECK_EQ(humidity(NAN), ESS_HUMIDITY_UNKNOWN);
+	CHECK_EQ(humidity(-NAN), ESS_HUMIDITY_UNKNOWN);
+	CHECK_EQ(co2(812.6f), 813);
+	CHECK_EQ(co2(-5.0f), 0);
+	CHECK_EQ(co2(40000.0f), 40000);
+
+	// random floats across the sensor ranges against libm, float * 100 is exact in a double
+	for (i = 0; i < 1000000; i++) {
+		float f = ((int32_t)rng() / 2147483648.0f) * 300.0f;
+		if (to_fixed(f, 100) != llround((double)f * 100)) {
+			CHECK_EQ(to_fixed(f, 100), llround((double)f * 100));
+			break;
+		}
+		f = (rng() / 4294967296.0f) * 40000.0f;
+		if (to_fixed(f, 1) != llround(f)) {
+			CHECK_EQ(to_fixed(f, 1), llround(f));
+			break;
+		}
+	}
+	return TEST_RESULT();
+}
@@ -0,0 +1,151 @@
+/* test_sample_codec.c - sample batch encoding, limits and decoding */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "sample_codec.h"
+#include "test.h"
+
+// xorshift32, the same values on every run
+static uint32_t rng_state = 2463534242u;
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static void test_bytes(void)
+{
+	struct sample_batch batch;
+	static const uint8_t expected[] = {
+		SAMPLE_CODEC_VERSION, 3, 0x34, 0x12,
+		0x90, 0x03, 0x09, 0x88, 0x27,	// 400ppm, -0.05degC, 50.00%RH
+		0x05, 0x02, 0x00, 0x00,		// 5s later, +1ppm
+		0xac, 0x02, 0x01, 0x01, 0x01,	// 300s later, -1ppm, -0.01degC, -0.01%RH
+	};
+
+	sample_batch_reset(&batch, SAMPLE_CODEC_MAX_BATCH_LEN);
+	CHECK_EQ(batch.len, SAMPLE_CODEC_HEADER_LEN);
+	CHECK_EQ(batch.buf[0], SAMPLE_CODEC_VERSION);
+	CHECK_EQ(batch.buf[1], 0);
+	CHECK_EQ(sample_batch_add(&batch, &(struct sample){ 400, -5, 5000 }, 7), 0);
+	CHECK_EQ(sample_batch_add(&batch, &(struct sample){ 401, -5, 5000 }, 5), 0);
+	CHECK_EQ(sample_batch_add(&batch, &(struct sample){ 400, -6, 4999 }, 300), 0);
+	sample_batch_set_age(&batch, 0x1234);
+	CHECK_EQ(batch.len, sizeof(expected));
+	CHECK(!memcmp(batch.buf, expected, sizeof(expected)));
+}
+
+static void test_round_trip(void)
+{
+	struct sample in[64], out[64];
+	uint32_t gaps[64], gap_out[64];
+	struct sample_batch batch;
+	uint16_t age;
+	int n, i, round;
+
+	for (round = 0; round < 1000; round++) {
+		sample_batch_reset(&batch, SAMPLE_CODEC_MAX_BATCH_LEN);
+		// the full sensor ranges, so deltas are large and negative as well as small
+		for (n = 0; n < 64; n++) {
+			in[n].co2_ppm = rng() % 40001;
+			in[n].temp_centi = (int32_t)(rng() % 60083) - 27315;
+			in[n].hum_centi = rng() % 10001;
+			gaps[n] = n ? rng() % 4000 : 0;
+			if (sample_batch_add(&batch, &in[n], gaps[n])) break;
+			CHECK(batch.len <= batch.max_len);
+		}
+		sample_batch_set_age(&batch, round);
+		CHECK(n > 0);
+		CHECK_EQ(sample_batch_decode(batch.buf, batch.len, &age, out, gap_out, 64), n);
+		CHECK_EQ(age, round);
+		for (i = 0; i < n; i++) {
+			CHECK_EQ(out[i].co2_ppm, in[i].co2_ppm);
+			CHECK_EQ(out[i].temp_centi, in[i].temp_centi);
+			CHECK_EQ(out[i].hum_centi, in[i].hum_centi);
+			CHECK_EQ(gap_out[i], gaps[i]);
+		}
+		if (test_failures) break;
+	}
+}
+
+static void test_limits(void)
+{
+	struct sample s = { 40000, -27315, 10000 };
+	struct sample_batch batch;
+	uint16_t len;
+
+	sample_batch_reset(&batch, 1000);
+	CHECK_EQ(batch.max_len, SAMPLE_CODEC_MAX_BATCH_LEN);
+
+	// an empty batch takes a sample however small max_len is, the next one waits for a send
+	sample_batch_reset(&batch, 5);
+	CHECK_EQ(sample_batch_add(&batch, &s, 0), 0);
+	len = batch.len;
+	CHECK_EQ(sample_batch_add(&batch, &s, 1), -ENOSPC);
+	CHECK_EQ(batch.len, len);
+	CHECK_EQ(batch.count, 1);
+	CHECK_EQ(batch.buf[1], 1);
+
+	// the worst case first sample fits in a notification at the default MTU
+	CHECK(len <= 20);
+
+	// filling up to max_len exactly: the same sample 1s apart is 4 bytes
+	sample_batch_reset(&batch, len + 4 * 2);
+	CHECK_EQ(sample_batch_add(&batch, &s, 0), 0);
+	CHECK_EQ(sample_batch_add(&batch, &s, 1), 0);
+	CHECK_EQ(sample_batch_add(&batch, &s, 1), 0);
+	CHECK_EQ(batch.len, batch.max_len);
+	CHECK_EQ(sample_batch_add(&batch, &s, 1), -ENOSPC);
+
+	// a smaller max_len applies to the next add, the batch keeps what it has
+	sample_batch_reset(&batch, SAMPLE_CODEC_MAX_BATCH_LEN);
+	CHECK_EQ(sample_batch_add(&batch, &s, 0), 0);
+	CHECK_EQ(sample_batch_add(&batch, &s, 1), 0);
+	sample_batch_set_max_len(&batch, batch.len);
+	CHECK_EQ(sample_batch_add(&batch, &s, 1), -ENOSPC);
+	CHECK_EQ(batch.count, 2);
+}
+
+static void test_decode_errors(void)
+{
+	struct sample_batch batch;
+	struct sample out[4];
+	uint32_t gaps[4];
+	uint8_t buf[SAMPLE_CODEC_MAX_BATCH_LEN];
+	int i;
+
+	sample_batch_reset(&batch, SAMPLE_CODEC_MAX_BATCH_LEN);
+	for (i = 0; i < 3; i++) sample_batch_add(&batch, &(struct sample){ 500 + i, 2000, 4000 }, 60);
+	memcpy(buf, batch.buf, batch.len);
+
+	CHECK_EQ(sample_batch_decode(buf, batch.len, NULL, out, NULL, 4), 3);
+	CHECK_EQ(sample_batch_decode(buf, batch.len, NULL, out, gaps, 2), 2);
+	CHECK_EQ(gaps[0], 0);
+	CHECK_EQ(gaps[1], 60);
+	CHECK_EQ(sample_batch_decode(buf, SAMPLE_CODEC_HEADER_LEN - 1, NULL, out, NULL, 4), -EINVAL);
+	CHECK_EQ(sample_batch_decode(buf, batch.len - 1, NULL, out, NULL, 4), -EINVAL);
+	buf[0] = SAMPLE_CODEC_VERSION - 1;
+	CHECK_EQ(sample_batch_decode(buf, batch.len, NULL, out, NULL, 4), -EINVAL);
+
+	// a varint longer than 32 bits
+	buf[0] = SAMPLE_CODEC_VERSION;
+	buf[1] = 1;
+	memset(&buf[SAMPLE_CODEC_HEADER_LEN], 0x80, 5);
+	buf[SAMPLE_CODEC_HEADER_LEN + 5] = 0x01;
+	CHECK_EQ(sample_batch_decode(buf, SAMPLE_CODEC_HEADER_LEN + 6, NULL, out, NULL, 4), -EINVAL);
+
+	// no samples
+	sample_batch_reset(&batch, SAMPLE_CODEC_MAX_BATCH_LEN);
+	CHECK_EQ(sample_batch_decode(batch.buf, batch.len, NULL, out, NULL, 4), 0);
+}
+
+int main(void)
+{
+	test_bytes();
+	test_round_trip();
+	test_limits();
+	test_decode_errors();
+	return TEST_RESULT();
+}
@@ -0,0 +1,210 @@
+#include <zephyr.h>
+#include <device.h>
+#include <shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "bench.h"
+#include "diag.h"
+#include "matrix.h"
+#include "lsm303_ll.h"
+#include "i2c_bus.h"
+#include "scd30.h"
+
+#define BENCH_MAX_OPS 1000	// latencies kept for the percentiles
+#define BENCH_MATRIX_MS 2000	// length of the matrix test
+#define BENCH_MATRIX_ROWS 5	// one frame is one pass over the rows
+// bits on the wire for one byte: 8 data bits and the ack
+#define I2C_BYTE_BITS 9
+// accelerometer output registers, the bench reads them directly rather than through lsm303_ll.c
+#define LSM303_OUT_X_L_A 0x28
+#define LSM303_AUTO_INCREMENT 0x80
+#define BENCH_NOTIFY_MAX 244	// largest notification with the 247 byte ATT MTU
+
+static uint32_t latency[BENCH_MAX_OPS]; // cycles
+
+// insertion sort, the minimal libc has no qsort and a thousand entries sort in a few ms
+static void sort_u32(uint32_t *v, uint32_t n)
+{
+	for (uint32_t i = 1; i < n; i++)
+	{
+		uint32_t x = v[i], j = i;
+		for (; j > 0 && v[j - 1] > x; j--) v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+// ops/s, p50/p90/p99/max latency and, when bits_per_op is set, bus utilisation at bus_hz over the run
+static void bench_report(const struct shell *shell, const char *name, uint32_t n, uint32_t errors,
+			 int64_t elapsed_ms, uint32_t bits_per_op, uint32_t bus_hz)
+{
+	uint32_t kept = n < BENCH_MAX_OPS ? n : BENCH_MAX_OPS;
+	if (!kept || elapsed_ms <= 0)
+	{
+		shell_error(shell, "%s: nothing measured", name);
+		return;
+	}
+	sort_u32(latency, kept);
+	shell_print(shell, "%s: %u ops in %lld ms, %u errors, %u ops/s", name, n, elapsed_ms, errors,
+		    (uint32_t)(n * 1000LL / elapsed_ms));
+	shell_print(shell, "  latency us p50=%u p90=%u p99=%u max=%u", diag_cycles_to_us(latency[kept / 2]),
+		    diag_cycles_to_us(latency[kept * 9 / 10]), diag_cycles_to_us(latency[kept * 99 / 100]), diag_cycles_to_us(latency[kept - 1]));
+	if (bits_per_op)
+	{
+		// share of the run the bus spent clocking bits at its nominal rate
+		uint64_t busy_us = (uint64_t)n * bits_per_op * 1000000 / bus_hz;
+		shell_print(shell, "  bus %u kHz, utilisation %u.%u%%", bus_hz / 1000,
+			    (uint32_t)(busy_us / (elapsed_ms * 10)), (uint32_t)(busy_us / elapsed_ms % 10));
+	}
+}
+
+static int parse_count(const struct shell *shell, const char *arg, uint32_t max, uint32_t *out)
+{
+	char *end;
+	unsigned long v = strtoul(arg, &end, 0);
+	if (*end || v == 0 || v > max)
+	{
+		shell_error(shell, "expected a number from 1 to %u", max);
+		return -EINVAL;
+	}
+	*out = v;
+	return 0;
+}
+
+static int cmd_bench_i2c_lsm303(const struct shell *shell, size_t argc, char **argv)
+{
+	// the LSM303 driver's bus settings, each read takes the bus lock like the driver's do
+	const struct i2c_bus_dev lsm303 = I2C_BUS_DEV(LSM303_ACCEL_ADDRESS, I2C_SPEED_FAST);
+	uint8_t xyz[6];
+	uint32_t n, i, errors = 0, start;
+	int64_t t0;
+
+	if (parse_count(shell, argv[1], 100000, &n)) return -EINVAL;
+	if (i2c_bus_begin())
+	{
+		shell_error(shell, "no I2C_1");
+		return -ENODEV;
+	}
+	bench_pause();
+	t0 = k_uptime_get();
+	for (i = 0; i < n; i++)
+	{
+		start = diag_cycles();
+		// OUT_X_L_A with the auto increment bit, all three axes in one transaction
+		if (i2c_bus_burst_read(&lsm303, LSM303_OUT_X_L_A | LSM303_AUTO_INCREMENT, xyz, sizeof(xyz))) errors++;
+		if (i < BENCH_MAX_OPS) latency[i] = diag_cycles() - start;
+	}
+	bench_report(shell, "i2c lsm303", n, errors, k_uptime_get() - t0,
+		     // start, address+W, register, restart, address+R, 6 data bytes, stop
+		     (1 + 3 + sizeof(xyz)) * I2C_BYTE_BITS + 3, I2C_BITRATE_FAST);
+	bench_resume();
+	return 0;
+}
+
+static int cmd_bench_scd30(const struct shell *shell, size_t argc, char **argv)
+{
+	uint16_t ready;
+	uint32_t n, i, errors = 0, start;
+	int64_t t0;
+
+	if (parse_count(shell, argv[1], 10000, &n)) return -EINVAL;
+	bench_pause();
+	t0 = k_uptime_get();
+	for (i = 0; i < n; i++)
+	{
+		start = diag_cycles();
+		if (scd30_get_data_ready(&ready)) errors++;
+		if (i < BENCH_MAX_OPS) latency[i] = diag_cycles() - start;
+	}
+	bench_report(shell, "scd30 data ready", n, errors, k_uptime_get() - t0,
+		     // address+W and the 2 byte command, then address+R and a word with its crc, two starts and stops
+		     (3 + 4) * I2C_BYTE_BITS + 4, I2C_BITRATE_STANDARD); // the sensirion HAL's speed
+	bench_resume();
+	return 0;
+}
+
+static int cmd_bench_matrix(const struct shell *shell, size_t argc, char **argv)
+{
+	uint32_t fps, frames = 0, late = 0, start, row;
+	int64_t t0, next_us, now_us, row_us;
+
+	if (parse_count(shell, argv[1], 2000, &fps)) return -EINVAL;
+	row_us = 1000000 / (fps * BENCH_MATRIX_ROWS);
+	bench_pause();
+	t0 = k_uptime_get();
+	next_us = t0 * 1000;
+	while (k_uptime_get() - t0 < BENCH_MATRIX_MS)
+	{
+		for (row = 0; row < BENCH_MATRIX_ROWS; row++)
+		{
+			start = diag_cycles();
+			matrix_put_pattern(1 << row, 0b00000); // every led of the row on
+			if (frames * BENCH_MATRIX_ROWS + row < BENCH_MAX_OPS) latency[frames * BENCH_MATRIX_ROWS + row] = diag_cycles() - start;
+			next_us += row_us;
+			now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+			if (now_us < next_us) k_usleep(next_us - now_us);
+			else late++;
+		}
+		frames++;
+	}
+	matrix_all_off();
+	bench_report(shell, "matrix rows", frames * BENCH_MATRIX_ROWS, 0, k_uptime_get() - t0, 0, 0);
+	shell_print(shell, "  %u fps asked, %u fps achieved, %u late rows", fps,
+		    (uint32_t)(frames * 1000LL / (k_uptime_get() - t0)), late);
+	bench_resume();
+	return 0;
+}
+
+static int cmd_bench_notify(const struct shell *shell, size_t argc, char **argv)
+{
+	static uint8_t payload[BENCH_NOTIFY_MAX];
+	uint32_t len, n, i, errors = 0, retries = 0, start;
+	int64_t t0, elapsed;
+	int err;
+
+	uint16_t max_len = MIN(bench_notify_max_len(), BENCH_NOTIFY_MAX);
+
+	if (!max_len)
+	{
+		shell_error(shell, "no central connected");
+		return -ENOTCONN;
+	}
+	if (parse_count(shell, argv[1], max_len, &len)) return -EINVAL;
+	if (parse_count(shell, argv[2], 100000, &n)) return -EINVAL;
+	for (i = 0; i < len; i++) payload[i] = i;
+	t0 = k_uptime_get();
+	for (i = 0; i < n; i++)
+	{
+		start = diag_cycles();
+		// out of buffers: wait for the controller to send some and try again
+		while ((err = bench_notify(payload, len)) == -ENOMEM)
+		{
+			retries++;
+			k_msleep(1);
+		}
+		if (err == -ENOTCONN)
+		{
+			shell_error(shell, "no central connected");
+			return err;
+		}
+		if (err) errors++;
+		if (i < BENCH_MAX_OPS) latency[i] = diag_cycles() - start;
+	}
+	elapsed = k_uptime_get() - t0;
+	bench_report(shell, "notify", n, errors, elapsed, 0, 0);
+	if (elapsed > 0) shell_print(shell, "  %u bytes/s, %u retries waiting for buffers", (uint32_t)((uint64_t)n * len * 1000 / elapsed), retries);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(bench_i2c_cmds,
+	SHELL_CMD_ARG(lsm303, NULL, "<n> accelerometer XYZ burst reads", cmd_bench_i2c_lsm303, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+SHELL_STATIC_SUBCMD_SET_CREATE(bench_cmds,
+	SHELL_CMD(i2c, &bench_i2c_cmds, "I2C device reads", NULL),
+	SHELL_CMD_ARG(scd30, NULL, "<n> data ready queries", cmd_bench_scd30, 2, 0),
+	SHELL_CMD_ARG(matrix, NULL, "<fps> drive the display for 2 seconds", cmd_bench_matrix, 2, 0),
+	SHELL_CMD_ARG(notify, NULL, "<bytes> <n> notifications to the connected central", cmd_bench_notify, 3, 0),
+	SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(bench, &bench_cmds, "Driver throughput benchmarks", NULL);
@@ -0,0 +1,17 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+#include <stdint.h>
+/*
+ * On-target benchmarks, run from the shell:
+ *   bench i2c lsm303 <n>     n accelerometer XYZ burst reads
+ *   bench scd30 <n>          n data-ready queries (command, 3ms wait, read)
+ *   bench matrix <fps>       drive the multiplexed display for 2 seconds at fps frames/s
+ *   bench notify <bytes> <n> n notifications of bytes each on the bench characteristic
+ * Each reports ops/s, latency percentiles and, for the I2C tests, bus utilisation.
+ * The app provides the hooks below so the benchmarks don't race the normal jobs.
+ */
+void bench_pause(void);		// stop the app's use of the sensors and the display
+void bench_resume(void);
+int bench_notify(const void *data, uint16_t len);	// returns bt_gatt_notify()'s result, -ENOTCONN without a central
+uint16_t bench_notify_max_len(void);
+#endif
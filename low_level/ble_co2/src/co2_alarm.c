@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "co2_alarm.h"
+
+// CO2 level at which band level starts, level 1..CO2_LEVEL_COUNT-1
+static uint32_t band_start(const struct co2_alarm_config *cfg, int level)
+{
+	return cfg->threshold_ppm + (uint32_t)(level - 1) * cfg->band_ppm;
+}
+
+// level the measurement points at, the hysteresis makes it depend on the current level
+static enum co2_level co2_alarm_target(const struct co2_alarm *a, uint32_t co2_ppm)
+{
+	int level = a->level;
+	while (level < CO2_LEVEL_COUNT - 1 && co2_ppm >= band_start(&a->cfg, level + 1)) level++;
+	while (level > CO2_LEVEL_NORMAL && co2_ppm + a->cfg.hysteresis_ppm < band_start(&a->cfg, level)) level--;
+	return (enum co2_level)level;
+}
+
+void co2_alarm_init(struct co2_alarm *a, const struct co2_alarm_config *cfg)
+{
+	a->cfg = *cfg;
+	a->level = CO2_LEVEL_NORMAL;
+	a->pending = CO2_LEVEL_NORMAL;
+	a->pending_since_s = 0;
+}
+
+bool co2_alarm_config_valid(const struct co2_alarm_config *cfg)
+{
+	return cfg->threshold_ppm > 0 && cfg->band_ppm > 0 && cfg->hysteresis_ppm < cfg->threshold_ppm;
+}
+
+// Returns 0 or -EINVAL, the current level is kept and re-evaluated on the next update
+int co2_alarm_set_config(struct co2_alarm *a, const struct co2_alarm_config *cfg)
+{
+	if (!co2_alarm_config_valid(cfg)) return -EINVAL;
+	a->cfg = *cfg;
+	return 0;
+}
+
+// Feed a measurement taken at now_s. Returns true when the debounced level changes
+bool co2_alarm_update(struct co2_alarm *a, uint32_t co2_ppm, uint32_t now_s)
+{
+	enum co2_level target = co2_alarm_target(a, co2_ppm);
+	if (target == a->level)
+	{
+		a->pending = target; // back inside the current level, drop any pending change
+		return false;
+	}
+	if (a->pending == a->level || (target > a->level) != (a->pending > a->level))
+	{
+		// started moving away from the current level, or turned around: start timing the dwell
+		// a move that keeps going the same way (e.g. elevated -> critical) keeps its start time
+		a->pending_since_s = now_s;
+	}
+	a->pending = target;
+	if (now_s - a->pending_since_s < a->cfg.dwell_s) return false;
+	a->level = target;
+	return true;
+}
+
+const char *co2_level_name(enum co2_level level)
+{
+	static const char *const names[CO2_LEVEL_COUNT] = { "normal", "elevated", "high", "critical" };
+	return level < CO2_LEVEL_COUNT ? names[level] : "?";
+}
@@ -0,0 +1,41 @@
+#ifndef __CO2_ALARM_H
+#define __CO2_ALARM_H
+#include <stdint.h>
+#include <stdbool.h>
+/*
+ * CO2 alarm state machine with severity bands, hysteresis and a minimum dwell time.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * Band n (1..3) is entered when CO2 reaches threshold_ppm + (n - 1) * band_ppm and left
+ * when it drops below that level minus hysteresis_ppm. A new level is only taken once
+ * the measurements have pointed at it for dwell_s seconds, so a reading that jitters
+ * around a boundary doesn't flap the display or the notifications.
+ */
+enum co2_level {
+	CO2_LEVEL_NORMAL,
+	CO2_LEVEL_ELEVATED,	// at or above the user threshold
+	CO2_LEVEL_HIGH,
+	CO2_LEVEL_CRITICAL,
+	CO2_LEVEL_COUNT
+};
+
+struct co2_alarm_config {
+	uint16_t threshold_ppm;		// start of the elevated band
+	uint16_t band_ppm;		// width of the elevated and high bands
+	uint16_t hysteresis_ppm;	// how far below a band's start CO2 must drop to leave it
+	uint16_t dwell_s;		// time a new level must persist before it is taken
+};
+
+struct co2_alarm {
+	struct co2_alarm_config cfg;
+	enum co2_level level;		// current, debounced level
+	enum co2_level pending;		// level the measurements point at
+	uint32_t pending_since_s;	// when pending was first seen
+};
+
+void co2_alarm_init(struct co2_alarm *a, const struct co2_alarm_config *cfg);
+bool co2_alarm_config_valid(const struct co2_alarm_config *cfg);
+int co2_alarm_set_config(struct co2_alarm *a, const struct co2_alarm_config *cfg);
+bool co2_alarm_update(struct co2_alarm *a, uint32_t co2_ppm, uint32_t now_s);
+const char *co2_level_name(enum co2_level level);
+#endif
@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "co2_pipeline.h"
+
+const uint8_t co2_alarm_rows[CO2_LEVEL_COUNT] = { 0b00000, 0b10000, 0b11100, 0b11111 };
+
+// publish the current batch and start a new one
+static void batch_send(struct co2_pipeline *p, uint32_t now_s)
+{
+	sample_batch_set_age(&p->batch, now_s - p->batch_last_s);
+	p->ops->send_batch(p->batch.buf, p->batch.len);
+	sample_batch_reset(&p->batch, p->ops->batch_max_len());
+}
+
+// add a sample taken at time_s to the batch, sending the batch first when the sample doesn't fit
+// and after it when it is full
+static void batch_put(struct co2_pipeline *p, const struct sample *s, uint32_t time_s, uint32_t now_s)
+{
+	if (sample_batch_add(&p->batch, s, time_s - p->batch_last_s) == -ENOSPC) {
+		batch_send(p, now_s);
+		sample_batch_add(&p->batch, s, 0); // an empty batch always takes it
+	}
+	if (p->batch.count == 1) p->batch_first_s = time_s;
+	p->batch_last_s = time_s;
+	if (p->batch.count >= CO2_PIPELINE_BATCH_SAMPLES) batch_send(p, now_s);
+}
+
+// follow the notification payload size, it drops back to the default on a new connection and
+// grows after an MTU exchange. An open batch that no longer fits is re-encoded into ones that do
+static void batch_fit(struct co2_pipeline *p, uint32_t now_s)
+{
+	struct sample open[CO2_PIPELINE_BATCH_SAMPLES];
+	uint32_t gap_s[CO2_PIPELINE_BATCH_SAMPLES];
+	uint16_t max_len = p->ops->batch_max_len();
+	uint32_t time_s = p->batch_first_s;
+	int n, i;
+
+	if (p->batch.len <= max_len) {
+		sample_batch_set_max_len(&p->batch, max_len);
+		return;
+	}
+	n = sample_batch_decode(p->batch.buf, p->batch.len, NULL, open, gap_s, CO2_PIPELINE_BATCH_SAMPLES);
+	sample_batch_reset(&p->batch, max_len);
+	for (i = 0; i < n; i++) {
+		time_s += gap_s[i];
+		batch_put(p, &open[i], time_s, now_s);
+	}
+}
+
+// add a measurement to the batch
+static void batch_add(struct co2_pipeline *p, const struct sample *s, uint32_t now_s)
+{
+	batch_fit(p, now_s);
+	batch_put(p, s, now_s, now_s);
+}
+
+// floor_s is the sampler floor to boot with, the app doesn't hear about the starting interval through the ops
+void co2_pipeline_init(struct co2_pipeline *p, const struct co2_pipeline_ops *ops, const struct sampler_config *sampler_cfg,
+		       uint16_t floor_s, const struct co2_alarm_config *alarm_cfg)
+{
+	p->ops = ops;
+	sampler_init(&p->sampler, sampler_cfg);
+	sampler_set_floor(&p->sampler, floor_s);
+	co2_alarm_init(&p->alarm, alarm_cfg);
+	p->interval_s = p->sampler.interval_s;
+	p->batch_first_s = 0;
+	p->batch_last_s = 0;
+	sample_batch_reset(&p->batch, ops->batch_max_len());
+}
+
+// batch the new measurement if it changed enough and follow the sampler's interval
+void co2_pipeline_sample(struct co2_pipeline *p, const struct sample *s, int64_t now_ms)
+{
+	uint32_t now_s = now_ms / 1000;
+	if (sampler_update(&p->sampler, s, now_s)) batch_add(p, s, now_s);
+	// air has gone stable, don't hold what we have for longer than the max age
+	if (p->batch.count && now_s - p->batch_first_s >= CO2_PIPELINE_BATCH_MAX_AGE_S) {
+		batch_fit(p, now_s);
+		if (p->batch.count) batch_send(p, now_s);
+	}
+	co2_pipeline_set_interval(p, p->sampler.interval_s, now_ms);
+}
+
+// change the measurement interval, the app moves the scd30 and its sample job to match
+// the open batch carries the time of each sample so it is kept
+void co2_pipeline_set_interval(struct co2_pipeline *p, uint16_t seconds, int64_t now_ms)
+{
+	if (seconds == p->interval_s) return;
+	p->interval_s = seconds;
+	p->ops->set_interval(seconds);
+}
+
+// raise or drop the lower bound on the interval, e.g. while nobody is connected
+void co2_pipeline_set_floor(struct co2_pipeline *p, uint16_t floor_s, int64_t now_ms)
+{
+	sampler_set_floor(&p->sampler, floor_s);
+	co2_pipeline_set_interval(p, p->sampler.interval_s, now_ms);
+}
+
+// change the start of the elevated band, the alarm config is the only copy of the threshold.
+// Returns 0 or -EINVAL and leaves the threshold as it was, it has to stay above the hysteresis
+int co2_pipeline_set_threshold(struct co2_pipeline *p, uint16_t threshold_ppm)
+{
+	struct co2_alarm_config cfg = p->alarm.cfg;
+	cfg.threshold_ppm = threshold_ppm;
+	return co2_alarm_set_config(&p->alarm, &cfg);
+}
+
+// run the alarm state machine on a measurement, true when the level changed
+bool co2_pipeline_alarm(struct co2_pipeline *p, uint32_t co2_ppm, int64_t now_ms)
+{
+	if (!co2_alarm_update(&p->alarm, co2_ppm, now_ms / 1000)) return false;
+	p->ops->alarm_changed(p->alarm.level, co2_ppm);
+	return true;
+}
+
+// threshold after a button press, step is +/-CO2_THRESHOLD_STEP_PPM and the first press only shows it
+int co2_threshold_step(int threshold, int step, bool display_on)
+{
+	//if co2 threshold not muliple of 100, round down to nearest 100
+	if (threshold % CO2_THRESHOLD_STEP_PPM) threshold = (threshold / CO2_THRESHOLD_STEP_PPM) * CO2_THRESHOLD_STEP_PPM;
+	//bring a threshold written over BLE back into range on the side being stepped towards
+	if (step > 0 && threshold > CO2_THRESHOLD_MAX_PPM) threshold = CO2_THRESHOLD_MAX_PPM;
+	if (step < 0 && threshold < CO2_THRESHOLD_MIN_PPM) threshold = CO2_THRESHOLD_MIN_PPM;
+	if (display_on && (step > 0 ? threshold < CO2_THRESHOLD_MAX_PPM : threshold > CO2_THRESHOLD_MIN_PPM)) {
+		threshold += step;
+	}
+	return threshold;
+}
+
+// the matrix rows that show the threshold's hundreds digit, -EINVAL leaves rows as they were
+int co2_threshold_digit(int threshold, int rows[3])
+{
+	switch (threshold)
+	{
+		case 700:
+			rows[0] = 0b11111;
+			rows[1] = 0b00001;
+			rows[2] = 0b00001;
+			break;
+		case 800:
+			rows[0] = 0b11111;
+			rows[1] = 0b10101;
+			rows[2] = 0b11111;
+			break;
+		case 600:
+			rows[0] = 0b11101;
+			rows[1] = 0b10101;
+			rows[2] = 0b11111;
+			break;
+		case 900:
+			rows[0] = 0b11111;
+			rows[1] = 0b10101;
+			rows[2] = 0b10111;
+			break;
+		case 500:
+			rows[0] = 0b11101;
+			rows[1] = 0b10101;
+			rows[2] = 0b10111;
+			break;
+		default:
+			return -EINVAL;
+	}
+	return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef __CO2_PIPELINE_H
+#define __CO2_PIPELINE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sample_codec.h"
+#include "sampler.h"
+#include "co2_alarm.h"
+/*
+ * What the app does with each CO2 measurement, pulled out of main.c so the replay harness
+ * in ../replay runs the same decisions on recorded traces.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * A measurement that gets through the sampler's dead-band goes into the open batch with the time
+ * since the sample before it, so the batch stays open across the measurements the dead-band drops
+ * and across interval changes. It is sent when it is full, after CO2_PIPELINE_BATCH_SAMPLES samples
+ * or once its oldest sample is CO2_PIPELINE_BATCH_MAX_AGE_S old. The alarm runs on every
+ * measurement. Notifications, the scd30 interval and the matrix are left to the app through the ops.
+ */
+#define CO2_PIPELINE_BATCH_SAMPLES 16	// send a batch at least every 16 samples
+#define CO2_PIPELINE_BATCH_MAX_AGE_S SAMPLER_HEARTBEAT_S	// and at least as often as the sampler heartbeat
+
+// the buttons move the threshold in 100ppm steps between 500 and 900
+#define CO2_THRESHOLD_MIN_PPM 500
+#define CO2_THRESHOLD_MAX_PPM 900
+#define CO2_THRESHOLD_STEP_PPM 100
+
+struct co2_pipeline_ops {
+	void (*send_batch)(const uint8_t *buf, uint16_t len);
+	uint16_t (*batch_max_len)(void);	// largest batch that fits in one notification
+	void (*set_interval)(uint16_t seconds);	// the sampler asked for a new measurement interval
+	void (*alarm_changed)(enum co2_level level, uint32_t co2_ppm);
+};
+
+struct co2_pipeline {
+	const struct co2_pipeline_ops *ops;
+	struct sampler sampler;
+	struct co2_alarm alarm;
+	struct sample_batch batch;
+	uint32_t batch_first_s;	// when the oldest sample in the batch was taken, for the max age
+	uint32_t batch_last_s;	// when the newest sample in the batch was taken, for its age and the next gap
+	uint16_t interval_s;	// measurement interval in use
+};
+
+// matrix rows lit for each alarm level, more rows for higher levels
+extern const uint8_t co2_alarm_rows[CO2_LEVEL_COUNT];
+
+void co2_pipeline_init(struct co2_pipeline *p, const struct co2_pipeline_ops *ops, const struct sampler_config *sampler_cfg,
+		       uint16_t floor_s, const struct co2_alarm_config *alarm_cfg);
+void co2_pipeline_sample(struct co2_pipeline *p, const struct sample *s, int64_t now_ms);
+void co2_pipeline_set_interval(struct co2_pipeline *p, uint16_t seconds, int64_t now_ms);
+void co2_pipeline_set_floor(struct co2_pipeline *p, uint16_t floor_s, int64_t now_ms);
+int co2_pipeline_set_threshold(struct co2_pipeline *p, uint16_t threshold_ppm);
+bool co2_pipeline_alarm(struct co2_pipeline *p, uint32_t co2_ppm, int64_t now_ms);
+
+int co2_threshold_step(int threshold, int step, bool display_on);
+int co2_threshold_digit(int threshold, int rows[3]);
+#endif
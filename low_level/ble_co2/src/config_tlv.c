@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
+#include "config_tlv.h"
+
+// Returns 0, -EMSGSIZE if an entry is truncated or has the wrong length for its tag,
+// or -EINVAL for an unknown or repeated tag. out is only valid when 0 is returned
+int config_tlv_parse(const uint8_t *buf, size_t len, struct config_update *out)
+{
+	size_t pos = 0;
+	memset(out, 0, sizeof(*out));
+	while (pos < len)
+	{
+		uint8_t tag, vlen;
+		if (len - pos < 2) return -EMSGSIZE;
+		tag = buf[pos];
+		vlen = buf[pos + 1];
+		pos += 2;
+		if (vlen > len - pos) return -EMSGSIZE;
+		if (tag == 0 || tag >= CONFIG_TAG_COUNT || CONFIG_HAS(out, tag)) return -EINVAL;
+		if (vlen != sizeof(uint16_t)) return -EMSGSIZE;
+		out->value[tag] = buf[pos] | (uint16_t)buf[pos + 1] << 8;
+		out->present |= 1u << tag;
+		pos += vlen;
+	}
+	return 0;
+}
+
+// Appends one entry. Returns the number of bytes written, 0 if it doesn't fit
+size_t config_tlv_put(uint8_t *buf, size_t size, enum config_tag tag, uint16_t value)
+{
+	if (size < CONFIG_TLV_ENTRY_LEN) return 0;
+	buf[0] = tag;
+	buf[1] = sizeof(uint16_t);
+	buf[2] = (uint8_t)value;
+	buf[3] = (uint8_t)(value >> 8);
+	return CONFIG_TLV_ENTRY_LEN;
+}
@@ -0,0 +1,35 @@
+#ifndef __CONFIG_TLV_H
+#define __CONFIG_TLV_H
+#include <stdint.h>
+#include <stddef.h>
+/*
+ * Binary encoding of the configuration characteristic.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * The value is a list of entries: tag (1 byte), length (1 byte), value (length bytes,
+ * little endian). Every value is currently a uint16 so length is always 2. A write only
+ * needs to carry the entries it changes, e.g. 01 02 20 03 sets the threshold to 800ppm.
+ */
+enum config_tag {
+	CONFIG_TAG_THRESHOLD = 1,	// ppm, start of the elevated alarm band
+	CONFIG_TAG_HYSTERESIS = 2,	// ppm, alarm hysteresis
+	CONFIG_TAG_MIN_INTERVAL = 3,	// s, sampler interval while co2 is changing
+	CONFIG_TAG_MAX_INTERVAL = 4,	// s, longest sampler interval while co2 is stable
+	CONFIG_TAG_SLOPE = 5,		// ppm/minute that counts as changing
+	CONFIG_TAG_DEADBAND = 6,	// ppm change needed to send a sample
+	CONFIG_TAG_CALIBRATION = 7,	// ppm, reference for a forced recalibration, write only
+	CONFIG_TAG_COUNT
+};
+#define CONFIG_TLV_ENTRY_LEN 4
+// a write may set each tag once
+#define CONFIG_TLV_MAX_LEN ((CONFIG_TAG_COUNT - 1) * CONFIG_TLV_ENTRY_LEN)
+
+struct config_update {
+	uint16_t present;			// bit (1 << tag) is set for every tag in the write
+	uint16_t value[CONFIG_TAG_COUNT];	// indexed by tag
+};
+#define CONFIG_HAS(update, tag) ((update)->present & (1u << (tag)))
+
+int config_tlv_parse(const uint8_t *buf, size_t len, struct config_update *out);
+size_t config_tlv_put(uint8_t *buf, size_t size, enum config_tag tag, uint16_t value);
+#endif
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include "ess_fixed.h"
+
+/*
+ * Convert a big-endian IEEE754 single precision float to value * scale, rounded to nearest.
+ * A float is (-1)^sign * 1.mantissa * 2^(exponent - 127), so with the implicit bit restored the
+ * result is mantissa * scale * 2^(exponent - 150) which only needs a multiply and a shift.
+ * Out of range values and NaN/infinity saturate to INT32_MIN/INT32_MAX.
+ */
+int32_t ess_float_to_fixed(const uint8_t bytes[4], uint32_t scale)
+{
+	uint32_t bits = (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+			(uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
+	int negative = bits >> 31;
+	int exponent = (bits >> 23) & 0xff;
+	uint64_t value = (uint64_t)((bits & 0x7fffff) | 0x800000) * scale;
+	int shift = exponent - 150;
+
+	if (exponent == 0) return 0; // zero or denormal, far below 0.01 resolution
+	if (exponent == 0xff) return negative ? INT32_MIN : INT32_MAX; // infinity or NaN
+	if (shift >= 0)
+	{
+		if (shift > 31 || (value << shift) > INT32_MAX) return negative ? INT32_MIN : INT32_MAX;
+		value <<= shift;
+	}
+	else if (shift > -64)
+	{
+		value = (value + ((uint64_t)1 << (-shift - 1))) >> -shift; // round half up on the magnitude
+		if (value > INT32_MAX) return negative ? INT32_MIN : INT32_MAX;
+	}
+	else
+	{
+		value = 0;
+	}
+	return negative ? -(int32_t)value : (int32_t)value;
+}
+
+// a NaN has every exponent bit set and a mantissa that isn't zero, the SCD30 sends one for a failed measurement
+static int float_is_nan(const uint8_t bytes[4])
+{
+	return (bytes[0] & 0x7f) == 0x7f && (bytes[1] & 0x80) && ((bytes[1] & 0x7f) || bytes[2] || bytes[3]);
+}
+
+// ESS Temperature: sint16, 0.01 degC, valid range -273.15 to 327.67, NaN is reported as unknown
+int16_t ess_temperature_from_raw(const uint8_t bytes[4])
+{
+	int32_t centi;
+
+	if (float_is_nan(bytes)) return ESS_TEMPERATURE_UNKNOWN;
+	centi = ess_float_to_fixed(bytes, 100);
+	if (centi < -27315) return -27315;
+	if (centi > INT16_MAX) return INT16_MAX;
+	return (int16_t)centi;
+}
+
+// ESS Humidity: uint16, 0.01 %RH, valid range 0 to 100.00, NaN is reported as unknown
+uint16_t ess_humidity_from_raw(const uint8_t bytes[4])
+{
+	int32_t centi;
+
+	if (float_is_nan(bytes)) return ESS_HUMIDITY_UNKNOWN;
+	centi = ess_float_to_fixed(bytes, 100);
+	if (centi < 0) return 0;
+	if (centi > 10000) return 10000;
+	return (uint16_t)centi;
+}
+
+// CO2 in whole ppm, the SCD30 range is 0 to 40000 ppm
+uint32_t ess_co2_from_raw(const uint8_t bytes[4])
+{
+	int32_t ppm = ess_float_to_fixed(bytes, 1);
+	return ppm < 0 ? 0 : (uint32_t)ppm;
+}
@@ -0,0 +1,18 @@
+#ifndef __ESS_FIXED_H
+#define __ESS_FIXED_H
+#include <stdint.h>
+/*
+ * Integer-only conversion of the SCD30's big-endian IEEE754 float words into the
+ * fixed-point encodings used by the Environmental Sensing Service (ESS):
+ * Temperature (0x2A6E) is a sint16 in 0.01 degC and Humidity (0x2A6F) a uint16 in 0.01 %RH.
+ * No floating point is used so sensirion_bytes_to_float() and soft-float are not needed.
+ */
+// ESS "value is not known" markers
+#define ESS_TEMPERATURE_UNKNOWN ((int16_t)0x8000)
+#define ESS_HUMIDITY_UNKNOWN ((uint16_t)0xFFFF)
+
+int32_t ess_float_to_fixed(const uint8_t bytes[4], uint32_t scale);
+int16_t ess_temperature_from_raw(const uint8_t bytes[4]);
+uint16_t ess_humidity_from_raw(const uint8_t bytes[4]);
+uint32_t ess_co2_from_raw(const uint8_t bytes[4]);
+#endif
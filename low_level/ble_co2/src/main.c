@@ -30,12 +30,27 @@
 #include <device.h>
 #include <drivers/sensor.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "sensirion_i2c.h"
 #include "buttons.h"
 #include "scd30.h"
 #include "matrix.h"
+#include "sample_codec.h"
+#include "ess_fixed.h"
+#include "sched.h"
+#include "power.h"
+#include "sampler.h"
+#include "co2_alarm.h"
+#include "config_tlv.h"
+#include "co2_pipeline.h"
+#include "log_ram.h"
+#include "diag.h"
+#include "bench.h"
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app, CONFIG_APP_LOG_LEVEL);
 
 
 // ********************[ Start of First characteristic ]**************************************
@@ -43,55 +58,31 @@
 static struct bt_uuid_128 co2_id=BT_UUID_INIT_128(BT_UUID_CO2_VAL); // the 128 bit UUID for this gatt value
 uint32_t co2_value; // the gatt characateristic value that is being shared over BLE	
 static ssize_t read_co2(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
-static ssize_t write_co2(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
-int co2_threshold = 700;
+static struct sched_job alarm_job; //event: applies button presses and re-evaluates the alarm
 // Callback that is activated when the characteristic is read by central
 static ssize_t read_co2(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a read %p\n",attr);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a read %p", attr);
 	// Could use 'const char *value =  attr->user_data' also here if there is the char value is being maintained with the BLE STACK
 	const char *value = (const char *)&co2_value; // point at the value in memory
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(co2_value)); // pass the value back up through the BLE stack
 }
 
-//write function for co2 characteristic
-static ssize_t write_co2(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-			 const void *buf, uint16_t len, uint16_t offset,
-			 uint8_t flags)
-{
-	//set value = attribute data
-	uint8_t *value = attr->user_data;
-	//convert ascii number data to int
-	int co2_write = atoi((char *)buf);
-	printf("Got a write %d\n",co2_write);
-
-	//if conversion to int returns non 0 and is not the same as current val
-	if (co2_write && co2_threshold != co2_write) {
-		//set new threshold
-		co2_threshold = co2_write;
-		//if new threshold is less than current value, turn off leds 
-		if(co2_write > co2_value) matrix_all_off();
-	}
-	
-	memcpy(value, buf, len); // copy the incoming value in the memory occupied by our characateristic variable
-	return len;
-}
-
 // Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
-#define BT_GATT_CHAR1 BT_GATT_CHARACTERISTIC(&co2_id.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY | BT_GATT_CHRC_WRITE , BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, read_co2, write_co2, &co2_value)
+#define BT_GATT_CHAR1 BT_GATT_CHARACTERISTIC(&co2_id.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, read_co2, NULL, &co2_value)
 // ********************[ End of First characteristic ]****************************************
 
 // ********************[ Start of Second characteristic ]**************************************
 //#define BT_UUID_TEMP_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)2)
 #define BT_UUID_TEMP_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)0x272F)
 static struct bt_uuid_16 temp_id=BT_UUID_INIT_16(BT_UUID_TEMPERATURE_VAL); // the 128 bit UUID for this gatt value
-uint32_t temp_value; // the gatt characateristic value that is being shared over BLE	
+int16_t temp_value; // ESS Temperature: sint16 in 0.01 degC
 static ssize_t read_temp(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 
 // Callback that is activated when the characteristic is read by central
 static ssize_t read_temp(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a read %p\n",attr);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a read %p", attr);
 	// Could use 'const char *value =  attr->user_data' also here if there is the char value is being maintained with the BLE STACK
 	const char *value = (const char *)&temp_value; // point at the value in memory
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(temp_value)); // pass the value back up through the BLE stack
@@ -104,13 +95,13 @@ static ssize_t read_temp(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 // ********************[ Start of Third characteristic ]**************************************
 #define BT_UUID_HUM_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)3)
 static struct bt_uuid_16 hum_id=BT_UUID_INIT_16(BT_UUID_HUMIDITY_VAL); // the 128 bit UUID for this gatt value
-uint32_t hum_value; // the gatt characateristic value that is being shared over BLE	
+uint16_t hum_value; // ESS Humidity: uint16 in 0.01 %RH
 static ssize_t read_hum(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 
 // Callback that is activated when the characteristic is read by central
 static ssize_t read_hum(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
 {
-	printf("Got a read %p\n",attr);
+	LOG_RATELIMIT(1000, LOG_DBG, "Got a read %p", attr);
 	// Could use 'const char *value =  attr->user_data' also here if there is the char value is being maintained with the BLE STACK
 	const char *value = (const char *)&hum_value; // point at the value in memory
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(hum_value)); // pass the value back up through the BLE stack
@@ -120,6 +111,181 @@ static ssize_t read_hum(struct bt_conn *conn, const struct bt_gatt_attr *attr, v
 #define BT_GATT_CHAR3 BT_GATT_CHARACTERISTIC(&hum_id.uuid, BT_GATT_CHRC_READ , BT_GATT_PERM_READ , read_hum, NULL, &hum_value)
 // ********************[ End of Third characteristic ]****************************************
 
+// ********************[ Start of Fourth characteristic ]**************************************
+// Delta/varint encoded batch of recent samples, see sample_codec.h for the format
+#define BT_UUID_BATCH_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)4)
+static struct bt_uuid_128 batch_id=BT_UUID_INIT_128(BT_UUID_BATCH_VAL); // the 128 bit UUID for this gatt value
+static uint8_t batch_value[SAMPLE_CODEC_MAX_BATCH_LEN]; // last completed batch, returned on read
+static uint16_t batch_value_len;
+static ssize_t read_batch(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+
+// Callback that is activated when the characteristic is read by central
+static ssize_t read_batch(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, batch_value, batch_value_len); // pass the value back up through the BLE stack
+}
+
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR4 BT_GATT_CHARACTERISTIC(&batch_id.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_READ, read_batch, NULL, batch_value), \
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+// ********************[ End of Fourth characteristic ]****************************************
+
+// ********************[ Start of Fifth characteristic ]**************************************
+// Time spent in each power state and the estimated charge used, see power.h
+#define BT_UUID_POWER_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)5)
+static struct bt_uuid_128 power_id=BT_UUID_INIT_128(BT_UUID_POWER_VAL); // the 128 bit UUID for this gatt value
+static ssize_t read_power(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+
+// Callback that is activated when the characteristic is read by central
+static ssize_t read_power(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	struct power_stats stats;
+	power_get_stats(&stats); // snapshot, includes the time spent so far in the current state
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats)); // pass the value back up through the BLE stack
+}
+
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR5 BT_GATT_CHARACTERISTIC(&power_id.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, read_power, NULL, NULL)
+// ********************[ End of Fifth characteristic ]****************************************
+
+// ********************[ Start of Sixth characteristic ]**************************************
+// Configuration as tag-length-value entries, see config_tlv.h. Reads return every readable entry,
+// writes carry only the entries to change and are applied all or nothing
+#define BT_UUID_CONFIG_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)6)
+static struct bt_uuid_128 config_id=BT_UUID_INIT_128(BT_UUID_CONFIG_VAL); // the 128 bit UUID for this gatt value
+static struct co2_pipeline co2_pipe; // sampler, alarm and open batch, owned by the scheduler thread
+#define CALIBRATION_MIN_PPM 400 // scd30 forced recalibration range
+#define CALIBRATION_MAX_PPM 2000
+K_MSGQ_DEFINE(config_msgq, sizeof(struct config_update), 2, 2); // written configs waiting for the config job
+static struct sched_job config_job; //event: applies written configs on the scheduler thread
+static ssize_t read_config(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t write_config(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+
+// Callback that is activated when the characteristic is read by central, long reads come back with an offset
+static ssize_t read_config(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	uint8_t value[CONFIG_TLV_MAX_LEN];
+	size_t n = 0;
+	n += config_tlv_put(&value[n], sizeof(value) - n, CONFIG_TAG_THRESHOLD, co2_pipe.alarm.cfg.threshold_ppm);
+	n += config_tlv_put(&value[n], sizeof(value) - n, CONFIG_TAG_HYSTERESIS, co2_pipe.alarm.cfg.hysteresis_ppm);
+	n += config_tlv_put(&value[n], sizeof(value) - n, CONFIG_TAG_MIN_INTERVAL, co2_pipe.sampler.cfg.min_interval_s);
+	n += config_tlv_put(&value[n], sizeof(value) - n, CONFIG_TAG_MAX_INTERVAL, co2_pipe.sampler.cfg.max_interval_s);
+	n += config_tlv_put(&value[n], sizeof(value) - n, CONFIG_TAG_SLOPE, co2_pipe.sampler.cfg.slope_ppm_min);
+	n += config_tlv_put(&value[n], sizeof(value) - n, CONFIG_TAG_DEADBAND, co2_pipe.sampler.cfg.deadband_ppm);
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, n); // pass the value back up through the BLE stack
+}
+
+// Callback that is activated when the characteristic is written by central
+// Writes longer than the MTU come as prepare writes: the stack checks each chunk with
+// BT_GATT_WRITE_FLAG_PREPARE set and on execute passes the reassembled value in a single call.
+// The whole write is checked here and handed to the config job, nothing is changed from the BT thread
+static ssize_t write_config(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 const void *buf, uint16_t len, uint16_t offset,
+			 uint8_t flags)
+{
+	struct config_update update;
+	struct sampler_config sampler_cfg = co2_pipe.sampler.cfg;
+	struct co2_alarm_config alarm_cfg = co2_pipe.alarm.cfg;
+	int err;
+
+	if (offset + len > CONFIG_TLV_MAX_LEN) return BT_GATT_ERR(offset ? BT_ATT_ERR_INVALID_OFFSET : BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	if (flags & BT_GATT_WRITE_FLAG_PREPARE) return 0; // chunk accepted, the value is checked on execute
+	if (offset) return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET); // values are only replaced whole
+
+	err = config_tlv_parse(buf, len, &update);
+	if (err == -EMSGSIZE) return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	if (err) return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	// check the result of applying the write to the current config
+	if (CONFIG_HAS(&update, CONFIG_TAG_THRESHOLD)) alarm_cfg.threshold_ppm = update.value[CONFIG_TAG_THRESHOLD];
+	if (CONFIG_HAS(&update, CONFIG_TAG_HYSTERESIS)) alarm_cfg.hysteresis_ppm = update.value[CONFIG_TAG_HYSTERESIS];
+	if (CONFIG_HAS(&update, CONFIG_TAG_MIN_INTERVAL)) sampler_cfg.min_interval_s = update.value[CONFIG_TAG_MIN_INTERVAL];
+	if (CONFIG_HAS(&update, CONFIG_TAG_MAX_INTERVAL)) sampler_cfg.max_interval_s = update.value[CONFIG_TAG_MAX_INTERVAL];
+	if (CONFIG_HAS(&update, CONFIG_TAG_SLOPE)) sampler_cfg.slope_ppm_min = update.value[CONFIG_TAG_SLOPE];
+	if (CONFIG_HAS(&update, CONFIG_TAG_DEADBAND)) sampler_cfg.deadband_ppm = update.value[CONFIG_TAG_DEADBAND];
+	if (!co2_alarm_config_valid(&alarm_cfg) || !sampler_config_valid(&sampler_cfg)) return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	if (CONFIG_HAS(&update, CONFIG_TAG_CALIBRATION) &&
+	    (update.value[CONFIG_TAG_CALIBRATION] < CALIBRATION_MIN_PPM || update.value[CONFIG_TAG_CALIBRATION] > CALIBRATION_MAX_PPM))
+	{
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	if (k_msgq_put(&config_msgq, &update, K_NO_WAIT)) return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+	sched_job_trigger(&config_job);
+	return len;
+}
+
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR6 BT_GATT_CHARACTERISTIC(&config_id.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE | BT_GATT_PERM_PREPARE_WRITE, read_config, write_config, NULL)
+// ********************[ End of Sixth characteristic ]****************************************
+
+// ********************[ Start of Seventh characteristic ]**************************************
+// Most recent log output as text, see log_ram.h. Read it with a long read to get the whole snapshot
+#define BT_UUID_LOG_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)7)
+static struct bt_uuid_128 log_id=BT_UUID_INIT_128(BT_UUID_LOG_VAL); // the 128 bit UUID for this gatt value
+static uint8_t log_value[512]; // snapshot taken when a read starts, 512 is the longest attribute value
+static uint16_t log_value_len;
+static ssize_t read_log(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+
+// Callback that is activated when the characteristic is read by central
+static ssize_t read_log(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	// the rest of a long read comes back with an offset, keep serving the same snapshot
+	if (offset == 0) log_value_len = log_ram_read(log_value, sizeof(log_value));
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, log_value, log_value_len); // pass the value back up through the BLE stack
+}
+
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR7 BT_GATT_CHARACTERISTIC(&log_id.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, read_log, NULL, log_value)
+// ********************[ End of Seventh characteristic ]****************************************
+
+// ********************[ Start of Eighth characteristic ]**************************************
+// Diagnostics as text: driver call timings in us, notification counters and stack usage, see diag.h
+// the same report (with histograms) is printed by the "diag show" shell command
+#define BT_UUID_DIAG_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)8)
+static struct bt_uuid_128 diag_id=BT_UUID_INIT_128(BT_UUID_DIAG_VAL); // the 128 bit UUID for this gatt value
+enum { T_SCD30, T_MATRIX, T_NOTIFY, T_COUNT };
+static struct diag_timer diag_timers[T_COUNT] = {
+	[T_SCD30] = DIAG_TIMER_INIT("scd30_read"),
+	[T_MATRIX] = DIAG_TIMER_INIT("matrix_put_pattern"),
+	[T_NOTIFY] = DIAG_TIMER_INIT("bt_gatt_notify"),
+};
+enum { C_NOTIFY_OK, C_NOTIFY_FAILED, C_SENSOR_ERRORS, C_COUNT };
+static struct diag_counter diag_counters[C_COUNT] = {
+	[C_NOTIFY_OK] = DIAG_COUNTER_INIT("notify_ok"),
+	[C_NOTIFY_FAILED] = DIAG_COUNTER_INIT("notify_failed"),
+	[C_SENSOR_ERRORS] = DIAG_COUNTER_INIT("sensor_errors"),
+};
+// main returns once everything is set up, the sampling runs on the scheduler thread
+enum { TH_RENDERER, TH_SCHED, TH_COUNT };
+static struct diag_thread diag_threads[TH_COUNT] = {
+	[TH_RENDERER] = { .name = "renderer" },
+	[TH_SCHED] = { .name = "sched" },
+};
+static char diag_value[512]; // snapshot taken when a read starts, 512 is the longest attribute value
+static uint16_t diag_value_len;
+static ssize_t read_diag(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+
+// Callback that is activated when the characteristic is read by central
+static ssize_t read_diag(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	// the rest of a long read comes back with an offset, keep serving the same snapshot
+	if (offset == 0) diag_value_len = diag_format(diag_value, sizeof(diag_value), false);
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, diag_value, diag_value_len); // pass the value back up through the BLE stack
+}
+
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR8 BT_GATT_CHARACTERISTIC(&diag_id.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ, read_diag, NULL, diag_value)
+// ********************[ End of Eighth characteristic ]****************************************
+
+// ********************[ Start of Ninth characteristic ]**************************************
+// Filler notifications for the "bench notify" shell command, no value of its own, see bench.h
+#define BT_UUID_BENCH_VAL    BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)9)
+static struct bt_uuid_128 bench_id=BT_UUID_INIT_128(BT_UUID_BENCH_VAL); // the 128 bit UUID for this gatt value
+
+// Arguments to BT_GATT_CHARACTERISTIC = _uuid, _props, _perm, _read, _write, _value
+#define BT_GATT_CHAR9 BT_GATT_CHARACTERISTIC(&bench_id.uuid, BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL, NULL, NULL), \
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+// ********************[ End of Ninth characteristic ]****************************************
+
 
 
 // ********************[ Service definition ]********************
@@ -131,9 +297,38 @@ BT_GATT_SERVICE_DEFINE(my_service_svc,
 	BT_GATT_PRIMARY_SERVICE(&my_service_uuid),
 		BT_GATT_CHAR1,
 		BT_GATT_CHAR2,
-		BT_GATT_CHAR3
-		
+		BT_GATT_CHAR3,
+		BT_GATT_CHAR4,
+		BT_GATT_CHAR5,
+		BT_GATT_CHAR6,
+		BT_GATT_CHAR7,
+		BT_GATT_CHAR8,
+		BT_GATT_CHAR9
 );
+// attribute indices of the characteristic values within my_service_svc
+#define CO2_ATTR_IDX 2
+#define BATCH_ATTR_IDX 8
+#define BENCH_ATTR_IDX 19
+
+// notify the central (if there is one), timed and counted for the diagnostics
+static void notify_attr(int attr_idx, const void *data, uint16_t len)
+{
+	int err;
+	if (!active_conn) return;
+	DIAG_TIME(&diag_timers[T_NOTIFY], err = bt_gatt_notify(active_conn, &my_service_svc.attrs[attr_idx], data, len));
+	diag_count(&diag_counters[err ? C_NOTIFY_FAILED : C_NOTIFY_OK]);
+}
+// the bench module sends through here, it counts the buffer waits itself so they stay out of the diagnostics
+int bench_notify(const void *data, uint16_t len)
+{
+	if (!active_conn) return -ENOTCONN;
+	return bt_gatt_notify(active_conn, &my_service_svc.attrs[BENCH_ATTR_IDX], data, len);
+}
+
+uint16_t bench_notify_max_len(void)
+{
+	return active_conn ? bt_gatt_get_mtu(active_conn) - 3 : 0; // the notification header takes 3 bytes
+}
 // ********************[ Advertising configuration ]********************
 /* The bt_data structure type:
  * {
@@ -164,28 +359,37 @@ static const struct bt_data ad[] = {
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err) {
-		printf("Connection failed (err 0x%02x)\n", err);
+		LOG_WRN("Connection failed (err 0x%02x)", err);
 	} else {
-		printf("Connected\n");
+		LOG_INF("Connected");
 		active_conn = conn;
+		power_request(POWER_ACTIVE);
 	}
 }
 // Callback that is activated when a connection with a central device is taken down
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	printk("Disconnected (reason 0x%02x)\n", reason);
+	LOG_INF("Disconnected (reason 0x%02x)", reason);
 	active_conn = NULL;
+	power_request(POWER_IDLE);
 }
 // structure used to pass connection callback handlers to the BLE stack
 static struct bt_conn_cb conn_callbacks = {
 	.connected = connected,
 	.disconnected = disconnected,
 };
+// Advertising used while no central is connected. Connectable advertising resumes at the fast
+// interval after a disconnect so it is restarted with this once the device goes idle.
+// BT_GAP_ADV_SLOW_INT_MIN/MAX set the interval to between 1 and 1.2s
+#define BT_LE_ADV_CONN_NAME_SLOW BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | \
+					BT_LE_ADV_OPT_USE_NAME, \
+					BT_GAP_ADV_SLOW_INT_MIN, \
+					BT_GAP_ADV_SLOW_INT_MAX, NULL)
 // This is called when the BLE stack has finished initializing
 static void bt_ready(void)
 {
 	int err;
-	printf("Bluetooth initialized\n");
+	LOG_INF("Bluetooth initialized");
 
 // start advertising see https://developer.nordicsemi.com/nRF_Connect_SDK/doc/latest/zephyr/reference/bluetooth/gap.html
 /*
@@ -199,13 +403,13 @@ static void bt_ready(void)
  Also see : zephyr/include/bluetooth/gap.h for BT_GAP_ADV.... These set the advertising interval to between 100 and 150ms
  
  */
-// Start BLE advertising using the ad array defined above
-	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME, ad, ARRAY_SIZE(ad), NULL, 0);
+// Start BLE advertising using the ad array defined above, slow since the device boots idle
+	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME_SLOW, ad, ARRAY_SIZE(ad), NULL, 0);
 	if (err) {
-		printf("Advertising failed to start (err %d)\n", err);
+		LOG_ERR("Advertising failed to start (err %d)", err);
 		return;
 	}
-	printf("Advertising successfully started\n");
+	LOG_INF("Advertising successfully started");
 }
 
 //renderer thread consts
@@ -232,42 +436,21 @@ void display_timeout(struct k_timer *timer_id){
 //defining display timer
 K_TIMER_DEFINE(display_timer, display_timeout, NULL);
 
-void set_digit(){
-	//set led display digit
-	switch (co2_threshold)
-	{
-		case 700:
-			rows[0] = 0b11111;
-			rows[1] = 0b00001;
-			rows[2] = 0b00001;
-			break;
-		case 800:
-			rows[0] = 0b11111;
-			rows[1] = 0b10101;
-			rows[2] = 0b11111;
-			break;
-		case 600:
-			rows[0] = 0b11101;
-			rows[1] = 0b10101;
-			rows[2] = 0b11111;
-			break;
-		case 900:
-			rows[0] = 0b11111;
-			rows[1] = 0b10101;
-			rows[2] = 0b10111;
-			break;
-		case 500:
-			rows[0] = 0b11101;
-			rows[1] = 0b10101;
-			rows[2] = 0b10111;	
-			break;
-		default:
-			break;
-	}	
+//a threshold button press, handed from the button ISR to the alarm job which owns the threshold
+struct threshold_press {
+	int16_t step;		//+/-CO2_THRESHOLD_STEP_PPM
+	bool display_on;	//the first press only shows the threshold
+};
+K_MSGQ_DEFINE(press_msgq, sizeof(struct threshold_press), 4, 2);
+
+void threshold_pressed(int step){
+	struct threshold_press press = { .step = step, .display_on = display_on };
+	//a press that doesn't fit is dropped, the display still comes on
+	k_msgq_put(&press_msgq, &press, K_NO_WAIT);
 	//set display flag to 1 -> prevents all leds from lighting on co2 passing threshold
 	display_on = 1;
-	//wake up thread from sleep
-	k_wakeup(renderer_thread);
+	//apply the press and show the threshold digit
+	sched_job_trigger(&alarm_job);
 	//start display timer, run for 5 secs, start immediately 
 	k_timer_start(&display_timer, K_SECONDS(5), K_NO_WAIT);
 }
@@ -275,32 +458,16 @@ void set_digit(){
 //b button call back
 void button_b_pressed()
 {
-	//if co2 threshold not muliple of 100, round down to nearest 100
-	if (co2_threshold%100) co2_threshold = (co2_threshold/100)*100;
-	//if co2 threshold over 900 set back to max of 900
-	if (co2_threshold > 900) co2_threshold = 900;
-	//if co2 threshold < 900, inc by 100
-	if (display_on && co2_threshold < 900){
-		co2_threshold+=100;
-	}
-	printf("CO2 threshold: %d\n", co2_threshold);
-	set_digit();
+	//the first press shows the threshold, the next ones raise it by 100 up to 900
+	threshold_pressed(CO2_THRESHOLD_STEP_PPM);
 	return;
 }
 
 //a button callback
 void button_a_pressed()
 {
-	//if co2 threshold not muliple of 100, round down to nearest 100
-	if (co2_threshold%100) co2_threshold = (co2_threshold/100)*100;
-	//if co2 threshold under 500 set back to min of 500
-	if (co2_threshold < 500) co2_threshold = 500;
-	//if co2 threshold > 500, dec by 100
-	if (display_on && co2_threshold > 500){
-		co2_threshold-=100;
-	}
-	printf("CO2 threshold: %d\n", co2_threshold);
-	set_digit();
+	//the first press shows the threshold, the next ones lower it by 100 down to 500
+	threshold_pressed(-CO2_THRESHOLD_STEP_PPM);
 	return;
 }
 
@@ -311,113 +478,310 @@ void renderer_function(void *p1, void *p2, void *p3){
 	err = buttons_begin();	
 	if (err < 0)
 	{
-		printf("\nError initializing buttons. Error code = %d\n",err);	
+		LOG_ERR("Error initializing buttons. Error code = %d",err);	
 		while(1);
 	}
 	err = matrix_begin();
 	if (err) {
-		printf("Error reading initialising matrix: %i\n", err);
+		LOG_ERR("Error reading initialising matrix: %i", err);
 		return;
 	}
 	//attach button a and b callbacks
 	attach_callback_to_button(button_a_pressed, BTN_A);	
 	attach_callback_to_button(button_b_pressed, BTN_B);
 
+	//turn of leds
+	matrix_all_off();
 	//run forever
 	while(1)
 	{
-		//turn of leds and sleep forever
-		matrix_all_off();
+		//sleep until a button press wakes the thread
 		k_sleep(K_FOREVER);
 
 		//after waking while display on = 1 
 		while(display_on){
 			//display digits
 			for (int i = 0; i < 3; i++){
-				matrix_put_pattern(rows[i], ~cols[i]);
+				DIAG_TIME(&diag_timers[T_MATRIX], matrix_put_pattern(rows[i], ~cols[i]));
 				k_msleep(5);
 			}
 		}
+		//display timed out, clear the digit and have the alarm job put the alarm pattern back
+		matrix_all_off();
+		sched_job_trigger(&alarm_job);
 	}
 	return;
 }
 
+// largest batch that fits in a single notification on the current connection
+static uint16_t batch_max_len(void)
+{
+	if (!active_conn) return SAMPLE_CODEC_MAX_BATCH_LEN;
+	return bt_gatt_get_mtu(active_conn) - 3; // 3 bytes of ATT header per notification
+}
+
+//default sampler config: 2s while co2 is changing by more than 30ppm/minute, backing off to 2 minutes
+//while it is stable, only samples that moved more than 20ppm are sent
+static const struct sampler_config sampler_defaults = {
+	.min_interval_s = 2,
+	.max_interval_s = 120,
+	.slope_ppm_min = 30,
+	.deadband_ppm = 20,
+};
+//shortest scd30 interval while idle, idle sampling only has to keep the threshold alarm on the matrix going
+#define IDLE_INTERVAL_SECONDS 30
+//rough average current in each power state (uA) for the charge estimate, the scd30 dominates
+static const uint32_t power_current_ua[POWER_STATE_COUNT] = {
+	[POWER_ACTIVE] = 20000,
+	[POWER_IDLE] = 6000,
+};
+
+//sampling jobs, run on the scheduler thread
+#define SAMPLE_RETRY_MS 100 //poll period while the scd30 is finishing a measurement
+#define SAMPLE_RETRY_MAX_MS 2000 //further out of phase than this, wait for the next period instead of polling
+static uint32_t sample_wait_ms; //time spent polling for the current measurement
+static uint32_t prev_co2; //co2 value from the previous measurement
+static struct sched_job sample_job; //periodic: reads the scd30 at its measurement interval
+static struct sched_job notify_job; //event: batches, notifies and updates the alarm after each new measurement
+
+//sample job: read a measurement from the scd30
+static void sample_fn(struct sched_job *job)
+{
+	int err;
+	uint16_t data_ready = 0; //init data ready to 0 - FALSE
+	uint8_t raw[3][4]; // co2, temperature and humidity as big-endian float words
+
+	err = scd30_get_data_ready(&data_ready);
+	if (err) {
+		diag_count(&diag_counters[C_SENSOR_ERRORS]);
+		LOG_RATELIMIT(10000, LOG_ERR, "Error reading data_ready flag: %i", err);
+		return;
+	}
+	if (!data_ready) {
+		//measurement not finished yet, check again shortly and lock on to the sensor's timing
+		//the data ready flag stays set until the measurement is read, so giving up only makes it late
+		if (sample_wait_ms < SAMPLE_RETRY_MAX_MS) {
+			sample_wait_ms += SAMPLE_RETRY_MS;
+			sched_job_retry(job, SAMPLE_RETRY_MS);
+		} else {
+			sample_wait_ms = 0;
+		}
+		return;
+	}
+	sample_wait_ms = 0;
+
+	DIAG_TIME(&diag_timers[T_SCD30], err = scd30_read_measurement_raw(raw)); //read data
+	if (err) {
+		diag_count(&diag_counters[C_SENSOR_ERRORS]);
+		LOG_RATELIMIT(10000, LOG_ERR, "error reading measurement");
+		return;
+	}
+	prev_co2 = co2_value; // store previous co2 value before updating
+	//update glob co2, temp and humidity values in their fixed point encodings
+	co2_value = ess_co2_from_raw(raw[0]);
+	temp_value = ess_temperature_from_raw(raw[1]);
+	hum_value = ess_humidity_from_raw(raw[2]);
+	//log the measurement, formatted later on the logging thread
+	LOG_INF("CO2 %u ppm, temp %s%d.%02d degC, humidity %u.%02u %%RH",
+		co2_value, temp_value < 0 ? "-" : "", abs(temp_value) / 100, abs(temp_value) % 100,
+		hum_value / 100, hum_value % 100);
+	//hand the new measurement over to the notify job
+	sched_job_trigger(&notify_job);
+}
+
+//alarm bands: elevated from the threshold (700ppm until set from the buttons or over BLE), high 400ppm above it and critical 400ppm above that
+//a band is left 50ppm below where it starts and a new level has to hold for 10 seconds
+#define ALARM_THRESHOLD_PPM 700
+#define ALARM_BAND_PPM 400
+#define ALARM_HYSTERESIS_PPM 50
+#define ALARM_DWELL_S 10
+
+//pipeline ops, called on the scheduler thread from the co2_pipeline calls below
+//publish a finished batch, it is kept for reads as well
+static void send_batch(const uint8_t *buf, uint16_t len)
+{
+	memcpy(batch_value, buf, len);
+	batch_value_len = len;
+	notify_attr(BATCH_ATTR_IDX, batch_value, batch_value_len);
+}
+
+//change the scd30 measurement interval and the sample job period to match
+static void set_interval(uint16_t seconds)
+{
+	scd30_set_measurement_interval(seconds);
+	sched_job_set_period(&sample_job, seconds * 1000);
+	//the scd30 starts over at the new interval, its next measurement is ready one interval from now
+	sched_job_restart(&sample_job);
+}
+
+static void alarm_changed(enum co2_level level, uint32_t co2_ppm)
+{
+	LOG_WRN("CO2 alarm %s", co2_level_name(level));
+	notify_attr(CO2_ATTR_IDX, &co2_value, sizeof(co2_value));
+	if (level == CO2_LEVEL_NORMAL && !display_on) matrix_all_off();
+}
+
+static const struct co2_pipeline_ops co2_pipe_ops = {
+	.send_batch = send_batch,
+	.batch_max_len = batch_max_len,
+	.set_interval = set_interval,
+	.alarm_changed = alarm_changed,
+};
+
+//run the alarm state machine on the latest measurement, the matrix and the notification are done in alarm_changed
+static void update_alarm(void)
+{
+	co2_pipeline_alarm(&co2_pipe, co2_value, k_uptime_get());
+	//the renderer clears the matrix after showing the threshold, so put the alarm pattern back every time
+	if (co2_pipe.alarm.level != CO2_LEVEL_NORMAL && !display_on) {
+		DIAG_TIME(&diag_timers[T_MATRIX], matrix_put_pattern(co2_alarm_rows[co2_pipe.alarm.level], 0b00000));
+	}
+}
+
+//notify job: batch the new measurement if it changed enough, adapt the interval and act on the co2 threshold
+static void notify_fn(struct sched_job *job)
+{
+	struct sample s = { .co2_ppm = co2_value, .temp_centi = temp_value, .hum_centi = hum_value };
+	co2_pipeline_sample(&co2_pipe, &s, k_uptime_get());
+	update_alarm();
+	//log prev co2 val, current co2 val, threshold
+	LOG_DBG("CO2 prev %u, current %u, threshold %d, alarm %s, next in %us",
+		prev_co2, co2_value, co2_pipe.alarm.cfg.threshold_ppm, co2_level_name(co2_pipe.alarm.level), co2_pipe.interval_s);
+}
+
+//alarm job: apply threshold button presses, show the threshold and re-evaluate the alarm against the latest measurement
+//also run when the threshold display times out, update_alarm() redraws the alarm pattern
+static void alarm_fn(struct sched_job *job)
+{
+	struct threshold_press press;
+	bool pressed = false;
+	while (!k_msgq_get(&press_msgq, &press, K_NO_WAIT)) {
+		int threshold = co2_threshold_step(co2_pipe.alarm.cfg.threshold_ppm, press.step, press.display_on);
+		pressed = true;
+		if (threshold == co2_pipe.alarm.cfg.threshold_ppm) continue;
+		if (co2_pipeline_set_threshold(&co2_pipe, threshold)) {
+			//the hysteresis set over BLE is too big for this threshold, keep the old one
+			LOG_WRN("CO2 threshold %d rejected, hysteresis is %uppm", threshold, co2_pipe.alarm.cfg.hysteresis_ppm);
+			continue;
+		}
+		LOG_INF("CO2 threshold: %u", co2_pipe.alarm.cfg.threshold_ppm);
+	}
+	if (pressed) {
+		//set led display digit to the threshold in use, see co2_threshold_digit() for the patterns
+		co2_threshold_digit(co2_pipe.alarm.cfg.threshold_ppm, rows);
+		//wake up thread from sleep
+		k_wakeup(renderer_thread);
+	}
+	update_alarm();
+}
+
+//bench hooks, called from the shell thread: the benchmarks drive the scd30 and the matrix directly
+void bench_pause(void)
+{
+	sched_job_stop(&sample_job);
+	k_thread_suspend(renderer_thread);
+}
+
+void bench_resume(void)
+{
+	k_thread_resume(renderer_thread);
+	sched_job_trigger(&alarm_job); //put the alarm pattern back on the matrix
+	sched_job_start(&sample_job);
+}
+
+//config job: apply sampler configs written over BLE
+static void config_fn(struct sched_job *job)
+{
+	struct config_update update;
+	while (!k_msgq_get(&config_msgq, &update, K_NO_WAIT)) {
+		struct sampler_config sampler_cfg = co2_pipe.sampler.cfg;
+		struct co2_alarm_config alarm_cfg = co2_pipe.alarm.cfg;
+		if (CONFIG_HAS(&update, CONFIG_TAG_THRESHOLD)) alarm_cfg.threshold_ppm = update.value[CONFIG_TAG_THRESHOLD];
+		if (CONFIG_HAS(&update, CONFIG_TAG_HYSTERESIS)) alarm_cfg.hysteresis_ppm = update.value[CONFIG_TAG_HYSTERESIS];
+		if (CONFIG_HAS(&update, CONFIG_TAG_MIN_INTERVAL)) sampler_cfg.min_interval_s = update.value[CONFIG_TAG_MIN_INTERVAL];
+		if (CONFIG_HAS(&update, CONFIG_TAG_MAX_INTERVAL)) sampler_cfg.max_interval_s = update.value[CONFIG_TAG_MAX_INTERVAL];
+		if (CONFIG_HAS(&update, CONFIG_TAG_SLOPE)) sampler_cfg.slope_ppm_min = update.value[CONFIG_TAG_SLOPE];
+		if (CONFIG_HAS(&update, CONFIG_TAG_DEADBAND)) sampler_cfg.deadband_ppm = update.value[CONFIG_TAG_DEADBAND];
+		//checked in write_config, these only fail if another write or a button press got in between
+		if (co2_alarm_set_config(&co2_pipe.alarm, &alarm_cfg) || sampler_set_config(&co2_pipe.sampler, &sampler_cfg)) {
+			LOG_WRN("Config rejected");
+			continue;
+		}
+		if (CONFIG_HAS(&update, CONFIG_TAG_CALIBRATION)) {
+			LOG_INF("Forced recalibration to %uppm", update.value[CONFIG_TAG_CALIBRATION]);
+			if (scd30_set_forced_recalibration(update.value[CONFIG_TAG_CALIBRATION])) LOG_ERR("Error setting forced recalibration");
+		}
+		LOG_INF("Config: threshold %uppm, hysteresis %uppm, interval %u-%us, slope %uppm/min, dead-band %uppm",
+			alarm_cfg.threshold_ppm, alarm_cfg.hysteresis_ppm, sampler_cfg.min_interval_s, sampler_cfg.max_interval_s,
+			sampler_cfg.slope_ppm_min, sampler_cfg.deadband_ppm);
+	}
+	update_alarm();
+	co2_pipeline_set_interval(&co2_pipe, co2_pipe.sampler.interval_s, k_uptime_get());
+}
+
+//power state changes, run on the scheduler thread
+static void power_changed(enum power_state state)
+{
+	int err;
+	if (state == POWER_ACTIVE) {
+		co2_pipeline_set_floor(&co2_pipe, 0, k_uptime_get());
+		return;
+	}
+	co2_pipeline_set_floor(&co2_pipe, IDLE_INTERVAL_SECONDS, k_uptime_get());
+	//the stack resumed advertising at the fast interval after the disconnect, slow it down
+	bt_le_adv_stop();
+	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME_SLOW, ad, ARRAY_SIZE(ad), NULL, 0);
+	if (err) LOG_ERR("Slow advertising failed to start (err %d)", err);
+}
+
 void main(void)
 {
 	//defining main func vars
 	int err=0;	
-    uint16_t interval_in_seconds = 2;
-    float co2_ppm, temperature, relative_humidity, prev_co2;
-    co2_ppm = 0.0;
-    temperature = 0.0; 
-    relative_humidity = 0.0;
+	//sampler and alarm state, the device boots idle
+	co2_pipeline_init(&co2_pipe, &co2_pipe_ops, &sampler_defaults, IDLE_INTERVAL_SECONDS, &(struct co2_alarm_config){
+		.threshold_ppm = ALARM_THRESHOLD_PPM,
+		.band_ppm = ALARM_BAND_PPM,
+		.hysteresis_ppm = ALARM_HYSTERESIS_PPM,
+		.dwell_s = ALARM_DWELL_S,
+	});
+	//set up the jobs first, the buttons can trigger the alarm job while the sensor is still being probed
+	sched_begin();
+	diag_threads[TH_RENDERER].tid = renderer_thread;
+	diag_threads[TH_SCHED].tid = sched_thread();
+	diag_begin(diag_timers, T_COUNT, diag_counters, C_COUNT, diag_threads, TH_COUNT);
+	power_begin(power_changed, power_current_ua); //starts idle until a central connects
+	sched_job_init(&sample_job, "scd30", sample_fn, co2_pipe.interval_s * 1000);
+	sched_job_init(&notify_job, "notify", notify_fn, 0);
+	sched_job_init(&config_job, "config", config_fn, 0);
+	sched_job_init(&alarm_job, "alarm", alarm_fn, 0);
+
 	sensirion_i2c_select_bus(1);
     sensirion_i2c_init();
     /* Busy loop for initialization, because the main loop does not work without
      * a sensor.
      */
     while (scd30_probe() != NO_ERROR) {
-        printf("SCD30 sensor probing failed\n");
+        LOG_ERR("SCD30 sensor probing failed");
         sensirion_sleep_usec(1000000u);
     }
-    printf("SCD30 sensor probing successful\n");
+    LOG_INF("SCD30 sensor probing successful");
 	//init sdc30 
-    scd30_set_measurement_interval(interval_in_seconds);
+    scd30_set_measurement_interval(co2_pipe.interval_s);
     sensirion_sleep_usec(20000u);
     scd30_start_periodic_measurement(0);
 
 	//init bluetooth
 	err = bt_enable(NULL);
 	if (err) {
-		printk("Bluetooth init failed (err %d)\n", err);
-		return;
-	}
-	bt_ready(); // This function starts advertising
-	bt_conn_cb_register(&conn_callbacks); //sets connection call backs
-	printf("Zephyr Microbit CO2 sensor %s\n", CONFIG_BOARD);		
-		
-	while (1) {
-		
-		k_sleep(K_SECONDS(1)); //sleep main thread for 1 sec
-        uint16_t data_ready = 0; //init data ready to 0 - FALSE
-		err = scd30_get_data_ready(&data_ready);
-        if (err) {
-			printf("Error reading data_ready flag: %i\n", err);
-        }
-
-        if (data_ready)
-        {
-            prev_co2 = co2_ppm; // store previous co2 value before updating
-            err = scd30_read_measurement(&co2_ppm, &temperature, &relative_humidity); //read data
-            if (err) {
-                printf("error reading measurement\n");
-
-            } else {
-				//if no error display data on serial monitor
-                printf("CO2(ppm)| temp(degC)\t| humidity(%%RH)\n"
-                   "%0.2f\t| %0.2f\t\t| %0.2f\n\n",
-                   co2_ppm, temperature, relative_humidity);
-            }
-			//update glob co2, temp and humidity values 
-            co2_value = co2_ppm;
-            temp_value = temperature;
-            hum_value = relative_humidity;
-			//print prev co2 val, current co2 val, threshold
-			printf("Measured CO2 (ppm)\nprev\t| current\t| threshold\n"
-				"%0.2f\t| %0.2f\t| %d\n"
-				"===================================\n", 
-				prev_co2, co2_ppm, co2_threshold);
-			// if the co2 level reaches the threshold
-			if (co2_value >= co2_threshold){
-				if (active_conn) bt_gatt_notify(active_conn,&my_service_svc.attrs[2], &co2_value, sizeof(co2_value));
-				if (!display_on) matrix_put_pattern(0b11111, 0b00000);
-			} 
-			// if co2 level returns to normal for after exceeding notify
-			else if (co2_ppm < co2_threshold && prev_co2 >= co2_threshold && !display_on){
-				// on dropping below threshold disable matrix
-				matrix_all_off();
-			}
-			
-        }
+		//carry on without BLE, the display and the alarm still work (native_posix has no radio)
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+	} else {
+		bt_ready(); // This function starts advertising
+		bt_conn_cb_register(&conn_callbacks); //sets connection call backs
 	}
+	LOG_INF("Zephyr Microbit CO2 sensor %s", CONFIG_BOARD);		
+
+	//start sampling, main has nothing left to do after this and returns
+	sched_job_start(&sample_job);
 }
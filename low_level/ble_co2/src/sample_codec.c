@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "sample_codec.h"
+
+// map signed values onto unsigned so small negative deltas stay small: 0,-1,1,-2,2 -> 0,1,2,3,4
+static uint32_t zigzag_encode(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+static int32_t zigzag_decode(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+// number of bytes needed to hold value as a varint (7 data bits per byte)
+static uint8_t uvarint_len(uint32_t value)
+{
+	uint8_t len = 1;
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		len++;
+	}
+	return len;
+}
+static uint16_t put_uvarint(uint8_t *buf, uint32_t value)
+{
+	uint16_t i = 0;
+	while (value >= 0x80)
+	{
+		buf[i++] = (uint8_t)(value | 0x80); // low 7 bits with the continuation flag set
+		value >>= 7;
+	}
+	buf[i++] = (uint8_t)value;
+	return i;
+}
+// returns the number of bytes consumed or 0 if the varint is truncated or too long
+static size_t get_uvarint(const uint8_t *buf, size_t len, uint32_t *value)
+{
+	uint32_t result = 0;
+	size_t i;
+	for (i = 0; i < len && i < 5; i++)
+	{
+		result |= (uint32_t)(buf[i] & 0x7f) << (7 * i);
+		if (!(buf[i] & 0x80))
+		{
+			*value = result;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+void sample_batch_reset(struct sample_batch *batch, uint16_t max_len)
+{
+	sample_batch_set_max_len(batch, max_len);
+	batch->count = 0;
+	batch->buf[0] = SAMPLE_CODEC_VERSION;
+	batch->buf[1] = 0;
+	batch->buf[2] = 0;
+	batch->buf[3] = 0;
+	batch->len = SAMPLE_CODEC_HEADER_LEN;
+}
+
+// Changes the flush threshold, e.g. when the MTU changes. A batch already longer than the new
+// threshold stays as it is, the caller checks len against it
+void sample_batch_set_max_len(struct sample_batch *batch, uint16_t max_len)
+{
+	if (max_len > SAMPLE_CODEC_MAX_BATCH_LEN) max_len = SAMPLE_CODEC_MAX_BATCH_LEN;
+	batch->max_len = max_len;
+}
+
+// Appends a sample taken gap_sec after the previous one (ignored for the first sample).
+// Returns 0 on success or -ENOSPC if the caller must send and reset the batch first. An empty
+// batch always takes the sample, the first sample fits in even the smallest notification
+// (20 bytes at the default ATT MTU of 23)
+int sample_batch_add(struct sample_batch *batch, const struct sample *s, uint32_t gap_sec)
+{
+	uint32_t co2, temp, hum;
+	uint16_t len;
+	if (batch->count == 0)
+	{
+		co2 = s->co2_ppm;
+		temp = zigzag_encode(s->temp_centi);
+		hum = s->hum_centi;
+		len = 0;
+	}
+	else
+	{
+		co2 = zigzag_encode((int32_t)(s->co2_ppm - batch->prev.co2_ppm));
+		temp = zigzag_encode(s->temp_centi - batch->prev.temp_centi);
+		hum = zigzag_encode((int32_t)(s->hum_centi - batch->prev.hum_centi));
+		len = uvarint_len(gap_sec);
+	}
+	len += uvarint_len(co2) + uvarint_len(temp) + uvarint_len(hum);
+	if (batch->count == UINT8_MAX || (batch->count && batch->len + len > batch->max_len)) return -ENOSPC;
+	if (batch->count) batch->len += put_uvarint(&batch->buf[batch->len], gap_sec);
+	batch->len += put_uvarint(&batch->buf[batch->len], co2);
+	batch->len += put_uvarint(&batch->buf[batch->len], temp);
+	batch->len += put_uvarint(&batch->buf[batch->len], hum);
+	batch->prev = *s;
+	batch->count++;
+	batch->buf[1] = batch->count;
+	return 0;
+}
+
+// Records how long ago the last sample was taken, set just before the batch is sent
+void sample_batch_set_age(struct sample_batch *batch, uint16_t age_sec)
+{
+	batch->buf[2] = (uint8_t)age_sec;
+	batch->buf[3] = (uint8_t)(age_sec >> 8);
+}
+
+// Decodes up to max_samples samples, with the seconds between each sample and the one before it
+// in gap_sec (0 for the first) if that isn't NULL. Returns the number decoded or -EINVAL on a malformed buffer
+int sample_batch_decode(const uint8_t *buf, size_t len, uint16_t *age_sec, struct sample *out, uint32_t *gap_sec, size_t max_samples)
+{
+	size_t pos = SAMPLE_CODEC_HEADER_LEN, used;
+	uint32_t fields[4];
+	struct sample prev = {0};
+	uint8_t count, i, f;
+
+	if (len < SAMPLE_CODEC_HEADER_LEN || buf[0] != SAMPLE_CODEC_VERSION) return -EINVAL;
+	count = buf[1];
+	if (age_sec) *age_sec = buf[2] | (uint16_t)buf[3] << 8;
+
+	for (i = 0; i < count && i < max_samples; i++)
+	{
+		// the first sample has no time, fields[0] is the gap for the rest
+		fields[0] = 0;
+		for (f = i ? 0 : 1; f < 4; f++)
+		{
+			used = get_uvarint(&buf[pos], len - pos, &fields[f]);
+			if (!used) return -EINVAL;
+			pos += used;
+		}
+		if (gap_sec) gap_sec[i] = fields[0];
+		if (i == 0)
+		{
+			out[i].co2_ppm = fields[1];
+			out[i].temp_centi = zigzag_decode(fields[2]);
+			out[i].hum_centi = fields[3];
+		}
+		else
+		{
+			out[i].co2_ppm = prev.co2_ppm + (uint32_t)zigzag_decode(fields[1]);
+			out[i].temp_centi = prev.temp_centi + zigzag_decode(fields[2]);
+			out[i].hum_centi = prev.hum_centi + (uint32_t)zigzag_decode(fields[3]);
+		}
+		prev = out[i];
+	}
+	return i;
+}
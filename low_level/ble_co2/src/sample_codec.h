@@ -0,0 +1,45 @@
+#ifndef __SAMPLE_CODEC_H
+#define __SAMPLE_CODEC_H
+#include <stdint.h>
+#include <stddef.h>
+/*
+ * Compact binary encoding for batches of CO2/temperature/humidity samples.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * Wire format (all multi-byte integers are LEB128 style varints):
+ * byte 0      : format version
+ * byte 1      : number of samples in the batch
+ * bytes 2-3   : little endian age of the last sample in seconds when the batch was sent
+ * first sample: uvarint co2 (ppm), zigzag varint temperature (0.01 degC), uvarint humidity (0.01 %RH)
+ * each further sample: uvarint seconds since the previous sample, then zigzag varint deltas of
+ *               co2, temperature and humidity from the previous sample
+ * The receiver rebuilds the timestamps backwards from the age of the last sample, so a batch can
+ * stay open across interval changes and measurements that were not worth sending.
+ */
+#define SAMPLE_CODEC_VERSION 3
+#define SAMPLE_CODEC_HEADER_LEN 4
+// largest possible encoding of one sample (the time and 3 fields, 5 bytes per 32 bit varint)
+#define SAMPLE_CODEC_MAX_SAMPLE_LEN 20
+// largest batch buffer, sized for an ATT MTU of 247 (244 bytes of notification payload)
+#define SAMPLE_CODEC_MAX_BATCH_LEN 244
+
+struct sample {
+	uint32_t co2_ppm;	// CO2 concentration in ppm
+	int32_t temp_centi;	// temperature in 0.01 degC
+	uint32_t hum_centi;	// relative humidity in 0.01 %RH
+};
+
+struct sample_batch {
+	uint8_t buf[SAMPLE_CODEC_MAX_BATCH_LEN];
+	uint16_t len;		// number of bytes used in buf
+	uint16_t max_len;	// flush threshold, normally the notification payload size
+	uint8_t count;		// number of samples in buf
+	struct sample prev;	// last sample added, deltas are taken from this
+};
+
+void sample_batch_reset(struct sample_batch *batch, uint16_t max_len);
+void sample_batch_set_max_len(struct sample_batch *batch, uint16_t max_len);
+int sample_batch_add(struct sample_batch *batch, const struct sample *s, uint32_t gap_sec);
+void sample_batch_set_age(struct sample_batch *batch, uint16_t age_sec);
+int sample_batch_decode(const uint8_t *buf, size_t len, uint16_t *age_sec, struct sample *out, uint32_t *gap_sec, size_t max_samples);
+#endif
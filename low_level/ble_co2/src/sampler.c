@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "sampler.h"
+
+static uint32_t abs_diff(uint32_t a, uint32_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+static uint32_t temp_diff(int32_t a, int32_t b)
+{
+	return a > b ? (uint32_t)(a - b) : (uint32_t)(b - a);
+}
+
+// keep the interval inside the configured range and at or above the app's floor
+static void sampler_clamp(struct sampler *s)
+{
+	uint16_t lo = s->cfg.min_interval_s, hi = s->cfg.max_interval_s;
+	if (s->floor_s > lo) lo = s->floor_s;
+	if (lo > hi) hi = lo;
+	if (s->interval_s < lo) s->interval_s = lo;
+	if (s->interval_s > hi) s->interval_s = hi;
+}
+
+void sampler_init(struct sampler *s, const struct sampler_config *cfg)
+{
+	s->cfg = *cfg;
+	s->floor_s = 0;
+	s->interval_s = cfg->min_interval_s;
+	s->have_prev = false;
+	s->have_emitted = false;
+	sampler_clamp(s);
+}
+
+bool sampler_config_valid(const struct sampler_config *cfg)
+{
+	return cfg->min_interval_s >= SAMPLER_MIN_INTERVAL_S && cfg->max_interval_s <= SAMPLER_MAX_INTERVAL_S &&
+	       cfg->min_interval_s <= cfg->max_interval_s && cfg->slope_ppm_min > 0;
+}
+
+// Returns 0 or -EINVAL if the config is out of range, the current interval is kept inside the new range
+int sampler_set_config(struct sampler *s, const struct sampler_config *cfg)
+{
+	if (!sampler_config_valid(cfg)) return -EINVAL;
+	s->cfg = *cfg;
+	sampler_clamp(s);
+	return 0;
+}
+
+void sampler_set_floor(struct sampler *s, uint16_t floor_s)
+{
+	s->floor_s = floor_s;
+	sampler_clamp(s);
+}
+
+// Feed a new measurement taken at now_s. Updates s->interval_s and returns true if the sample should be emitted
+bool sampler_update(struct sampler *s, const struct sample *sample, uint32_t now_s)
+{
+	bool emit;
+	if (s->have_prev)
+	{
+		// ppm per minute over the last interval
+		uint32_t slope = abs_diff(sample->co2_ppm, s->prev_co2) * 60 / s->interval_s;
+		if (slope > s->cfg.slope_ppm_min) s->interval_s = s->cfg.min_interval_s;
+		else if (slope <= s->cfg.slope_ppm_min / 2) s->interval_s = s->interval_s < s->cfg.max_interval_s / 2 ? s->interval_s * 2 : s->cfg.max_interval_s;
+		// in between: keep the interval, avoids see-sawing around the slope limit
+		sampler_clamp(s);
+	}
+	s->prev_co2 = sample->co2_ppm;
+	s->have_prev = true;
+
+	emit = !s->have_emitted ||
+	       abs_diff(sample->co2_ppm, s->emitted.co2_ppm) > s->cfg.deadband_ppm ||
+	       temp_diff(sample->temp_centi, s->emitted.temp_centi) > SAMPLER_TEMP_DEADBAND ||
+	       abs_diff(sample->hum_centi, s->emitted.hum_centi) > SAMPLER_HUM_DEADBAND ||
+	       now_s - s->emitted_s >= SAMPLER_HEARTBEAT_S;
+	if (emit)
+	{
+		s->emitted = *sample;
+		s->emitted_s = now_s;
+		s->have_emitted = true;
+	}
+	return emit;
+}
@@ -0,0 +1,45 @@
+#ifndef __SAMPLER_H
+#define __SAMPLER_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sample_codec.h"
+/*
+ * Adaptive measurement interval and dead-band filter for the CO2 samples.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * While CO2 is stable the interval doubles on every sample up to max_interval_s,
+ * as soon as the slope goes over slope_ppm_min it drops back to min_interval_s.
+ * A sample is only emitted when it has moved more than the dead-band from the last
+ * emitted one, or when nothing has been emitted for SAMPLER_HEARTBEAT_S.
+ */
+#define SAMPLER_HEARTBEAT_S 600		// emit at least every 10 minutes so the central knows we are alive
+#define SAMPLER_TEMP_DEADBAND 50	// 0.5 degC
+#define SAMPLER_HUM_DEADBAND 200	// 2 %RH
+#define SAMPLER_MIN_INTERVAL_S 2	// scd30 limits
+#define SAMPLER_MAX_INTERVAL_S 1800
+
+// packed so it can be read and written as is over GATT
+struct sampler_config {
+	uint16_t min_interval_s;	// interval while CO2 is changing
+	uint16_t max_interval_s;	// longest interval while CO2 is stable
+	uint16_t slope_ppm_min;		// rate of change (ppm/minute) that counts as changing
+	uint16_t deadband_ppm;		// CO2 change needed to emit a sample
+} __attribute__((packed));
+
+struct sampler {
+	struct sampler_config cfg;
+	uint16_t floor_s;		// lower bound on the interval set by the app, e.g. while idle
+	uint16_t interval_s;		// interval to use for the next measurement
+	bool have_prev;
+	uint32_t prev_co2;		// previous measurement, for the slope
+	bool have_emitted;
+	struct sample emitted;		// last emitted sample, for the dead-band
+	uint32_t emitted_s;		// time of the last emitted sample
+};
+
+void sampler_init(struct sampler *s, const struct sampler_config *cfg);
+bool sampler_config_valid(const struct sampler_config *cfg);
+int sampler_set_config(struct sampler *s, const struct sampler_config *cfg);
+void sampler_set_floor(struct sampler *s, uint16_t floor_s);
+bool sampler_update(struct sampler *s, const struct sample *sample, uint32_t now_s);
+#endif
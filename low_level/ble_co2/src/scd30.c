@@ -53,6 +53,8 @@ static const uint8_t SCD30_I2C_ADDRESS = 0x61;
 #define SCD30_CMD_READ_SERIAL 0xD033
 #define SCD30_SERIAL_NUM_WORDS 16
 #define SCD30_WRITE_DELAY_US 20000
+/* the datasheet asks for 3ms between a command and reading its response */
+#define SCD30_READ_DELAY_US 3000
 
 #define SCD30_MAX_BUFFER_WORDS 24
 #define SCD30_CMD_SINGLE_WORD_BUF_LEN \
@@ -85,6 +87,7 @@ int16_t scd30_read_measurement(float* co2_ppm, float* temperature,
     if (error != NO_ERROR)
         return error;
 
+    sensirion_sleep_usec(SCD30_READ_DELAY_US);
     error = sensirion_i2c_read_words_as_bytes(SCD30_I2C_ADDRESS, &data[0][0],
                                               SENSIRION_NUM_WORDS(data));
     if (error != NO_ERROR)
@@ -97,6 +100,19 @@ int16_t scd30_read_measurement(float* co2_ppm, float* temperature,
     return NO_ERROR;
 }
 
+int16_t scd30_read_measurement_raw(uint8_t data[3][4]) {
+    int16_t error;
+
+    error =
+        sensirion_i2c_write_cmd(SCD30_I2C_ADDRESS, SCD30_CMD_READ_MEASUREMENT);
+    if (error != NO_ERROR)
+        return error;
+
+    sensirion_sleep_usec(SCD30_READ_DELAY_US);
+    return sensirion_i2c_read_words_as_bytes(SCD30_I2C_ADDRESS, &data[0][0],
+                                             3 * SENSIRION_NUM_WORDS(data[0]));
+}
+
 int16_t scd30_set_measurement_interval(uint16_t interval_sec) {
     int16_t error;
 
@@ -115,7 +131,7 @@ int16_t scd30_set_measurement_interval(uint16_t interval_sec) {
 
 int16_t scd30_get_data_ready(uint16_t* data_ready) {
     return sensirion_i2c_delayed_read_cmd(
-        SCD30_I2C_ADDRESS, SCD30_CMD_GET_DATA_READY, 3000, data_ready,
+        SCD30_I2C_ADDRESS, SCD30_CMD_GET_DATA_READY, SCD30_READ_DELAY_US, data_ready,
         SENSIRION_NUM_WORDS(*data_ready));
 }
 
@@ -145,9 +161,10 @@ int16_t scd30_get_automatic_self_calibration(uint8_t* asc_enabled) {
     uint16_t word;
     int16_t error;
 
-    error = sensirion_i2c_read_cmd(SCD30_I2C_ADDRESS,
-                                   SCD30_CMD_AUTO_SELF_CALIBRATION, &word,
-                                   SENSIRION_NUM_WORDS(word));
+    error = sensirion_i2c_delayed_read_cmd(SCD30_I2C_ADDRESS,
+                                           SCD30_CMD_AUTO_SELF_CALIBRATION,
+                                           SCD30_READ_DELAY_US, &word,
+                                           SENSIRION_NUM_WORDS(word));
     if (error != NO_ERROR)
         return error;
 
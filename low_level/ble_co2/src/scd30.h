@@ -107,6 +107,17 @@ int16_t scd30_stop_periodic_measurement(void);
 int16_t scd30_read_measurement(float* co2_ppm, float* temperature,
                                float* humidity);
 
+/**
+ * scd30_read_measurement_raw() - Read out an available measurement without
+ * converting it to float.
+ * Same as scd30_read_measurement() but returns the CRC-checked big-endian
+ * IEEE754 words as received, so callers can convert them with integer math.
+ * @param data  data[0] CO2 concentration, data[1] temperature and data[2]
+ *              relative humidity, each as 4 big-endian bytes
+ * @return      0 if the command was successful, an error code otherwise
+ */
+int16_t scd30_read_measurement_raw(uint8_t data[3][4]);
+
 /**
  * scd30_set_measurement_interval() - Sets the measurement interval in
  * continuous measurement mode.
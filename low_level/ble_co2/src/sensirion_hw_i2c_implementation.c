@@ -36,9 +36,13 @@
 #include "sensirion_arch_config.h"
 #include "sensirion_common.h"
 #include "sensirion_i2c.h"
+#include "i2c_bus.h"
 
-/* I2C device. */
-static struct device* i2c_dev;
+/* The bus is shared with the other drivers through i2c_bus.h. Sensirion parts
+ * run in standard mode: the SCD30 stretches the clock while it prepares a
+ * response and is only specified up to 100kHz. */
+#define SENSIRION_I2C_SPEED I2C_SPEED_STANDARD
+static bool i2c_selected;
 
 /**
  * Select the current i2c bus by index.
@@ -49,19 +53,17 @@ static struct device* i2c_dev;
  */
 int16_t sensirion_i2c_select_bus(uint8_t bus_idx) {
 	
-    char bus_name[6] = "I2C_1";
 	printf("Entering sensirion_i2c_select_bus\n");
-    if (bus_idx > 9) {
-        /* Invalid bus index */
+    if (bus_idx != 1) {
+        /* Only I2C_1 is shared through i2c_bus.h */
         return STATUS_FAIL;
     }
 
-    bus_name[4] = bus_idx + '0';
-    i2c_dev = device_get_binding(bus_name);
-    if (i2c_dev == NULL) {
+    if (i2c_bus_begin() < 0) {
         /* No valid device found */
         return STATUS_FAIL;
     }
+    i2c_selected = true;
 
     return STATUS_OK;
 }
@@ -79,7 +81,7 @@ void sensirion_i2c_init(void) {
  * Release all resources initialized by sensirion_i2c_init().
  */
 void sensirion_i2c_release(void) {
-    i2c_dev = NULL;
+    i2c_selected = false;
 }
 
 /**
@@ -93,7 +95,12 @@ void sensirion_i2c_release(void) {
  * @returns 0 on success, error code otherwise
  */
 int8_t sensirion_i2c_read(uint8_t address, uint8_t* data, uint16_t count) {
-    return i2c_read(i2c_dev, data, count, address);
+    const struct i2c_bus_dev dev = I2C_BUS_DEV(address, SENSIRION_I2C_SPEED);
+
+    if (!i2c_selected) {
+        return STATUS_FAIL;
+    }
+    return i2c_bus_read(&dev, data, count);
 }
 
 /**
@@ -109,7 +116,12 @@ int8_t sensirion_i2c_read(uint8_t address, uint8_t* data, uint16_t count) {
  */
 int8_t sensirion_i2c_write(uint8_t address, const uint8_t* data,
                            uint16_t count) {
-    return i2c_write(i2c_dev, data, count, address);
+    const struct i2c_bus_dev dev = I2C_BUS_DEV(address, SENSIRION_I2C_SPEED);
+
+    if (!i2c_selected) {
+        return STATUS_FAIL;
+    }
+    return i2c_bus_write(&dev, data, count);
 }
 
 /**
@@ -10,11 +10,9 @@
 #include "matrix.h"
 #include "buttons.h"
 
-#define BTN_A 14
-#define BTN_B 23
-
-volatile uint8_t rows = 1;
-volatile uint8_t cols = 1;
+uint8_t rows = 1;
+uint8_t cols = 1;
+// the interrupts only queue the presses, the state changes on the main thread
 void button_a_pressed(void)
 {
 	cols = cols >> 1;
@@ -46,13 +44,21 @@ void main(void)
 		printf("\nError initializing buttons.  Error code = %d\n",ret);	
 		while(1);
 	}
-	attach_callback_to_button(button_b_pressed, BTN_B);	
-	attach_callback_to_button(button_a_pressed, BTN_A);
-
+	ret = buttons_events_begin();
+	if (ret < 0)
+	{
+		printf("\nError attaching the button interrupts.  Error code = %d\n",ret);	
+		while(1);
+	}
+	matrix_put_pattern(rows, ~cols);
+	// block until a press arrives and redraw only when the pattern changes
 	while(1)
 	{       
-		matrix_put_pattern(rows, ~cols);
-		k_msleep(100);
-		
+		struct button_event event;
+		uint8_t old_cols = cols;
+		if (buttons_wait_event(&event, K_FOREVER)) continue;
+		if (event.button == BUTTON_A) button_a_pressed();
+		if (event.button == BUTTON_B) button_b_pressed();
+		if (cols != old_cols) matrix_put_pattern(rows, ~cols);
 	}
 }
@@ -6,8 +6,10 @@
  * 0x1801 Generic Attribute (GATT)
  * And a custom service 1-2-3-4-0 
  * This custom service contains a custom characteristic called stepcount_value
- * stepcount_value is updated on receipt of an interrupt from the LSM303 accelerometer.
+ * stepcount_value is updated by the pedometer (pedometer.h) which runs on the samples
+ * read from the LSM303 accelerometer's FIFO each time it reaches its watermark.
  * A second characateristic provides the Y axis reading from the LSM303 accelerometer
+ * and a third the cadence in steps per minute
  */
 #include <zephyr/types.h>
 #include <stddef.h>
@@ -29,18 +31,24 @@
 #include <stdio.h>
 
 #include "lsm303_ll.h"
+#include "sched.h"
+#include "pedometer.h"
 
 #define BT_UUID_CUSTOM_SERVICE_VAL BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)0)
 #define BT_UUID_STEPCOUNT_ID       BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)4)
 #define BT_UUID_Y_ACCEL_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)6)
+#define BT_UUID_CADENCE_ID  	   BT_UUID_128_ENCODE(1, 2, 3, 4, (uint64_t)7)
 static struct bt_uuid_128 my_service_uuid = BT_UUID_INIT_128( BT_UUID_CUSTOM_SERVICE_VAL);
 static struct bt_uuid_128 stepcount_id=BT_UUID_INIT_128(BT_UUID_STEPCOUNT_ID); // the 128 bit UUID for this gatt value
 static struct bt_uuid_128 y_accel_id=BT_UUID_INIT_128(BT_UUID_Y_ACCEL_ID); // the 128 bit UUID for this gatt value
+static struct bt_uuid_128 cadence_id=BT_UUID_INIT_128(BT_UUID_CADENCE_ID); // the 128 bit UUID for this gatt value
 uint32_t stepcount_value=0; // the gatt characateristic value that is being shared over BLE	
 uint32_t y_accel;
+uint16_t cadence_value; // steps per minute, 0 when not walking
 static ssize_t read_char(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 static ssize_t write_char(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
 static ssize_t read_y_accel(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
+static ssize_t read_cadence(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset);
 /* The bt_data structure type:
  * {
  * 	uint8_t type : The kind of data encoded in the following structure
@@ -75,11 +83,20 @@ BT_GATT_SERVICE_DEFINE(my_service_svc,
 		BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |  BT_GATT_CHRC_NOTIFY,
 		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
 		read_char, write_char, &stepcount_value),
+		BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 		BT_GATT_CHARACTERISTIC(&y_accel_id.uuid,		
 		BT_GATT_CHRC_READ,
 		BT_GATT_PERM_READ,
-		read_y_accel, NULL, &y_accel)
+		read_y_accel, NULL, &y_accel),
+		BT_GATT_CHARACTERISTIC(&cadence_id.uuid,		
+		BT_GATT_CHRC_READ |  BT_GATT_CHRC_NOTIFY,
+		BT_GATT_PERM_READ,
+		read_cadence, NULL, &cadence_value),
+		BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
 );
+// attribute indices of the characteristic values within my_service_svc, the CCCs follow them
+#define STEPCOUNT_ATTR_IDX 2
+#define CADENCE_ATTR_IDX 7
 
 
 struct bt_conn *active_conn=NULL; // use this to maintain a reference to the connection with the central device (if any)
@@ -110,6 +127,11 @@ static ssize_t read_y_accel(struct bt_conn *conn, const struct bt_gatt_attr *att
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(y_accel)); // pass the value back up through the BLE stack
 	return 0;
 }
+static ssize_t read_cadence(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+	const char *value = (const char *)&cadence_value;
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(cadence_value)); // pass the value back up through the BLE stack
+}
 
 
 // Callback that is activated when a connection with a central device is established
@@ -160,6 +182,62 @@ static void bt_ready(void)
 	printf("Advertising successfully started\n");
 }
 
+// sampling jobs, run on the scheduler thread
+// The accelerometer fills its FIFO at 50Hz and raises INT1 once more than FIFO_WATERMARK
+// samples are waiting, so the CPU wakes every half second instead of for every sample
+#define FIFO_WATERMARK 24
+#define FIFO_POLL_MS 1000 // in case a watermark edge is missed, the FIFO is drained at least this often
+#define STEPS_PRINT_EVERY 10
+static struct sched_job fifo_job; // periodic poll, triggered early by the watermark interrupt
+static struct sched_job notify_job; // event: sends the step count and cadence when they change
+static struct pedometer pedometer;
+
+static void fifo_fn(struct sched_job *job)
+{
+	static int samples[LSM303_FIFO_DEPTH][3];
+	uint32_t steps = pedometer.steps;
+	bool changed = false;
+	int count = lsm303_ll_readFifo(samples, LSM303_FIFO_DEPTH);
+	if (count < 0)
+	{
+		printf("Error reading the accelerometer FIFO %d\n", count);
+		return;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		changed |= pedometer_add(&pedometer, samples[i][0], samples[i][1], samples[i][2]);
+	}
+	if (count) y_accel = samples[count - 1][1];
+	if (!changed) return;
+	// steps are added on so a count written by the central carries on from there
+	stepcount_value += pedometer.steps - steps;
+	if (!cadence_value && pedometer.cadence_spm) printf("Walking, %u steps/min\n", pedometer.cadence_spm);
+	if (cadence_value && !pedometer.cadence_spm) printf("Stopped\n");
+	cadence_value = pedometer.cadence_spm;
+	if (pedometer.steps / STEPS_PRINT_EVERY != steps / STEPS_PRINT_EVERY) printf("Steps %u\n", pedometer.steps);
+	sched_job_trigger(&notify_job);
+}
+
+static void notify_fn(struct sched_job *job)
+{
+	// int bt_gatt_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *data, u16_t len)
+	// conn: Connection object. (NULL for all)
+	// attr: Characteristic Value Descriptor attribute.
+	// data: Pointer to Attribute data.
+	// len: Attribute value length.				
+	if (active_conn)
+	{
+		bt_gatt_notify(active_conn,&my_service_svc.attrs[STEPCOUNT_ATTR_IDX], &stepcount_value,sizeof(stepcount_value));
+		bt_gatt_notify(active_conn,&my_service_svc.attrs[CADENCE_ATTR_IDX], &cadence_value,sizeof(cadence_value));
+	}	
+}
+
+// FIFO watermark interrupt, defers the reading to the scheduler thread
+static void fifo_ready(void)
+{
+	sched_job_trigger(&fifo_job);
+}
+
 void main(void)
 {
 	int err;
@@ -172,30 +250,22 @@ void main(void)
 	}
 	err = bt_enable(NULL);
 	if (err) {
+		// carry on without BLE, the steps are still counted (native_posix has no radio)
 		printk("Bluetooth init failed (err %d)\n", err);
-		return;
+	} else {
+		bt_ready(); // This function starts advertising
+		bt_conn_cb_register(&conn_callbacks);
 	}
-	bt_ready(); // This function starts advertising
-	bt_conn_cb_register(&conn_callbacks);
 	printf("Zephyr Microbit V2 minimal BLE example! %s\n", CONFIG_BOARD);
-	if (lsm303_countSteps(&stepcount_value) < 0)
+	sched_begin();
+	sched_job_init(&fifo_job, "fifo", fifo_fn, FIFO_POLL_MS);
+	sched_job_init(&notify_job, "notify", notify_fn, 0);
+	pedometer_init(&pedometer, LSM303_FIFO_PERIOD_MS);
+	if (lsm303_ll_fifoBegin(FIFO_WATERMARK, fifo_ready) < 0)
 	{
-		printf("Error starting step counter\n");
+		printf("Error starting the accelerometer FIFO\n");
 		while(1);
 	}
-
-	while (1) {
-		k_msleep(100);
-		
-		y_accel = lsm303_ll_readAccelY();
-		// int bt_gatt_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *data, u16_t len)
-		// conn: Connection object. (NULL for all)
-		// attr: Characteristic Value Descriptor attribute.
-		// data: Pointer to Attribute data.
-		// len: Attribute value length.				
-		if (active_conn)
-		{
-			bt_gatt_notify(active_conn,&my_service_svc.attrs[2], &stepcount_value,sizeof(stepcount_value));			
-		}	
-	}
+	// the step count is only sent when it changes, main returns and the CPU idles between jobs
+	sched_job_start(&fifo_job);
 }
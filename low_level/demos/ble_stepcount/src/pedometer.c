@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pedometer.h"
+
+#define Q 4			// fraction bits kept through the filters
+#define HIGH_PASS_SHIFT 6	// gravity follows over ~64 samples, ~0.12Hz at 50Hz
+#define LOW_PASS_SHIFT 2	// ~2Hz at 50Hz
+#define PEAK_AVG_SHIFT 2
+
+static uint32_t isqrt32(uint32_t v)
+{
+	uint32_t root = 0, bit = 1UL << 30;
+
+	while (bit > v) bit >>= 2;
+	while (bit) {
+		if (v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+void pedometer_init(struct pedometer *p, uint16_t sample_ms)
+{
+	memset(p, 0, sizeof(*p));
+	p->sample_ms = sample_ms;
+	p->peak_avg = (2 * PEDOMETER_THRESHOLD_MIN) << Q;
+}
+
+static void walk_end(struct pedometer *p)
+{
+	p->walking = false;
+	p->pending = 0;
+	p->intervals = 0;
+	p->interval_next = 0;
+	p->cadence_spm = 0;
+	p->peak_avg = (2 * PEDOMETER_THRESHOLD_MIN) << Q;
+}
+
+// the intervals are kept from the first step, the cadence is only reported once walking
+static void cadence_update(struct pedometer *p, uint32_t interval_ms)
+{
+	uint32_t sum = 0;
+
+	p->interval_ms[p->interval_next] = interval_ms;
+	p->interval_next = (p->interval_next + 1) % PEDOMETER_CADENCE_STEPS;
+	if (p->intervals < PEDOMETER_CADENCE_STEPS) p->intervals++;
+	if (!p->walking) return;
+	for (int i = 0; i < p->intervals; i++) sum += p->interval_ms[i];
+	p->cadence_spm = (60000UL * p->intervals + sum / 2) / sum;
+}
+
+static void step(struct pedometer *p, int32_t peak)
+{
+	uint32_t interval_ms = p->now_ms - p->last_step_ms;
+	bool first = !p->pending && !p->walking;
+
+	p->last_step_ms = p->now_ms;
+	p->armed = false;
+	p->peak_avg += (peak - p->peak_avg) >> PEAK_AVG_SHIFT;
+	if (first) {
+		p->pending = 1; // no interval yet
+		return;
+	}
+	if (p->walking) {
+		cadence_update(p, interval_ms);
+		p->steps++;
+		return;
+	}
+	if (++p->pending == PEDOMETER_START_STEPS) {
+		p->walking = true;
+		p->steps += p->pending;
+		p->pending = 0;
+	}
+	cadence_update(p, interval_ms);
+}
+
+// one sample in the same units on each axis, returns true when steps or cadence changed
+bool pedometer_add(struct pedometer *p, int x, int y, int z)
+{
+	uint32_t steps = p->steps;
+	uint16_t cadence = p->cadence_spm;
+	int32_t mag = isqrt32(x * x + y * y + z * z) << Q;
+	int32_t threshold = p->peak_avg / 2;
+
+	p->now_ms += p->sample_ms;
+	// start the high-pass at the first sample rather than ramping up from 0
+	if (!p->gravity) p->gravity = mag;
+	p->gravity += (mag - p->gravity) >> HIGH_PASS_SHIFT;
+	p->filtered += ((mag - p->gravity) - p->filtered) >> LOW_PASS_SHIFT;
+
+	if (threshold < (PEDOMETER_THRESHOLD_MIN << Q)) threshold = PEDOMETER_THRESHOLD_MIN << Q;
+	if (p->filtered < 0) p->armed = true;
+	// prev[0] is a peak when it is above both of its neighbours
+	if (p->armed && p->prev[0] > threshold && p->prev[0] > p->prev[1] && p->prev[0] >= p->filtered &&
+	    p->now_ms - p->last_step_ms >= PEDOMETER_STEP_MIN_MS) {
+		step(p, p->prev[0]);
+	}
+	if ((p->walking || p->pending) && p->now_ms - p->last_step_ms > PEDOMETER_STEP_MAX_MS) walk_end(p);
+	p->prev[1] = p->prev[0];
+	p->prev[0] = p->filtered;
+	return p->steps != steps || p->cadence_spm != cadence;
+}
@@ -0,0 +1,46 @@
+#ifndef __PEDOMETER_H
+#define __PEDOMETER_H
+#include <stdint.h>
+#include <stdbool.h>
+/*
+ * Step detection from accelerometer samples at a fixed rate, all in integer arithmetic.
+ * Plain C with no Zephyr dependencies so the same file can be compiled on a host.
+ *
+ * Each sample's magnitude goes through a band-pass filter: a slow one pole high-pass takes
+ * out gravity, a faster one pole low-pass the jitter, leaving the 1-3Hz walking signal.
+ * A step is a local maximum of the filtered signal above an adaptive threshold (half the
+ * average of the recent step peaks, never below PEDOMETER_THRESHOLD_MIN) that follows
+ * a dip below zero and comes at least PEDOMETER_STEP_MIN_MS after the previous step.
+ *
+ * Single bumps are not steps: counting starts once PEDOMETER_START_STEPS steps come
+ * within PEDOMETER_STEP_MAX_MS of each other, and those are added in one go. A gap longer
+ * than PEDOMETER_STEP_MAX_MS ends the walk. The cadence is worked out from the intervals
+ * between the last PEDOMETER_CADENCE_STEPS steps and is 0 when not walking.
+ */
+#define PEDOMETER_THRESHOLD_MIN 80	// input units (cm/s^2 from lsm303_ll), about 0.08g
+#define PEDOMETER_STEP_MIN_MS 250	// faster than 4 steps a second is not walking or running
+#define PEDOMETER_STEP_MAX_MS 2000
+#define PEDOMETER_START_STEPS 4
+#define PEDOMETER_CADENCE_STEPS 8
+
+struct pedometer {
+	uint16_t sample_ms;
+	uint32_t now_ms;		// time of the latest sample, counted in samples
+	int32_t gravity;		// high-pass state, 1/16 units
+	int32_t filtered;		// band-pass output, 1/16 units
+	int32_t prev[2];		// the two filtered samples before this one
+	int32_t peak_avg;		// average step peak, 1/16 units
+	bool armed;			// the signal has dipped below zero since the last step
+	bool walking;
+	uint8_t pending;		// steps seen before the walk is confirmed
+	uint32_t last_step_ms;
+	uint16_t interval_ms[PEDOMETER_CADENCE_STEPS];
+	uint8_t intervals;		// valid entries in interval_ms
+	uint8_t interval_next;
+	uint32_t steps;			// total counted
+	uint16_t cadence_spm;		// steps per minute
+};
+
+void pedometer_init(struct pedometer *p, uint16_t sample_ms);
+bool pedometer_add(struct pedometer *p, int x, int y, int z);
+#endif
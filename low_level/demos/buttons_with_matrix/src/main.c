@@ -25,15 +25,24 @@ void main(void)
 		printf("\nError initializing buttons.  Error code = %d\n",ret);	
 		while(1);
 	}	
+	ret = buttons_events_begin();
+	if (ret < 0)
+	{
+		printf("\nError attaching the button interrupts.  Error code = %d\n",ret);	
+		while(1);
+	}
+	matrix_put_pattern(rows, ~cols);
+	// sleep until a button is pressed, the pattern stays on the matrix in between
 	while(1)
 	{       
-		matrix_put_pattern(rows, ~cols);
-		if (get_buttonA()==0)
+		struct button_event event;
+		if (buttons_wait_event(&event, K_FOREVER)) continue;
+		if (event.button == BUTTON_A)
 		{
 			cols = cols << 1;
 			printf("%d\n", cols);
 		}
-		if (get_buttonB()==0)
+		if (event.button == BUTTON_B)
 		{
 			cols = cols >> 1;
 		}
@@ -46,6 +55,6 @@ void main(void)
 				rows = 1;
 			}
 		}
-		k_msleep(100);
+		matrix_put_pattern(rows, ~cols);
 	}
 }
@@ -1,6 +0,0 @@
-#ifndef __MATRIX_H
-#define __MATRIX_H
-int matrix_begin();
-void matrix_all_off();
-void matrix_put_pattern(uint8_t rows, uint8_t cols);
-#endif
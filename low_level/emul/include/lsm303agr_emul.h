@@ -0,0 +1,21 @@
+#ifndef __LSM303AGR_EMUL_H
+#define __LSM303AGR_EMUL_H
+#include <drivers/emul.h>
+#include <stdint.h>
+/*
+ * Emulated LSM303AGR for native_posix builds. The accelerometer (0x19) and magnetometer (0x1e)
+ * are separate nodes on the emulated I2C bus, see boards/native_posix.overlay in the apps.
+ * Samples are produced at the output data rate set in CTRL_REG1_A / CFG_REG_A_M and go
+ * through the same output registers, FIFO and INT1 logic as the real part:
+ * - accelerometer output is left justified 8, 10 or 12 bit depending on LPen and HR,
+ *   scaled by the full scale in CTRL_REG4_A
+ * - FIFO_CTRL_REG_A bypass, FIFO and stream modes with the watermark and overrun flags,
+ *   a burst read from OUT_X_L_A wraps at OUT_Z_H_A and pops one sample per 6 bytes
+ * - INT1 follows CTRL_REG3_A (IA1, ZYXDA, WTM, overrun) and the INT1_CFG_A AND/OR of the
+ *   high/low events, latched when LIR_INT1 is set, polarity from CTRL_REG6_A
+ * INT1_DURATION_A, click, activity and INT2 are not emulated.
+ */
+// the motion the sensors see, in mg and mgauss
+int lsm303agr_emul_set_accel(const struct emul *emul, const int16_t mg[3]);
+int lsm303agr_emul_set_magn(const struct emul *emul, const int16_t mgauss[3]);
+#endif
@@ -0,0 +1,18 @@
+#ifndef __SCD30_EMUL_H
+#define __SCD30_EMUL_H
+#include <drivers/emul.h>
+/*
+ * Emulated Sensirion SCD30 for native_posix builds (I2C address 0x61).
+ * Commands are 16 bit big endian with an optional argument word, every word on the wire
+ * carries the Sensirion CRC-8 and a bad CRC is NACKed. Once started the sensor measures
+ * every interval seconds and the data ready flag is set until the measurement is read.
+ * A read has to come at least SCD30_EMUL_CMD_DELAY_US after its command, as the datasheet
+ * asks; earlier reads are NACKed and counted so timing bugs in the driver show up. The count
+ * is logged every 10 measurement reads as "timing errors: <n>" for the console harness.
+ */
+#define SCD30_EMUL_CMD_DELAY_US 3000
+
+int scd30_emul_set_sample(const struct emul *emul, float co2_ppm, float temperature, float humidity);
+// reads that came too early since boot
+uint32_t scd30_emul_timing_errors(const struct emul *emul);
+#endif
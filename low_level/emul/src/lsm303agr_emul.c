@@ -0,0 +1,475 @@
+#define DT_DRV_COMPAT iotlab_lsm303agr_accel_emul
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <logging/log.h>
+#include <sys/byteorder.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lsm303agr_emul.h"
+
+LOG_MODULE_REGISTER(lsm303agr_emul, CONFIG_SENSOR_EMUL_LOG_LEVEL);
+
+// accelerometer registers
+#define ACCEL_FIRST_REG 0x07
+#define WHO_AM_I_A 0x0f
+#define CTRL_REG1_A 0x20	// ODR[7:4] LPen[3] Zen Yen Xen
+#define CTRL_REG3_A 0x22	// I1_IA1[6] I1_ZYXDA[4] I1_WTM[2] I1_OVERRUN[1]
+#define CTRL_REG4_A 0x23	// FS[5:4] HR[3]
+#define CTRL_REG5_A 0x24	// FIFO_EN[6] LIR_INT1[3]
+#define CTRL_REG6_A 0x25	// INT_POLARITY[1]
+#define STATUS_REG_A 0x27	// ZYXOR[7] ZYXDA[3]
+#define OUT_X_L_A 0x28
+#define OUT_Z_H_A 0x2d
+#define FIFO_CTRL_REG_A 0x2e	// FM[7:6] FTH[4:0]
+#define FIFO_SRC_REG_A 0x2f	// WTM[7] OVRN_FIFO[6] EMPTY[5] FSS[4:0]
+#define INT1_CFG_A 0x30		// AOI[7] 6D[6] ZHIE ZLIE YHIE YLIE XHIE XLIE
+#define INT1_SRC_A 0x31		// IA[6] ZH ZL YH YL XH XL
+#define INT1_THS_A 0x32
+#define ACCEL_LAST_REG 0x3f
+#define AUTO_INCREMENT 0x80	// accelerometer sub address bit, the magnetometer always increments
+// magnetometer registers
+#define MAGN_FIRST_REG 0x45
+#define WHO_AM_I_M 0x4f
+#define CFG_REG_A_M 0x60	// ODR[3:2] MD[1:0]
+#define STATUS_REG_M 0x67	// Zyxor[7] Zyxda[3]
+#define OUTX_L_REG_M 0x68
+#define OUTZ_H_REG_M 0x6d
+#define MAGN_LAST_REG 0x6f
+
+#define LPEN BIT(3)
+#define HR BIT(3)
+#define FIFO_EN BIT(6)
+#define LIR_INT1 BIT(3)
+#define INT_POLARITY BIT(1)
+#define ZYXDA BIT(3)
+#define ZYXOR BIT(7)
+#define I1_IA1 BIT(6)
+#define I1_ZYXDA BIT(4)
+#define I1_WTM BIT(2)
+#define I1_OVERRUN BIT(1)
+#define AOI BIT(7)
+#define IA BIT(6)
+#define FIFO_BYPASS 0
+#define FIFO_MODE 1
+#define FIFO_DEPTH 32
+#define MAGN_CONTINUOUS 0
+#define MAGN_SINGLE 1
+#define STEP_IMPULSE_MS 100
+#define STEP_IMPULSE_MG 1200
+
+struct lsm303agr_emul_data;
+
+struct lsm303agr_emul_cfg {
+	struct lsm303agr_emul_data *data;
+	uint16_t addr;
+	bool magn;
+	const char *int1_label;	// NULL without int1-gpios
+	gpio_pin_t int1_pin;
+	int16_t motion[3];	// mg or mgauss
+	uint32_t step_period_ms;
+};
+
+struct lsm303agr_emul_data {
+	struct i2c_emul emul_i2c;
+	const struct lsm303agr_emul_cfg *cfg;
+	const struct device *int1;
+	struct k_timer timer;
+	struct k_spinlock lock;
+	uint8_t reg[MAGN_LAST_REG + 1];
+	uint8_t sub;		// register pointer, kept between transfers like the real part
+	int16_t motion[3];
+	int16_t fifo[FIFO_DEPTH][3];
+	uint8_t fifo_head;
+	uint8_t fifo_level;
+	bool fifo_overrun;
+};
+
+static const uint16_t accel_odr_hz[16] = { 0, 1, 10, 25, 50, 100, 200, 400, 1620, 1344 };
+static const uint16_t magn_odr_hz[4] = { 10, 20, 50, 100 };
+
+static bool fifo_enabled(const uint8_t *reg)
+{
+	return (reg[CTRL_REG5_A] & FIFO_EN) && (reg[FIFO_CTRL_REG_A] >> 6) != FIFO_BYPASS;
+}
+
+static void fifo_reset(struct lsm303agr_emul_data *data)
+{
+	data->fifo_head = 0;
+	data->fifo_level = 0;
+	data->fifo_overrun = false;
+}
+
+static uint8_t fifo_src(const struct lsm303agr_emul_data *data)
+{
+	uint8_t fth = data->reg[FIFO_CTRL_REG_A] & 0x1f;
+	uint8_t src = MIN(data->fifo_level, 0x1f);
+
+	if (data->fifo_level > fth) src |= BIT(7);
+	if (data->fifo_overrun) src |= BIT(6);
+	if (!data->fifo_level) src |= BIT(5);
+	return src;
+}
+
+// left justified 8, 10 or 12 bit output, 1mg per digit for 12 bit at +/-2g
+static int16_t accel_encode(const uint8_t *reg, int32_t mg)
+{
+	static const uint8_t hr_mg_per_digit[4] = { 1, 2, 4, 12 };
+	int fs = (reg[CTRL_REG4_A] >> 4) & 3;
+	int shift = (reg[CTRL_REG1_A] & LPEN) ? 8 : (reg[CTRL_REG4_A] & HR) ? 4 : 6;
+	int32_t max = (1 << (15 - shift)) - 1;
+	int32_t digits = mg / (hr_mg_per_digit[fs] << (shift - 4));
+
+	digits = CLAMP(digits, -max - 1, max);
+	return digits * (1 << shift);
+}
+
+// XL, XH, YL, YH, ZL, ZH as in INT1_SRC_A, compared on the absolute value like the part does
+static uint8_t int1_events(const uint8_t *reg, const int32_t *mg)
+{
+	static const uint8_t ths_mg[4] = { 16, 32, 62, 186 };
+	int32_t ths = (reg[INT1_THS_A] & 0x7f) * ths_mg[(reg[CTRL_REG4_A] >> 4) & 3];
+	uint8_t events = 0;
+
+	for (int i = 0; i < 3; i++) {
+		events |= (abs(mg[i]) > ths ? 2 : 1) << (2 * i);
+	}
+	return events;
+}
+
+static void int1_evaluate(struct lsm303agr_emul_data *data, const int32_t *mg)
+{
+	uint8_t *reg = data->reg;
+	uint8_t enabled = reg[INT1_CFG_A] & 0x3f;
+	uint8_t hit = int1_events(reg, mg) & enabled;
+	bool active = enabled && ((reg[INT1_CFG_A] & AOI) ? hit == enabled : hit != 0);
+
+	// a latched interrupt holds until INT1_SRC_A is read
+	if ((reg[CTRL_REG5_A] & LIR_INT1) && (reg[INT1_SRC_A] & IA)) return;
+	reg[INT1_SRC_A] = (active ? IA : 0) | hit;
+}
+
+// level of the INT1 pin, set outside the lock as it runs the app's gpio callbacks
+static int int1_level(const struct lsm303agr_emul_data *data)
+{
+	const uint8_t *reg = data->reg;
+	uint8_t route = reg[CTRL_REG3_A];
+	uint8_t src = fifo_src(data);
+	bool asserted = ((route & I1_IA1) && (reg[INT1_SRC_A] & IA)) ||
+			((route & I1_ZYXDA) && (reg[STATUS_REG_A] & ZYXDA)) ||
+			((route & I1_WTM) && (src & BIT(7))) ||
+			((route & I1_OVERRUN) && (src & BIT(6)));
+
+	return asserted ^ !!(reg[CTRL_REG6_A] & INT_POLARITY);
+}
+
+static void int1_update(struct lsm303agr_emul_data *data, int level)
+{
+	if (data->int1) gpio_emul_input_set(data->int1, data->cfg->int1_pin, level);
+}
+
+static void accel_sample(struct lsm303agr_emul_data *data)
+{
+	uint8_t *reg = data->reg;
+	int32_t mg[3] = { data->motion[0], data->motion[1], data->motion[2] };
+	int16_t raw[3];
+
+	if (data->cfg->step_period_ms && k_uptime_get() % data->cfg->step_period_ms < STEP_IMPULSE_MS) {
+		mg[2] += STEP_IMPULSE_MG;
+	}
+	for (int i = 0; i < 3; i++) {
+		raw[i] = accel_encode(reg, mg[i]);
+		sys_put_le16(raw[i], &reg[OUT_X_L_A + 2 * i]);
+	}
+	if (reg[STATUS_REG_A] & ZYXDA) reg[STATUS_REG_A] |= ZYXOR;
+	reg[STATUS_REG_A] |= ZYXDA;
+
+	if (fifo_enabled(reg)) {
+		bool full = data->fifo_level == FIFO_DEPTH;
+
+		if (full) data->fifo_overrun = true;
+		if (!full || (reg[FIFO_CTRL_REG_A] >> 6) != FIFO_MODE) { // FIFO mode stops when full
+			if (full) {
+				// stream modes drop the oldest sample
+				data->fifo_head = (data->fifo_head + 1) % FIFO_DEPTH;
+				data->fifo_level--;
+			}
+			memcpy(data->fifo[(data->fifo_head + data->fifo_level) % FIFO_DEPTH], raw, sizeof(raw));
+			data->fifo_level++;
+		}
+	}
+	int1_evaluate(data, mg);
+}
+
+static void magn_sample(struct lsm303agr_emul_data *data)
+{
+	uint8_t *reg = data->reg;
+
+	for (int i = 0; i < 3; i++) {
+		// 1.5 mgauss per digit
+		sys_put_le16(data->motion[i] * 2 / 3, &reg[OUTX_L_REG_M + 2 * i]);
+	}
+	if (reg[STATUS_REG_M] & ZYXDA) reg[STATUS_REG_M] |= ZYXOR;
+	reg[STATUS_REG_M] |= ZYXDA;
+	// a single measurement drops back to idle
+	if ((reg[CFG_REG_A_M] & 3) == MAGN_SINGLE) reg[CFG_REG_A_M] |= 3;
+}
+
+static void sample_expiry(struct k_timer *timer)
+{
+	struct lsm303agr_emul_data *data = k_timer_user_data_get(timer);
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	int level;
+
+	if (data->cfg->magn) {
+		magn_sample(data);
+	} else {
+		accel_sample(data);
+	}
+	level = int1_level(data);
+	k_spin_unlock(&data->lock, key);
+	int1_update(data, level);
+}
+
+// follow the output data rate, or the single shot of the magnetometer
+static void sample_rate_update(struct lsm303agr_emul_data *data)
+{
+	uint32_t hz;
+
+	if (data->cfg->magn) {
+		uint8_t cfg = data->reg[CFG_REG_A_M];
+
+		if ((cfg & 3) == MAGN_SINGLE) {
+			k_timer_start(&data->timer, K_MSEC(10), K_NO_WAIT);
+			return;
+		}
+		hz = (cfg & 3) == MAGN_CONTINUOUS ? magn_odr_hz[(cfg >> 2) & 3] : 0;
+	} else {
+		hz = accel_odr_hz[data->reg[CTRL_REG1_A] >> 4];
+	}
+	if (hz) {
+		k_timer_start(&data->timer, K_USEC(USEC_PER_SEC / hz), K_USEC(USEC_PER_SEC / hz));
+	} else {
+		k_timer_stop(&data->timer);
+	}
+}
+
+static void registers_reset(struct lsm303agr_emul_data *data)
+{
+	memset(data->reg, 0, sizeof(data->reg));
+	data->reg[WHO_AM_I_A] = 0x33;
+	data->reg[CTRL_REG1_A] = 0x07; // power down, all axes enabled
+	data->reg[WHO_AM_I_M] = 0x40;
+	data->reg[CFG_REG_A_M] = 0x03; // idle
+	fifo_reset(data);
+}
+
+static bool reg_valid(const struct lsm303agr_emul_data *data, uint8_t addr)
+{
+	return data->cfg->magn ? addr >= MAGN_FIRST_REG && addr <= MAGN_LAST_REG :
+				 addr >= ACCEL_FIRST_REG && addr <= ACCEL_LAST_REG;
+}
+
+static uint8_t reg_read(struct lsm303agr_emul_data *data, uint8_t addr)
+{
+	uint8_t *reg = data->reg;
+	uint8_t val = reg[addr];
+
+	if (data->cfg->magn) {
+		if (addr >= OUTX_L_REG_M && addr <= OUTZ_H_REG_M) reg[STATUS_REG_M] = 0;
+		return val;
+	}
+	switch (addr) {
+	case FIFO_SRC_REG_A:
+		return fifo_src(data);
+	case INT1_SRC_A:
+		reg[INT1_SRC_A] &= ~IA; // reading clears a latched interrupt
+		return val;
+	}
+	if (addr >= OUT_X_L_A && addr <= OUT_Z_H_A) {
+		if (fifo_enabled(reg) && data->fifo_level) {
+			val = (uint16_t)data->fifo[data->fifo_head][(addr - OUT_X_L_A) / 2] >> (addr & 1 ? 8 : 0);
+			if (addr == OUT_Z_H_A) {
+				data->fifo_head = (data->fifo_head + 1) % FIFO_DEPTH;
+				data->fifo_level--;
+				data->fifo_overrun = false;
+			}
+		}
+		reg[STATUS_REG_A] = 0;
+	}
+	return val;
+}
+
+static void reg_write(struct lsm303agr_emul_data *data, uint8_t addr, uint8_t val)
+{
+	switch (addr) {
+	case WHO_AM_I_A:
+	case STATUS_REG_A:
+	case FIFO_SRC_REG_A:
+	case INT1_SRC_A:
+	case WHO_AM_I_M:
+	case STATUS_REG_M:
+		return; // read only
+	}
+	if ((addr >= OUT_X_L_A && addr <= OUT_Z_H_A) || (addr >= OUTX_L_REG_M && addr <= OUTZ_H_REG_M)) return;
+
+	data->reg[addr] = val;
+	switch (addr) {
+	case CTRL_REG1_A:
+	case CFG_REG_A_M:
+		sample_rate_update(data);
+		break;
+	case CTRL_REG5_A:
+		if (!(val & FIFO_EN)) fifo_reset(data);
+		break;
+	case FIFO_CTRL_REG_A:
+		if ((val >> 6) == FIFO_BYPASS) fifo_reset(data); // bypass empties the fifo
+		break;
+	}
+}
+
+// the register pointer after a byte, a fifo read wraps from OUT_Z_H_A back to OUT_X_L_A
+static uint8_t reg_next(const struct lsm303agr_emul_data *data, uint8_t addr, bool increment)
+{
+	if (!increment) return addr;
+	if (!data->cfg->magn && addr == OUT_Z_H_A && fifo_enabled(data->reg)) return OUT_X_L_A;
+	return addr + 1;
+}
+
+static int lsm303agr_emul_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+	struct lsm303agr_emul_data *data = CONTAINER_OF(emul, struct lsm303agr_emul_data, emul_i2c);
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	bool have_sub = false;
+	bool increment;
+	uint8_t ptr;
+	int level, err = 0;
+
+	for (int m = 0; m < num_msgs && !err; m++) {
+		struct i2c_msg *msg = &msgs[m];
+		uint32_t i = 0;
+
+		if (!(msg->flags & I2C_MSG_READ) && !have_sub) {
+			// the first byte written in a transfer is the register address
+			if (!msg->len) {
+				err = -EIO;
+				break;
+			}
+			data->sub = msg->buf[i++];
+			have_sub = true;
+		}
+		increment = data->cfg->magn || (data->sub & AUTO_INCREMENT);
+		ptr = data->sub & ~AUTO_INCREMENT;
+		for (; i < msg->len; i++) {
+			if (!reg_valid(data, ptr)) {
+				LOG_ERR("0x%02x: no register 0x%02x", addr, ptr);
+				err = -EIO; // the part NACKs
+				break;
+			}
+			if (msg->flags & I2C_MSG_READ) {
+				msg->buf[i] = reg_read(data, ptr);
+			} else {
+				reg_write(data, ptr, msg->buf[i]);
+			}
+			ptr = reg_next(data, ptr, increment);
+		}
+		data->sub = ptr | (data->sub & AUTO_INCREMENT);
+	}
+	level = int1_level(data);
+	k_spin_unlock(&data->lock, key);
+	int1_update(data, level);
+	return err;
+}
+
+static struct i2c_emul_api lsm303agr_emul_api_i2c = {
+	.transfer = lsm303agr_emul_transfer,
+};
+
+static int lsm303agr_emul_set(const struct emul *emul, const int16_t motion[3])
+{
+	const struct lsm303agr_emul_cfg *cfg = emul->cfg;
+	struct lsm303agr_emul_data *data = cfg->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	memcpy(data->motion, motion, sizeof(data->motion));
+	k_spin_unlock(&data->lock, key);
+	return 0;
+}
+
+int lsm303agr_emul_set_accel(const struct emul *emul, const int16_t mg[3])
+{
+	const struct lsm303agr_emul_cfg *cfg = emul->cfg;
+
+	if (cfg->magn) return -EINVAL;
+	return lsm303agr_emul_set(emul, mg);
+}
+
+int lsm303agr_emul_set_magn(const struct emul *emul, const int16_t mgauss[3])
+{
+	const struct lsm303agr_emul_cfg *cfg = emul->cfg;
+
+	if (!cfg->magn) return -EINVAL;
+	return lsm303agr_emul_set(emul, mgauss);
+}
+
+static int lsm303agr_emul_init(const struct emul *emul, const struct device *parent)
+{
+	const struct lsm303agr_emul_cfg *cfg = emul->cfg;
+	struct lsm303agr_emul_data *data = cfg->data;
+
+	data->cfg = cfg;
+	data->emul_i2c.api = &lsm303agr_emul_api_i2c;
+	data->emul_i2c.addr = cfg->addr;
+	memcpy(data->motion, cfg->motion, sizeof(data->motion));
+	registers_reset(data);
+	k_timer_init(&data->timer, sample_expiry, NULL);
+	k_timer_user_data_set(&data->timer, data);
+	if (cfg->int1_label) {
+		data->int1 = device_get_binding(cfg->int1_label);
+		if (!data->int1) {
+			LOG_ERR("No %s for INT1", cfg->int1_label);
+			return -ENODEV;
+		}
+		int1_update(data, int1_level(data));
+	}
+	return i2c_emul_register(parent, emul->dev_label, &data->emul_i2c);
+}
+
+#define LSM303AGR_ACCEL_EMUL(n)								\
+	static struct lsm303agr_emul_data lsm303agr_accel_emul_data_##n;			\
+	static const struct lsm303agr_emul_cfg lsm303agr_accel_emul_cfg_##n = {		\
+		.data = &lsm303agr_accel_emul_data_##n,					\
+		.addr = DT_INST_REG_ADDR(n),						\
+		.magn = false,								\
+		.int1_label = COND_CODE_1(DT_INST_NODE_HAS_PROP(n, int1_gpios),		\
+					  (DT_INST_GPIO_LABEL(n, int1_gpios)), (NULL)),	\
+		.int1_pin = COND_CODE_1(DT_INST_NODE_HAS_PROP(n, int1_gpios),		\
+					(DT_INST_GPIO_PIN(n, int1_gpios)), (0)),	\
+		.motion = COND_CODE_1(DT_INST_NODE_HAS_PROP(n, accel_mg),		\
+				      (DT_INST_PROP(n, accel_mg)), ({ 0, 0, 1000 })),	\
+		.step_period_ms = DT_INST_PROP(n, step_period_ms),			\
+	};										\
+	EMUL_DEFINE(lsm303agr_emul_init, DT_DRV_INST(n), &lsm303agr_accel_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(LSM303AGR_ACCEL_EMUL)
+
+#undef DT_DRV_COMPAT
+#define DT_DRV_COMPAT iotlab_lsm303agr_magn_emul
+
+#define LSM303AGR_MAGN_EMUL(n)								\
+	static struct lsm303agr_emul_data lsm303agr_magn_emul_data_##n;			\
+	static const struct lsm303agr_emul_cfg lsm303agr_magn_emul_cfg_##n = {		\
+		.data = &lsm303agr_magn_emul_data_##n,					\
+		.addr = DT_INST_REG_ADDR(n),						\
+		.magn = true,								\
+		.motion = COND_CODE_1(DT_INST_NODE_HAS_PROP(n, field_mgauss),		\
+				      (DT_INST_PROP(n, field_mgauss)), ({ 200, 0, -400 })), \
+	};										\
+	EMUL_DEFINE(lsm303agr_emul_init, DT_DRV_INST(n), &lsm303agr_magn_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(LSM303AGR_MAGN_EMUL)
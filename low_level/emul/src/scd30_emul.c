@@ -0,0 +1,334 @@
+#define DT_DRV_COMPAT iotlab_scd30_emul
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <logging/log.h>
+#include <sys/byteorder.h>
+#include <string.h>
+#include "scd30_emul.h"
+
+LOG_MODULE_REGISTER(scd30_emul, CONFIG_SENSOR_EMUL_LOG_LEVEL);
+
+#define CMD_START_PERIODIC_MEASUREMENT 0x0010
+#define CMD_STOP_PERIODIC_MEASUREMENT 0x0104
+#define CMD_GET_DATA_READY 0x0202
+#define CMD_READ_MEASUREMENT 0x0300
+#define CMD_MEASUREMENT_INTERVAL 0x4600
+#define CMD_ALTITUDE 0x5102
+#define CMD_FORCED_RECALIBRATION 0x5204
+#define CMD_AUTO_SELF_CALIBRATION 0x5306
+#define CMD_TEMPERATURE_OFFSET 0x5403
+#define CMD_READ_SERIAL 0xD033
+#define CMD_FIRMWARE_VERSION 0xD100
+#define CMD_SOFT_RESET 0xD304
+
+#define FIRMWARE_VERSION 0x0342
+#define CO2_MIN_PPM 400
+#define CO2_MAX_PPM 3000
+#define RESPONSE_MAX_WORDS 16	// the serial number is the longest response
+#define REPORT_READS 10		// measurement reads between timing error reports
+
+struct scd30_emul_data;
+
+struct scd30_emul_cfg {
+	struct scd30_emul_data *data;
+	uint16_t addr;
+	int32_t co2_ppm;
+	int32_t co2_step_ppm;
+	int32_t temperature_cdeg;
+	int32_t humidity_cpct;
+};
+
+struct scd30_emul_data {
+	struct i2c_emul emul_i2c;
+	const struct scd30_emul_cfg *cfg;
+	struct k_spinlock lock;
+	float sample[3];	// co2, temperature, humidity
+	int32_t co2_step;
+	bool measuring;
+	int64_t start_ms;	// measurements complete every interval from here
+	uint32_t measured;	// measurements taken since start_ms
+	uint32_t read;		// the last one read out
+	uint16_t interval_s;
+	uint16_t altitude;
+	uint16_t frc_ppm;
+	uint16_t asc;
+	uint16_t temperature_offset;
+	uint8_t response[RESPONSE_MAX_WORDS * 3];
+	uint8_t response_len;
+	int64_t command_us;	// when the command behind the response arrived
+	uint32_t timing_errors;
+	uint32_t reads;		// measurements read out since boot
+};
+
+// Sensirion CRC-8: polynomial 0x31, init 0xff
+static uint8_t crc8(const uint8_t *data, size_t len)
+{
+	uint8_t crc = 0xff;
+
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static int64_t uptime_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void respond_word(struct scd30_emul_data *data, uint16_t word)
+{
+	uint8_t *out = &data->response[data->response_len];
+
+	sys_put_be16(word, out);
+	out[2] = crc8(out, 2);
+	data->response_len += 3;
+}
+
+// floats go out big endian, most significant word first
+static void respond_float(struct scd30_emul_data *data, float value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	respond_word(data, bits >> 16);
+	respond_word(data, bits & 0xffff);
+}
+
+static void emul_reset(struct scd30_emul_data *data)
+{
+	const struct scd30_emul_cfg *cfg = data->cfg;
+
+	data->sample[0] = cfg->co2_ppm;
+	data->sample[1] = cfg->temperature_cdeg / 100.0f;
+	data->sample[2] = cfg->humidity_cpct / 100.0f;
+	data->co2_step = cfg->co2_step_ppm;
+	data->measuring = false;
+	data->interval_s = 2;
+	data->altitude = 0;
+	data->frc_ppm = 400;
+	data->asc = 0;
+	data->temperature_offset = 0;
+	data->response_len = 0;
+}
+
+// the sensor free runs once started, catch up with the measurements it would have taken
+static void measurements_update(struct scd30_emul_data *data)
+{
+	uint32_t measured;
+
+	if (!data->measuring) return;
+	measured = (k_uptime_get() - data->start_ms) / (data->interval_s * MSEC_PER_SEC);
+	for (; data->measured < measured; data->measured++) {
+		float co2 = data->sample[0] + data->co2_step;
+
+		if (!data->measured) continue; // the first measurement reads the starting value
+		if (co2 < CO2_MIN_PPM || co2 > CO2_MAX_PPM) {
+			data->co2_step = -data->co2_step;
+			co2 = data->sample[0] + data->co2_step;
+		}
+		data->sample[0] = co2;
+	}
+}
+
+static void measurements_restart(struct scd30_emul_data *data)
+{
+	data->start_ms = k_uptime_get();
+	data->measured = 0;
+	data->read = 0;
+}
+
+static int command(struct scd30_emul_data *data, uint16_t cmd, const uint16_t *arg)
+{
+	data->response_len = 0;
+	data->command_us = uptime_us();
+	measurements_update(data);
+
+	switch (cmd) {
+	case CMD_START_PERIODIC_MEASUREMENT:
+		if (!arg || (*arg && (*arg < 700 || *arg > 1400))) return -EIO;
+		data->measuring = true;
+		measurements_restart(data);
+		return 0;
+	case CMD_STOP_PERIODIC_MEASUREMENT:
+		if (arg) return -EIO;
+		data->measuring = false;
+		return 0;
+	case CMD_GET_DATA_READY:
+		if (arg) return -EIO;
+		respond_word(data, data->measured > data->read);
+		return 0;
+	case CMD_READ_MEASUREMENT:
+		if (arg) return -EIO;
+		for (int i = 0; i < 3; i++) {
+			respond_float(data, data->sample[i]);
+		}
+		data->read = data->measured;
+		// a steady report for the console checks in sample.yaml, which expect no timing errors
+		if (++data->reads % REPORT_READS == 0) {
+			LOG_INF("%u measurements read, timing errors: %u", data->reads, data->timing_errors);
+		}
+		return 0;
+	case CMD_MEASUREMENT_INTERVAL:
+		if (!arg) {
+			respond_word(data, data->interval_s);
+			return 0;
+		}
+		if (*arg < 2 || *arg > 1800) return -EIO;
+		data->interval_s = *arg;
+		measurements_restart(data);
+		return 0;
+	case CMD_FORCED_RECALIBRATION:
+		if (!arg) {
+			respond_word(data, data->frc_ppm);
+			return 0;
+		}
+		if (*arg < 400 || *arg > 2000) return -EIO;
+		data->frc_ppm = *arg;
+		data->sample[0] = *arg; // the sensor now reads the reference value
+		return 0;
+	case CMD_AUTO_SELF_CALIBRATION:
+		if (!arg) {
+			respond_word(data, data->asc);
+			return 0;
+		}
+		data->asc = !!*arg;
+		return 0;
+	case CMD_TEMPERATURE_OFFSET:
+		if (!arg) {
+			respond_word(data, data->temperature_offset);
+			return 0;
+		}
+		data->temperature_offset = *arg;
+		return 0;
+	case CMD_ALTITUDE:
+		if (!arg) {
+			respond_word(data, data->altitude);
+			return 0;
+		}
+		data->altitude = *arg;
+		return 0;
+	case CMD_FIRMWARE_VERSION:
+		if (arg) return -EIO;
+		respond_word(data, FIRMWARE_VERSION);
+		return 0;
+	case CMD_READ_SERIAL:
+		if (arg) return -EIO;
+		// "EMUL0000" as ascii words, zero padded
+		for (int i = 0; i < RESPONSE_MAX_WORDS; i++) {
+			respond_word(data, i < 4 ? sys_get_be16((const uint8_t *)&"EMUL0000"[2 * i]) : 0);
+		}
+		return 0;
+	case CMD_SOFT_RESET:
+		if (arg) return -EIO;
+		emul_reset(data);
+		return 0;
+	}
+	LOG_ERR("Unknown command 0x%04x", cmd);
+	return -EIO;
+}
+
+static int write_msg(struct scd30_emul_data *data, const struct i2c_msg *msg)
+{
+	uint16_t arg;
+
+	if (msg->len == 2) return command(data, sys_get_be16(msg->buf), NULL);
+	if (msg->len != 5) {
+		LOG_ERR("Write of %u bytes", msg->len);
+		return -EIO;
+	}
+	if (crc8(&msg->buf[2], 2) != msg->buf[4]) {
+		LOG_ERR("Bad CRC on the argument of 0x%04x", sys_get_be16(msg->buf));
+		return -EIO;
+	}
+	arg = sys_get_be16(&msg->buf[2]);
+	return command(data, sys_get_be16(msg->buf), &arg);
+}
+
+static int read_msg(struct scd30_emul_data *data, struct i2c_msg *msg)
+{
+	int64_t waited_us = uptime_us() - data->command_us;
+
+	if (waited_us < SCD30_EMUL_CMD_DELAY_US) {
+		data->timing_errors++;
+		LOG_ERR("Read %lldus after the command, needs %dus", (long long)waited_us, SCD30_EMUL_CMD_DELAY_US);
+		return -EIO;
+	}
+	if (!data->response_len || msg->len > data->response_len) {
+		LOG_ERR("Read of %u bytes with %u pending", msg->len, data->response_len);
+		return -EIO;
+	}
+	memcpy(msg->buf, data->response, msg->len);
+	data->response_len = 0;
+	return 0;
+}
+
+static int scd30_emul_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+	struct scd30_emul_data *data = CONTAINER_OF(emul, struct scd30_emul_data, emul_i2c);
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	int err = 0;
+
+	for (int i = 0; i < num_msgs && !err; i++) {
+		err = (msgs[i].flags & I2C_MSG_READ) ? read_msg(data, &msgs[i]) : write_msg(data, &msgs[i]);
+	}
+	k_spin_unlock(&data->lock, key);
+	return err;
+}
+
+static struct i2c_emul_api scd30_emul_api_i2c = {
+	.transfer = scd30_emul_transfer,
+};
+
+int scd30_emul_set_sample(const struct emul *emul, float co2_ppm, float temperature, float humidity)
+{
+	const struct scd30_emul_cfg *cfg = emul->cfg;
+	struct scd30_emul_data *data = cfg->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	data->sample[0] = co2_ppm;
+	data->sample[1] = temperature;
+	data->sample[2] = humidity;
+	k_spin_unlock(&data->lock, key);
+	return 0;
+}
+
+uint32_t scd30_emul_timing_errors(const struct emul *emul)
+{
+	const struct scd30_emul_cfg *cfg = emul->cfg;
+
+	return cfg->data->timing_errors;
+}
+
+static int scd30_emul_init(const struct emul *emul, const struct device *parent)
+{
+	const struct scd30_emul_cfg *cfg = emul->cfg;
+	struct scd30_emul_data *data = cfg->data;
+
+	data->cfg = cfg;
+	data->emul_i2c.api = &scd30_emul_api_i2c;
+	data->emul_i2c.addr = cfg->addr;
+	emul_reset(data);
+	return i2c_emul_register(parent, emul->dev_label, &data->emul_i2c);
+}
+
+#define SCD30_EMUL(n)									\
+	static struct scd30_emul_data scd30_emul_data_##n;				\
+	static const struct scd30_emul_cfg scd30_emul_cfg_##n = {			\
+		.data = &scd30_emul_data_##n,						\
+		.addr = DT_INST_REG_ADDR(n),						\
+		.co2_ppm = DT_INST_PROP(n, co2_ppm),					\
+		.co2_step_ppm = DT_INST_PROP(n, co2_step_ppm),				\
+		.temperature_cdeg = DT_INST_PROP(n, temperature_cdeg),			\
+		.humidity_cpct = DT_INST_PROP(n, humidity_cpct),			\
+	};										\
+	EMUL_DEFINE(scd30_emul_init, DT_DRV_INST(n), &scd30_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(SCD30_EMUL)
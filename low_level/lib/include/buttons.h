@@ -0,0 +1,28 @@
+#ifndef __BUTTONS_H
+#define __BUTTONS_H
+#include <zephyr.h>
+#include <device.h>	
+#include <stdio.h>
+// A typedef for a function pointer for an interrupt callback
+typedef void (*fptr)(void);
+
+int get_buttonA();
+int get_buttonB();
+int buttons_begin();
+int attach_callback_to_button(fptr callback_function, int btn);
+
+// Button presses as events for a UI thread: buttons_events_begin() takes both callback
+// slots, the interrupts queue a debounced event and buttons_wait_event() blocks until
+// one arrives, so the thread only wakes when something was pressed
+enum button_id {
+	BUTTON_A,
+	BUTTON_B,
+	BUTTON_COUNT
+};
+struct button_event {
+	uint8_t button;		// enum button_id
+	uint32_t time_ms;	// uptime of the press
+};
+int buttons_events_begin();
+int buttons_wait_event(struct button_event *event, k_timeout_t timeout);
+#endif
@@ -0,0 +1,68 @@
+#ifndef __DIAG_H
+#define __DIAG_H
+#include <zephyr.h>
+#ifdef CONFIG_CPU_CORTEX_M
+#include <soc.h> // CMSIS: DWT, CoreDebug and SystemCoreClock
+#endif
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * Lightweight run time statistics for profiling fielded units without a debugger.
+ * Timers use the Cortex-M DWT cycle counter (the kernel's cycle counter on native_posix) and keep count, min, average, max and a
+ * log2 histogram of the durations. Counters are plain atomics. Stack high-water marks
+ * come from the kernel (needs CONFIG_INIT_STACKS and CONFIG_THREAD_STACK_INFO).
+ * The app passes its tables to diag_begin(), diag_format() renders them as text for
+ * the diagnostics characteristic and the "diag" shell command.
+ */
+#define DIAG_HIST_BINS 12	// bin n counts durations below 2^(n+1) us, the last bin everything above 2ms
+
+struct diag_timer {
+	const char *name;
+	uint32_t count;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
+	uint32_t hist[DIAG_HIST_BINS];
+};
+#define DIAG_TIMER_INIT(_name) { .name = (_name), .min_cycles = UINT32_MAX }
+
+struct diag_counter {
+	const char *name;
+	atomic_t value;
+};
+#define DIAG_COUNTER_INIT(_name) { .name = (_name) }
+
+struct diag_thread {
+	const char *name;
+	k_tid_t tid;	// filled in by the app, threads with a NULL tid are skipped
+};
+
+void diag_begin(struct diag_timer *timers, size_t n_timers, struct diag_counter *counters, size_t n_counters,
+		struct diag_thread *threads, size_t n_threads);
+void diag_record(struct diag_timer *timer, uint32_t cycles);
+void diag_reset(void);
+size_t diag_format(char *buf, size_t size, bool histograms);
+uint32_t diag_cycles_to_us(uint64_t cycles);
+
+static inline uint32_t diag_cycles(void)
+{
+#ifdef CONFIG_CPU_CORTEX_M
+	return DWT->CYCCNT;
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+static inline void diag_count(struct diag_counter *counter)
+{
+	atomic_inc(&counter->value);
+}
+
+// time a statement, e.g. DIAG_TIME(&timers[T_SCD30], err = scd30_read_measurement_raw(raw));
+#define DIAG_TIME(timer, ...)							\
+	do {									\
+		uint32_t _diag_start = diag_cycles();				\
+		__VA_ARGS__;							\
+		diag_record((timer), diag_cycles() - _diag_start);		\
+	} while (0)
+#endif
@@ -0,0 +1,28 @@
+#ifndef __I2C_BUS_H
+#define __I2C_BUS_H
+#include <stdint.h>
+#include <device.h>
+#include <drivers/i2c.h>
+/*
+ * I2C_1 shared by the drivers. Every transaction takes the bus lock, so transfers made
+ * from different threads (scheduler jobs, the shell, main) can't interleave, and runs at
+ * the speed of the device it is for. The bus is only reconfigured when the speed changes
+ * from the previous transaction, e.g. the LSM303 runs in fast mode (400kHz) and the SCD30,
+ * which stretches the clock while it works out a response, in standard mode (100kHz).
+ */
+struct i2c_bus_dev {
+	uint16_t addr;
+	uint32_t speed;	// I2C_SPEED_STANDARD or I2C_SPEED_FAST
+};
+#define I2C_BUS_DEV(_addr, _speed) { .addr = (_addr), .speed = (_speed) }
+
+int i2c_bus_begin(void);
+// hold the bus across several transactions, i2c_bus_acquire() returns NULL on failure
+const struct device *i2c_bus_acquire(const struct i2c_bus_dev *dev);
+void i2c_bus_release(void);
+int i2c_bus_write(const struct i2c_bus_dev *dev, const uint8_t *buf, uint32_t len);
+int i2c_bus_read(const struct i2c_bus_dev *dev, uint8_t *buf, uint32_t len);
+int i2c_bus_burst_read(const struct i2c_bus_dev *dev, uint8_t reg, uint8_t *buf, uint32_t len);
+int i2c_bus_reg_read_byte(const struct i2c_bus_dev *dev, uint8_t reg, uint8_t *value);
+int i2c_bus_reg_write_byte(const struct i2c_bus_dev *dev, uint8_t reg, uint8_t value);
+#endif
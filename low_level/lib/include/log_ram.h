@@ -0,0 +1,30 @@
+#ifndef __LOG_RAM_H
+#define __LOG_RAM_H
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr.h>
+/*
+ * Log backend that keeps the most recent formatted log output in a RAM ring so it
+ * can be read back over BLE from a unit that isn't plugged into a serial port.
+ * It runs on the deferred logging thread along with the console backend, so the
+ * threads that log never wait on formatting or output.
+ */
+#define LOG_RAM_SIZE 1024
+
+size_t log_ram_read(uint8_t *dst, size_t size);
+
+/*
+ * Log at most once every interval_ms from this call site, e.g.
+ * LOG_RATELIMIT(1000, LOG_DBG, "Got a read %p", attr);
+ * Messages in between are dropped before they reach the logger.
+ */
+#define LOG_RATELIMIT(interval_ms, log_macro, ...)					\
+	do {										\
+		static int64_t _log_last_ms = -(interval_ms);				\
+		int64_t _log_now_ms = k_uptime_get();					\
+		if (_log_now_ms - _log_last_ms >= (interval_ms)) {			\
+			_log_last_ms = _log_now_ms;					\
+			log_macro(__VA_ARGS__);						\
+		}									\
+	} while (0)
+#endif
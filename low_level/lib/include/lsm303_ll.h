@@ -0,0 +1,33 @@
+#ifndef __LSM303_LL_H
+#define __LSM303_LL_H
+#include <stdint.h>
+#define LSM303_ACCEL_ADDRESS (0x19)
+#define LSM303_MAG_ADDRESS (0x1e)
+// power modes, see lsm303_ll_setPowerMode()
+enum lsm303_power_mode {
+	LSM303_POWER_DOWN,	// accelerometer ODR 0 and magnetometer idle, registers are kept
+	LSM303_LOW_POWER,	// 10Hz 8 bit accelerometer, low power magnetometer
+	LSM303_NORMAL		// 25Hz 12 bit accelerometer, continuous magnetometer
+};
+int lsm303_ll_begin();
+int lsm303_ll_setPowerMode(enum lsm303_power_mode mode);
+int lsm303_ll_readRegister(uint8_t RegNum, uint8_t *Value, uint8_t deviceReg);
+int lsm303_ll_writeRegister(uint8_t RegNum, uint8_t Value, uint8_t deviceReg);
+// acceleration in m/s^2 * 100
+int lsm303_ll_readAccelX();
+int lsm303_ll_readAccelY();
+int lsm303_ll_readAccelZ();
+int lsm303_ll_readAccel(int *x, int *y, int *z);
+// magnetic field in mgauss
+int lsm303_ll_readMagX();
+int lsm303_ll_readMagY();
+int lsm303_ll_readMagZ();
+int lsm303_ll_readMag(int *x, int *y, int *z);
+#ifdef CONFIG_IOTLAB_LSM303_FIFO
+#define LSM303_FIFO_DEPTH 32
+#define LSM303_FIFO_PERIOD_MS 20 // 50Hz while the FIFO is in use
+int lsm303_ll_fifoBegin(uint8_t watermark, void (*callback)(void));
+int lsm303_ll_readFifo(int accel[][3], int max);
+#endif
+
+#endif
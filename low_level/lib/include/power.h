@@ -0,0 +1,30 @@
+#ifndef __POWER_H
+#define __POWER_H
+#include <stdint.h>
+/*
+ * Power state tracking for the application.
+ * The app requests a state (e.g. from the BLE connection callbacks) and the change
+ * is applied on the scheduler thread through the callback passed to power_begin().
+ * Time spent in each state is accumulated and, with a per-state current estimate,
+ * gives a rough figure for the charge used since boot.
+ */
+enum power_state {
+	POWER_ACTIVE,	// a central is connected, sensors run at the reporting rate
+	POWER_IDLE,	// no central, sensors in their low power modes and slow advertising
+	POWER_STATE_COUNT
+};
+
+// packed so it can be returned as is from a GATT read
+struct power_stats {
+	uint32_t time_ms[POWER_STATE_COUNT];	// time spent in each state
+	uint32_t charge_uah;			// estimated charge used, micro amp hours
+	uint8_t state;				// current state
+} __attribute__((packed));
+
+typedef void (*power_state_fn)(enum power_state state);
+
+void power_begin(power_state_fn on_change, const uint32_t current_ua[POWER_STATE_COUNT]);
+void power_request(enum power_state state);
+enum power_state power_get_state(void);
+void power_get_stats(struct power_stats *stats);
+#endif
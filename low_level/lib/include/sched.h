@@ -0,0 +1,33 @@
+#ifndef __SCHED_H
+#define __SCHED_H
+#include <zephyr.h>
+/*
+ * Small cooperative scheduler built on k_work_delayable.
+ * Jobs run one at a time on a dedicated work queue thread. A periodic job is
+ * rescheduled against its own deadline so it keeps its rate, an event job
+ * (period 0) only runs when sched_job_trigger() is called, which is safe from ISRs.
+ * Between jobs the queue thread sleeps and the CPU idles.
+ */
+struct sched_job;
+typedef void (*sched_fn)(struct sched_job *job);
+
+struct sched_job {
+	struct k_work_delayable work;
+	sched_fn fn;			// function run by the job
+	uint32_t period_ms;		// 0 for an event triggered job
+	int64_t next_ms;		// uptime of the next periodic deadline
+	bool active;			// periodic runs are enabled
+	uint32_t retry_ms;		// set by sched_job_retry() while the job runs
+	const char *name;
+};
+
+int sched_begin(void);
+k_tid_t sched_thread(void);
+void sched_job_init(struct sched_job *job, const char *name, sched_fn fn, uint32_t period_ms);
+int sched_job_start(struct sched_job *job);
+int sched_job_restart(struct sched_job *job);
+int sched_job_trigger(struct sched_job *job);
+void sched_job_retry(struct sched_job *job, uint32_t delay_ms);
+void sched_job_set_period(struct sched_job *job, uint32_t period_ms);
+void sched_job_stop(struct sched_job *job);
+#endif
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <sys/printk.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <stdio.h>
+#include "buttons.h"
+// Both buttons are on GPIO0
+#define BUTTON_A_PORT_BIT 14
+#define BUTTON_B_PORT_BIT 23
+static const struct device *gpio0;
+
+int get_buttonA()
+{
+	return gpio_pin_get(gpio0, BUTTON_A_PORT_BIT);
+}
+int get_buttonB()
+{
+	return gpio_pin_get(gpio0, BUTTON_B_PORT_BIT);
+}
+
+int buttons_begin()
+{
+	int ret;
+	// Configure the GPIO's
+	gpio0 = device_get_binding("GPIO_0");
+	if (gpio0 == NULL)
+	{
+		printf("Error acquiring GPIO 0 interface\n");
+		return -1;
+	}
+	ret = gpio_pin_configure(gpio0, BUTTON_A_PORT_BIT, GPIO_INPUT);
+	ret |= gpio_pin_configure(gpio0, BUTTON_B_PORT_BIT, GPIO_INPUT);
+	if (ret)
+	{
+		printf("Error configuring the button pins\n");
+		return -2;
+	}
+	return 0;
+}
+
+#define MAX_CALLBACKS 2
+static fptr button_user_handler[MAX_CALLBACKS] = {NULL, NULL};
+static struct gpio_callback button_cb[MAX_CALLBACKS];
+// each attached button has its own gpio_callback, its index picks the user handler
+static void button_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+	fptr handler = button_user_handler[cb - button_cb];
+	if (handler) handler();
+}
+int attach_callback_to_button(fptr callback_function, int btn)
+{
+	int index = 0;
+	while (index < MAX_CALLBACKS && button_user_handler[index])
+	{
+		index++;
+	}
+	if (index == MAX_CALLBACKS)
+	{
+		printk("No callbacks left for button %d\n", btn);
+		return -1;
+	}
+	if (gpio_pin_interrupt_configure(gpio0, btn, GPIO_INT_EDGE_FALLING) < 0)
+	{
+		printk("Error configuring interrupt for button %d\n", btn);
+		return -2;
+	}
+	// the handler has to be in place before the callback can fire
+	button_user_handler[index] = callback_function;
+	gpio_init_callback(&button_cb[index], button_handler, (1 << btn));
+	if (gpio_add_callback(gpio0, &button_cb[index]) < 0)
+	{
+		printk("Error adding callback for button %d\n", btn);
+		button_user_handler[index] = NULL;
+		return -3;
+	}
+	return 0;
+}
+
+#define BUTTON_DEBOUNCE_MS 30 // contact bounce gives several falling edges per press, keep the first
+#define BUTTON_QUEUE_LEN 8 // presses waiting for the UI, later ones are dropped
+K_MSGQ_DEFINE(button_msgq, sizeof(struct button_event), BUTTON_QUEUE_LEN, 4);
+static uint32_t button_last_ms[BUTTON_COUNT];
+// runs in the GPIO interrupt
+static void button_event(enum button_id button)
+{
+	struct button_event event = { .button = button, .time_ms = k_uptime_get_32() };
+	if (event.time_ms - button_last_ms[button] < BUTTON_DEBOUNCE_MS) return;
+	button_last_ms[button] = event.time_ms;
+	k_msgq_put(&button_msgq, &event, K_NO_WAIT);
+}
+static void button_a_event(void)
+{
+	button_event(BUTTON_A);
+}
+static void button_b_event(void)
+{
+	button_event(BUTTON_B);
+}
+int buttons_events_begin()
+{
+	if (attach_callback_to_button(button_a_event, BUTTON_A_PORT_BIT) < 0) return -1;
+	if (attach_callback_to_button(button_b_event, BUTTON_B_PORT_BIT) < 0) return -2;
+	return 0;
+}
+// 0 with the oldest press in event, an error if none came within timeout
+int buttons_wait_event(struct button_event *event, k_timeout_t timeout)
+{
+	return k_msgq_get(&button_msgq, event, timeout);
+}
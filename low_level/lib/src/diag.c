@@ -0,0 +1,134 @@
+#include <zephyr.h>
+#include <stdio.h>
+#include <string.h>
+#include <shell/shell.h>
+#include "diag.h"
+
+static struct diag_timer *diag_timers;
+static size_t diag_n_timers;
+static struct diag_counter *diag_counters;
+static size_t diag_n_counters;
+static struct diag_thread *diag_threads;
+static size_t diag_n_threads;
+static struct k_spinlock lock;
+
+uint32_t diag_cycles_to_us(uint64_t cycles)
+{
+#ifdef CONFIG_CPU_CORTEX_M
+	return (uint32_t)(cycles / (SystemCoreClock / 1000000));
+#else
+	return (uint32_t)k_cyc_to_us_floor64(cycles);
+#endif
+}
+
+// turns on the DWT cycle counter and registers the app's tables
+void diag_begin(struct diag_timer *timers, size_t n_timers, struct diag_counter *counters, size_t n_counters,
+		struct diag_thread *threads, size_t n_threads)
+{
+#ifdef CONFIG_CPU_CORTEX_M
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	diag_timers = timers;
+	diag_n_timers = n_timers;
+	diag_counters = counters;
+	diag_n_counters = n_counters;
+	diag_threads = threads;
+	diag_n_threads = n_threads;
+}
+
+// add one duration to a timer, safe from any thread or ISR
+void diag_record(struct diag_timer *timer, uint32_t cycles)
+{
+	uint32_t us = diag_cycles_to_us(cycles);
+	int bin = 0;
+	k_spinlock_key_t key;
+
+	while (bin < DIAG_HIST_BINS - 1 && us >= (2u << bin)) bin++;
+	key = k_spin_lock(&lock);
+	timer->count++;
+	timer->total_cycles += cycles;
+	if (cycles < timer->min_cycles) timer->min_cycles = cycles;
+	if (cycles > timer->max_cycles) timer->max_cycles = cycles;
+	timer->hist[bin]++;
+	k_spin_unlock(&lock, key);
+}
+
+void diag_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	size_t i;
+	for (i = 0; i < diag_n_timers; i++)
+	{
+		const char *name = diag_timers[i].name;
+		memset(&diag_timers[i], 0, sizeof(diag_timers[i]));
+		diag_timers[i].name = name;
+		diag_timers[i].min_cycles = UINT32_MAX;
+	}
+	for (i = 0; i < diag_n_counters; i++) atomic_set(&diag_counters[i].value, 0);
+	k_spin_unlock(&lock, key);
+}
+
+// Render the statistics as text, one line per item, times in microseconds. Returns the length
+size_t diag_format(char *buf, size_t size, bool histograms)
+{
+	size_t n = 0, i;
+	int b;
+
+// append to buf, stopping quietly when it is full
+#define DIAG_PUT(...) do { if (n < size) n += snprintf(&buf[n], size - n, __VA_ARGS__); } while (0)
+	for (i = 0; i < diag_n_timers; i++)
+	{
+		struct diag_timer t;
+		k_spinlock_key_t key = k_spin_lock(&lock);
+		t = diag_timers[i];
+		k_spin_unlock(&lock, key);
+		if (!t.count)
+		{
+			DIAG_PUT("%s: -\n", t.name);
+			continue;
+		}
+		DIAG_PUT("%s: n=%u min=%u avg=%u max=%u\n", t.name, t.count, diag_cycles_to_us(t.min_cycles),
+			diag_cycles_to_us(t.total_cycles / t.count), diag_cycles_to_us(t.max_cycles));
+		if (!histograms) continue;
+		DIAG_PUT(" hist");
+		for (b = 0; b < DIAG_HIST_BINS; b++) DIAG_PUT(" %u", t.hist[b]);
+		DIAG_PUT("\n");
+	}
+	for (i = 0; i < diag_n_counters; i++)
+	{
+		DIAG_PUT("%s: %d\n", diag_counters[i].name, (int)atomic_get(&diag_counters[i].value));
+	}
+	for (i = 0; i < diag_n_threads; i++)
+	{
+		size_t unused = 0;
+		if (!diag_threads[i].tid || k_thread_stack_space_get(diag_threads[i].tid, &unused)) continue;
+		DIAG_PUT("stack %s: %u/%u used\n", diag_threads[i].name,
+			(unsigned)(diag_threads[i].tid->stack_info.size - unused), (unsigned)diag_threads[i].tid->stack_info.size);
+	}
+#undef DIAG_PUT
+	return n < size ? n : size - 1; // snprintf reports what didn't fit too
+}
+
+static int cmd_diag_show(const struct shell *shell, size_t argc, char **argv)
+{
+	static char report[1024];
+	size_t len = diag_format(report, sizeof(report), true);
+	shell_fprintf(shell, SHELL_NORMAL, "%.*s", (int)len, report);
+	return 0;
+}
+
+static int cmd_diag_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	diag_reset();
+	shell_print(shell, "diagnostics reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(diag_cmds,
+	SHELL_CMD(show, NULL, "Timers (us, with histograms), counters and stack usage", cmd_diag_show),
+	SHELL_CMD(reset, NULL, "Clear timers and counters", cmd_diag_reset),
+	SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(diag, &diag_cmds, "Run time diagnostics", NULL);
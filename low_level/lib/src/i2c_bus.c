@@ -0,0 +1,95 @@
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/i2c.h>
+#include <errno.h>
+#include <stdio.h>
+#include "i2c_bus.h"
+
+static const struct device *i2c;
+static K_MUTEX_DEFINE(i2c_bus_lock);
+static uint32_t i2c_bus_speed; // speed the bus is set to, 0 until the first transaction
+
+// safe to call from every driver that uses the bus, only the first call binds it
+int i2c_bus_begin(void)
+{
+	if (i2c != NULL) return 0;
+	i2c = device_get_binding("I2C_1");
+	if (i2c == NULL)
+	{
+		printf("Error acquiring i2c1 interface\n");
+		return -ENODEV;
+	}
+	return 0;
+}
+
+// the lock is recursive so a driver holding the bus can still use the calls below
+const struct device *i2c_bus_acquire(const struct i2c_bus_dev *dev)
+{
+	if (i2c == NULL) return NULL;
+	k_mutex_lock(&i2c_bus_lock, K_FOREVER);
+	if (dev->speed != i2c_bus_speed)
+	{
+		if (i2c_configure(i2c, I2C_MODE_MASTER | I2C_SPEED_SET(dev->speed)))
+		{
+			k_mutex_unlock(&i2c_bus_lock);
+			return NULL;
+		}
+		i2c_bus_speed = dev->speed;
+	}
+	return i2c;
+}
+
+void i2c_bus_release(void)
+{
+	k_mutex_unlock(&i2c_bus_lock);
+}
+
+int i2c_bus_write(const struct i2c_bus_dev *dev, const uint8_t *buf, uint32_t len)
+{
+	const struct device *bus = i2c_bus_acquire(dev);
+	int err;
+	if (bus == NULL) return -EIO;
+	err = i2c_write(bus, buf, len, dev->addr);
+	i2c_bus_release();
+	return err;
+}
+
+int i2c_bus_read(const struct i2c_bus_dev *dev, uint8_t *buf, uint32_t len)
+{
+	const struct device *bus = i2c_bus_acquire(dev);
+	int err;
+	if (bus == NULL) return -EIO;
+	err = i2c_read(bus, buf, len, dev->addr);
+	i2c_bus_release();
+	return err;
+}
+
+int i2c_bus_burst_read(const struct i2c_bus_dev *dev, uint8_t reg, uint8_t *buf, uint32_t len)
+{
+	const struct device *bus = i2c_bus_acquire(dev);
+	int err;
+	if (bus == NULL) return -EIO;
+	err = i2c_burst_read(bus, dev->addr, reg, buf, len);
+	i2c_bus_release();
+	return err;
+}
+
+int i2c_bus_reg_read_byte(const struct i2c_bus_dev *dev, uint8_t reg, uint8_t *value)
+{
+	const struct device *bus = i2c_bus_acquire(dev);
+	int err;
+	if (bus == NULL) return -EIO;
+	err = i2c_reg_read_byte(bus, dev->addr, reg, value);
+	i2c_bus_release();
+	return err;
+}
+
+int i2c_bus_reg_write_byte(const struct i2c_bus_dev *dev, uint8_t reg, uint8_t value)
+{
+	const struct device *bus = i2c_bus_acquire(dev);
+	int err;
+	if (bus == NULL) return -EIO;
+	err = i2c_reg_write_byte(bus, dev->addr, reg, value);
+	i2c_bus_release();
+	return err;
+}
@@ -0,0 +1,87 @@
+#include <zephyr.h>
+#include <string.h>
+#include <logging/log_backend.h>
+#include <logging/log_backend_std.h>
+#include <logging/log_output.h>
+#include "log_ram.h"
+
+static uint8_t ring[LOG_RAM_SIZE];
+static size_t head;		// next byte to write
+static bool wrapped;		// ring has been filled at least once, the oldest byte is at head
+static struct k_spinlock lock;
+
+// log_output callback: append formatted output, overwriting the oldest bytes
+static int ram_out(uint8_t *data, size_t length, void *ctx)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	size_t i;
+	for (i = 0; i < length; i++)
+	{
+		ring[head++] = data[i];
+		if (head == sizeof(ring))
+		{
+			head = 0;
+			wrapped = true;
+		}
+	}
+	k_spin_unlock(&lock, key);
+	return length;
+}
+
+static uint8_t out_buf[32];
+LOG_OUTPUT_DEFINE(log_output_ram, ram_out, out_buf, sizeof(out_buf));
+
+// Copies the newest min(size, available) bytes, oldest first. Returns the number of bytes copied
+size_t log_ram_read(uint8_t *dst, size_t size)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	size_t fill = wrapped ? sizeof(ring) : head;
+	size_t n = size < fill ? size : fill;
+	size_t start = (head + sizeof(ring) - n) % sizeof(ring);
+	size_t first = sizeof(ring) - start < n ? sizeof(ring) - start : n;
+
+	memcpy(dst, &ring[start], first);
+	memcpy(dst + first, ring, n - first);
+	k_spin_unlock(&lock, key);
+	return n;
+}
+
+// timestamps and levels are kept, colours are left to the UART backend
+#define LOG_RAM_FLAGS (LOG_OUTPUT_FLAG_LEVEL | LOG_OUTPUT_FLAG_TIMESTAMP)
+
+static void put(const struct log_backend *const backend, struct log_msg *msg)
+{
+	log_backend_std_put(&log_output_ram, LOG_RAM_FLAGS, msg);
+}
+
+static void put_sync_string(const struct log_backend *const backend, struct log_msg_ids src_level,
+			    uint32_t timestamp, const char *fmt, va_list ap)
+{
+	log_backend_std_sync_string(&log_output_ram, LOG_RAM_FLAGS, src_level, timestamp, fmt, ap);
+}
+
+static void put_sync_hexdump(const struct log_backend *const backend, struct log_msg_ids src_level,
+			     uint32_t timestamp, const char *metadata, const uint8_t *data, uint32_t length)
+{
+	log_backend_std_sync_hexdump(&log_output_ram, LOG_RAM_FLAGS, src_level, timestamp, metadata, data, length);
+}
+
+static void panic(struct log_backend const *const backend)
+{
+	log_backend_std_panic(&log_output_ram);
+}
+
+static void dropped(const struct log_backend *const backend, uint32_t cnt)
+{
+	log_backend_std_dropped(&log_output_ram, cnt);
+}
+
+static const struct log_backend_api log_backend_ram_api = {
+	.put = put,
+	.put_sync_string = put_sync_string,
+	.put_sync_hexdump = put_sync_hexdump,
+	.panic = panic,
+	.dropped = dropped,
+};
+
+LOG_BACKEND_DEFINE(log_backend_ram, log_backend_ram_api, true);
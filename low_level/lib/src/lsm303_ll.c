@@ -0,0 +1,235 @@
+#include <sys/byteorder.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "lsm303_ll.h"
+#include "i2c_bus.h"
+
+#define OUT_X_L_A 0x28
+#define OUTX_L_REG_M 0x68
+#define AUTO_INCREMENT 0x80 // set on the accelerometer's register address for multi byte reads
+
+// both halves of the part run in fast mode
+static const struct i2c_bus_dev accel_dev = I2C_BUS_DEV(LSM303_ACCEL_ADDRESS, I2C_SPEED_FAST);
+static const struct i2c_bus_dev mag_dev = I2C_BUS_DEV(LSM303_MAG_ADDRESS, I2C_SPEED_FAST);
+static bool have_mag;
+int lsm303_ll_begin()
+{
+	int nack;
+	uint8_t device_id;
+	// Set up the I2C interface
+	if (i2c_bus_begin() < 0) return -1;
+	// Check to make sure the device is present by reading the WHO_AM_I registers
+	nack = lsm303_ll_readRegister(0x0f,&device_id,LSM303_ACCEL_ADDRESS);
+	if (nack != 0)
+	{
+		printf("Error finding LSM303 on the I2C bus\n");
+		return -2;
+	}
+	printf("Found LSM303.  WHO_AM_I = %x\n",device_id);
+	// the accelerometer is enough for most apps, carry on without the magnetometer
+	have_mag = lsm303_ll_readRegister(0x4f,&device_id,LSM303_MAG_ADDRESS) == 0;
+	if (have_mag) lsm303_ll_writeRegister(0x62,0x10,LSM303_MAG_ADDRESS); //block data update
+	else printf("LSM303 magnetometer not found\n");
+	return lsm303_ll_setPowerMode(LSM303_NORMAL); //wake up LSM303 (all accel channels)
+}
+
+// CTRL_REG1_A (0x20) sets the accel data rate and LPen, CTRL_REG4_A (0x23) the resolution and
+// CFG_REG_A_M (0x60) the mag mode. Reads still return m/s^2 * 100 in every mode, the low bits are 0 at 8 bits
+int lsm303_ll_setPowerMode(enum lsm303_power_mode mode)
+{
+	int nack;
+	switch (mode)
+	{
+		case LSM303_POWER_DOWN:
+			nack = lsm303_ll_writeRegister(0x20,0x07,LSM303_ACCEL_ADDRESS); //ODR 0 = power down
+			if (have_mag) nack |= lsm303_ll_writeRegister(0x60,0x83,LSM303_MAG_ADDRESS); //temperature compensated, idle
+			break;
+		case LSM303_LOW_POWER:
+			nack = lsm303_ll_writeRegister(0x23,0x00,LSM303_ACCEL_ADDRESS); //high resolution off +/- 2g, required for LPen
+			nack |= lsm303_ll_writeRegister(0x20,0x2f,LSM303_ACCEL_ADDRESS); //10Hz, LPen, all accel channels
+			if (have_mag) nack |= lsm303_ll_writeRegister(0x60,0x90,LSM303_MAG_ADDRESS); //temperature compensated, low power, 10Hz continuous
+			break;
+		case LSM303_NORMAL:
+			nack = lsm303_ll_writeRegister(0x20,0x37,LSM303_ACCEL_ADDRESS); //25Hz, all accel channels
+			nack |= lsm303_ll_writeRegister(0x23,0x08,LSM303_ACCEL_ADDRESS); //enable  high resolution mode +/- 2g
+			if (have_mag) nack |= lsm303_ll_writeRegister(0x60,0x80,LSM303_MAG_ADDRESS); //temperature compensated, 10Hz continuous
+			break;
+		default:
+			return -1;
+	}
+	return nack ? -2 : 0;
+}
+
+// left justified 12 bit result, +2047 = +2g, scaled to m/s^2 * 100
+static int accel_from_raw(const uint8_t *buf)
+{
+	int accel = (int16_t)sys_get_le16(buf) / 16;
+	return accel * 2*981 / 2047;
+}
+
+// 16 bit result at 1.5 mgauss per digit
+static int mag_from_raw(const uint8_t *buf)
+{
+	return (int16_t)sys_get_le16(buf) * 3 / 2;
+}
+
+// all three axes in one 6 byte read, a third of the bus time of reading them one by one
+int lsm303_ll_readAccel(int *x, int *y, int *z)
+{
+	uint8_t buf[6];
+	int nack = i2c_bus_burst_read(&accel_dev,AUTO_INCREMENT | OUT_X_L_A, buf,sizeof(buf));
+	if (nack) return nack;
+	*x = accel_from_raw(&buf[0]);
+	*y = accel_from_raw(&buf[2]);
+	*z = accel_from_raw(&buf[4]);
+	return 0;
+}
+
+// the magnetometer always auto increments
+int lsm303_ll_readMag(int *x, int *y, int *z)
+{
+	uint8_t buf[6];
+	int nack = i2c_bus_burst_read(&mag_dev,OUTX_L_REG_M, buf,sizeof(buf));
+	if (nack) return nack;
+	*x = mag_from_raw(&buf[0]);
+	*y = mag_from_raw(&buf[2]);
+	*z = mag_from_raw(&buf[4]);
+	return 0;
+}
+
+static int accel_axis(uint8_t reg)
+{
+	uint8_t buf[2] = {0, 0};
+	i2c_bus_burst_read(&accel_dev,AUTO_INCREMENT | reg, buf,2);
+	return accel_from_raw(buf);
+}
+
+static int mag_axis(uint8_t reg)
+{
+	uint8_t buf[2] = {0, 0};
+	i2c_bus_burst_read(&mag_dev,reg, buf,2);
+	return mag_from_raw(buf);
+}
+
+int lsm303_ll_readAccelX()
+{
+	return accel_axis(OUT_X_L_A);
+}
+int lsm303_ll_readAccelY()
+{
+	return accel_axis(OUT_X_L_A + 2);
+}
+int lsm303_ll_readAccelZ()
+{
+	return accel_axis(OUT_X_L_A + 4);
+}
+int lsm303_ll_readMagX()
+{
+	return mag_axis(OUTX_L_REG_M);
+}
+int lsm303_ll_readMagY()
+{
+	return mag_axis(OUTX_L_REG_M + 2);
+}
+int lsm303_ll_readMagZ()
+{
+	return mag_axis(OUTX_L_REG_M + 4);
+}
+
+int lsm303_ll_readRegister(uint8_t RegNum, uint8_t *Value, uint8_t deviceReg)
+{
+	//reads a byte from a specific register
+	return i2c_bus_reg_read_byte(deviceReg == LSM303_MAG_ADDRESS ? &mag_dev : &accel_dev,RegNum,Value);
+}
+int lsm303_ll_writeRegister(uint8_t RegNum, uint8_t Value, uint8_t deviceReg)
+{
+	//writes a byte to a specific register
+	return i2c_bus_reg_write_byte(deviceReg == LSM303_MAG_ADDRESS ? &mag_dev : &accel_dev,RegNum,Value);
+}
+
+#ifdef CONFIG_IOTLAB_LSM303_FIFO
+#define CTRL_REG1_A 0x20
+#define CTRL_REG3_A 0x22
+#define CTRL_REG4_A 0x23
+#define CTRL_REG5_A 0x24
+#define FIFO_CTRL_REG_A 0x2e
+#define FIFO_SRC_REG_A 0x2f
+#define FIFO_EN 0x40
+#define FIFO_STREAM 0x80
+#define FIFO_OVRN 0x40
+#define FIFO_FSS 0x1f
+#define I1_WTM 0x04
+static const struct device *gpio0;
+// The LSM303's interrupt output pin is connected to P0.25
+#define FIFO_INTERRUPT_PORT_BIT 25
+static void (*watermark_callback)(void);
+
+static struct gpio_callback fifo_cb;
+static void fifo_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+	if (watermark_callback != NULL) watermark_callback();
+}
+
+// 50Hz 12 bit samples into the FIFO in stream mode, INT1 rises (and callback runs in
+// interrupt context) once more than watermark samples are waiting. Drain it with
+// lsm303_ll_readFifo(), changing the power mode afterwards changes the data rate
+int lsm303_ll_fifoBegin(uint8_t watermark, void (*callback)(void))
+{
+	int nack;
+	if (watermark >= LSM303_FIFO_DEPTH) return -1;
+	gpio0=device_get_binding("GPIO_0");
+	if (gpio0 == NULL)
+	{
+		printf("Error acquiring GPIO 0 interface\n");
+		return -2;
+	}
+	if (gpio_pin_configure(gpio0,FIFO_INTERRUPT_PORT_BIT,GPIO_INPUT | GPIO_PULL_UP) < 0)
+	{
+		printf("Error configuring FIFO interrupt pin\n");
+		return -3;
+	}
+	gpio_init_callback(&fifo_cb, fifo_handler, (1 << FIFO_INTERRUPT_PORT_BIT) );
+	if (gpio_add_callback(gpio0, &fifo_cb) < 0)
+	{
+		printf("Error adding callback for FIFO interrupt\n");
+		return -4;
+	}
+	watermark_callback = callback;
+	nack = lsm303_ll_writeRegister(CTRL_REG1_A,0x47,LSM303_ACCEL_ADDRESS); //50Hz, all accel channels
+	nack |= lsm303_ll_writeRegister(CTRL_REG4_A,0x08,LSM303_ACCEL_ADDRESS); //high resolution +/- 2g
+	nack |= lsm303_ll_writeRegister(FIFO_CTRL_REG_A,0x00,LSM303_ACCEL_ADDRESS); //bypass empties the FIFO
+	nack |= lsm303_ll_writeRegister(CTRL_REG5_A,FIFO_EN,LSM303_ACCEL_ADDRESS);
+	nack |= lsm303_ll_writeRegister(FIFO_CTRL_REG_A,FIFO_STREAM | watermark,LSM303_ACCEL_ADDRESS);
+	nack |= lsm303_ll_writeRegister(CTRL_REG3_A,I1_WTM,LSM303_ACCEL_ADDRESS); //watermark on INT1
+	if (nack) return -5;
+	if (gpio_pin_interrupt_configure(gpio0,FIFO_INTERRUPT_PORT_BIT,GPIO_INT_EDGE_RISING) < 0)
+	{
+		printf("Error configuring interrupt for FIFO\n");
+		return -6;
+	}
+	return 0;
+}
+
+// reads up to max samples (m/s^2 * 100) in one burst, returns the number read
+// the FIFO's read pointer wraps from OUT_Z_H_A back to OUT_X_L_A so the burst walks through the samples
+int lsm303_ll_readFifo(int accel[][3], int max)
+{
+	static uint8_t buf[LSM303_FIFO_DEPTH * 6];
+	uint8_t src;
+	int count, nack;
+	nack = lsm303_ll_readRegister(FIFO_SRC_REG_A,&src,LSM303_ACCEL_ADDRESS);
+	if (nack) return nack;
+	count = (src & FIFO_OVRN) ? LSM303_FIFO_DEPTH : (src & FIFO_FSS);
+	if (count > max) count = max;
+	if (!count) return 0;
+	nack = i2c_bus_burst_read(&accel_dev,AUTO_INCREMENT | OUT_X_L_A, buf,count * 6);
+	if (nack) return nack;
+	for (int i = 0; i < count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++) accel[i][axis] = accel_from_raw(&buf[i * 6 + axis * 2]);
+	}
+	return count;
+}
+#endif
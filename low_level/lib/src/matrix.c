@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <sys/printk.h>
+#include <sys/util.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <stdio.h>
+#include "matrix.h"
+// Rows and columns 1, 2, 3 and 5 are on GPIO0, column 4 is on GPIO1
+static const uint8_t row_bits[5] = { 21, 22, 15, 24, 19 };
+static const uint8_t col_bits[5] = { 28, 11, 31, 5, 30 };
+#define COL4 3
+
+static const struct device *gpio0, *gpio1;
+// GPIO0 port value for each 5 bit row and column pattern and the pins they cover, filled in by matrix_begin()
+static gpio_port_value_t row_value[32], col_value[32];
+static gpio_port_pins_t gpio0_mask;
+
+int matrix_begin()
+{
+	int ret = 0;
+	// Configure the GPIO's
+	gpio0 = device_get_binding("GPIO_0");
+	if (gpio0 == NULL)
+	{
+		printf("Error acquiring GPIO 0 interface\n");
+		return -1;
+	}
+	gpio1 = device_get_binding("GPIO_1");
+	if (gpio1 == NULL)
+	{
+		printf("Error acquiring GPIO 1 interface\n");
+		return -2;
+	}
+	for (int i = 0; i < 5; i++) {
+		ret |= gpio_pin_configure(i == COL4 ? gpio1 : gpio0, col_bits[i], GPIO_OUTPUT);
+		ret |= gpio_pin_configure(gpio0, row_bits[i], GPIO_OUTPUT);
+	}
+	if (ret)
+	{
+		printf("Error configuring the matrix pins\n");
+		return -3;
+	}
+	for (int pattern = 0; pattern < 32; pattern++) {
+		row_value[pattern] = col_value[pattern] = 0;
+		for (int i = 0; i < 5; i++) {
+			if (!(pattern & BIT(i))) continue;
+			row_value[pattern] |= BIT(row_bits[i]);
+			if (i != COL4) col_value[pattern] |= BIT(col_bits[i]);
+		}
+	}
+	gpio0_mask = row_value[0x1f] | col_value[0x1f];
+	matrix_all_off();
+	return 0;
+}
+// Rows are driven high and columns low to light an LED. Every pin on GPIO0 changes in one
+// port write, the scan loops in the apps call this every few ms
+void matrix_put_pattern(uint8_t rows, uint8_t cols)
+{
+	gpio_port_set_masked_raw(gpio0, gpio0_mask, row_value[rows & 0x1f] | col_value[cols & 0x1f]);
+	gpio_pin_set_raw(gpio1, col_bits[COL4], (cols >> COL4) & 1);
+}
+void matrix_all_off()
+{
+	matrix_put_pattern(0, 0x1f);
+}
@@ -0,0 +1,74 @@
+#include <zephyr.h>
+#include <logging/log.h>
+#include "power.h"
+#include "sched.h"
+
+LOG_MODULE_REGISTER(power, CONFIG_POWER_LOG_LEVEL);
+
+static power_state_fn state_changed;
+static const uint32_t *state_current_ua;	// estimated average current in each state
+static volatile enum power_state requested = POWER_IDLE;
+static enum power_state state = POWER_IDLE;
+static int64_t state_since_ms;			// uptime when the current state was entered
+static uint64_t time_ms[POWER_STATE_COUNT];	// accumulated time in each finished state period
+static struct k_spinlock lock;
+static struct sched_job power_job;		// event: applies the requested state
+
+// move the time spent in the current state into its total, caller holds the lock
+static void power_account(int64_t now)
+{
+	time_ms[state] += now - state_since_ms;
+	state_since_ms = now;
+}
+
+static void power_fn(struct sched_job *job)
+{
+	enum power_state next = requested;
+	k_spinlock_key_t key;
+
+	if (next == state) return;
+	key = k_spin_lock(&lock);
+	power_account(k_uptime_get());
+	state = next;
+	k_spin_unlock(&lock, key);
+	LOG_INF("Power state %s", next == POWER_ACTIVE ? "active" : "idle");
+	if (state_changed) state_changed(next);
+}
+
+// the app starts in POWER_IDLE, on_change is called on the scheduler thread for every change after that
+void power_begin(power_state_fn on_change, const uint32_t current_ua[POWER_STATE_COUNT])
+{
+	state_changed = on_change;
+	state_current_ua = current_ua;
+	state_since_ms = k_uptime_get();
+	sched_job_init(&power_job, "power", power_fn, 0);
+}
+
+// ask for a state change, safe to call from the BLE callbacks and ISRs
+void power_request(enum power_state next)
+{
+	requested = next;
+	sched_job_trigger(&power_job);
+}
+
+enum power_state power_get_state(void)
+{
+	return state;
+}
+
+void power_get_stats(struct power_stats *stats)
+{
+	uint64_t charge_uams = 0; // micro amp milliseconds
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int i;
+
+	power_account(k_uptime_get());
+	for (i = 0; i < POWER_STATE_COUNT; i++)
+	{
+		stats->time_ms[i] = (uint32_t)time_ms[i];
+		charge_uams += time_ms[i] * state_current_ua[i];
+	}
+	stats->state = state;
+	k_spin_unlock(&lock, key);
+	stats->charge_uah = charge_uams / 3600000; // 3600000 ms in an hour
+}
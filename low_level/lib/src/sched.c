@@ -0,0 +1,109 @@
+#include <zephyr.h>
+#include <logging/log.h>
+#include "sched.h"
+
+LOG_MODULE_REGISTER(sched, CONFIG_SCHED_LOG_LEVEL);
+
+#define SCHED_STACK_SIZE CONFIG_IOTLAB_SCHED_STACK_SIZE
+#define SCHED_PRIORITY CONFIG_IOTLAB_SCHED_PRIORITY
+
+K_THREAD_STACK_DEFINE(sched_stack, SCHED_STACK_SIZE);
+static struct k_work_q sched_q;
+
+static void sched_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct sched_job *job = CONTAINER_OF(dwork, struct sched_job, work);
+
+	job->retry_ms = 0;
+	job->fn(job);
+	// a job stopped from another thread while it ran stays stopped, active is checked again
+	// just before rescheduling to keep the window for that as small as possible
+	if (job->active && job->retry_ms)
+	{
+		// the job asked to run again early, its period is counted from the retry
+		job->next_ms = k_uptime_get() + job->retry_ms;
+		if (job->active) k_work_schedule_for_queue(&sched_q, &job->work, K_MSEC(job->retry_ms));
+	}
+	else if (job->active && job->period_ms)
+	{
+		// reschedule against the deadline rather than 'now' so the rate doesn't drift
+		int64_t now = k_uptime_get();
+		job->next_ms += job->period_ms;
+		if (job->next_ms < now) job->next_ms = now; // overran a whole period, resync
+		if (job->active) k_work_schedule_for_queue(&sched_q, &job->work, K_MSEC(job->next_ms - now));
+	}
+}
+
+int sched_begin()
+{
+	k_work_queue_init(&sched_q);
+	k_work_queue_start(&sched_q, sched_stack, K_THREAD_STACK_SIZEOF(sched_stack), SCHED_PRIORITY, NULL);
+	k_thread_name_set(&sched_q.thread, "sched");
+	return 0;
+}
+
+// the work queue thread the jobs run on, e.g. for stack usage checks
+k_tid_t sched_thread(void)
+{
+	return &sched_q.thread;
+}
+
+void sched_job_init(struct sched_job *job, const char *name, sched_fn fn, uint32_t period_ms)
+{
+	k_work_init_delayable(&job->work, sched_handler);
+	job->fn = fn;
+	job->period_ms = period_ms;
+	job->active = false;
+	job->name = name;
+}
+
+// start a periodic job, its first run is one period from now. A job that is already running
+// starts its period over, so a pending run is moved
+int sched_job_start(struct sched_job *job)
+{
+	if (!job->period_ms)
+	{
+		LOG_ERR("Job %s has no period", job->name);
+		return -1;
+	}
+	job->active = true;
+	job->next_ms = k_uptime_get() + job->period_ms;
+	return k_work_reschedule_for_queue(&sched_q, &job->work, K_MSEC(job->period_ms));
+}
+
+// start the period of a running job over from now, e.g. when the sensor it reads has restarted
+// its own timing. A stopped job stays stopped
+int sched_job_restart(struct sched_job *job)
+{
+	if (!job->active) return 0;
+	return sched_job_start(job);
+}
+
+// run a job as soon as the queue is free, can be called from an ISR
+int sched_job_trigger(struct sched_job *job)
+{
+	job->next_ms = k_uptime_get();
+	return k_work_reschedule_for_queue(&sched_q, &job->work, K_NO_WAIT);
+}
+
+// called from inside a started job: run again after delay_ms instead of waiting a whole period
+// e.g. when a sensor wasn't ready yet, this also brings the job into phase with the sensor.
+// Ignored if the job is stopped before it returns
+void sched_job_retry(struct sched_job *job, uint32_t delay_ms)
+{
+	job->retry_ms = delay_ms;
+}
+
+// takes effect from the next run, can be called from inside the job itself
+void sched_job_set_period(struct sched_job *job, uint32_t period_ms)
+{
+	job->period_ms = period_ms;
+}
+
+// stop periodic runs, sched_job_start() resumes them
+void sched_job_stop(struct sched_job *job)
+{
+	job->active = false;
+	k_work_cancel_delayable(&job->work);
+}
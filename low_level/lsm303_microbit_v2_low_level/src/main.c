@@ -12,6 +12,66 @@
 #include <math.h>
 #include "lsm303_ll.h"
 #include "matrix.h"
+#include "sched.h"
+
+// tilt state, updated by the tilt job
+static int rows = 0b00100;
+static int cols = 0b00100;
+static int sens = 70;
+static double a, b; // coefficients of the tilt to update period curve
+static struct sched_job tilt_job;
+
+// tilt job: move the lit LED with the board's tilt, the steeper the tilt the sooner it runs again
+static void tilt_fn(struct sched_job *job)
+{
+	int accel_x;
+	int accel_y;
+	accel_x = lsm303_ll_readAccelX();
+	accel_y = lsm303_ll_readAccelY();
+	if (accel_y > sens)
+	{
+		rows = rows >> 1;
+		if (rows < 1)
+		{
+			rows = 1;
+		}
+	}
+	else if (accel_y < -sens)
+	{
+		rows = rows << 1;
+		if (rows > 16)
+		{
+			rows = 16;
+		}
+	}
+	if (accel_x > sens)
+	{
+		cols = cols << 1;
+		if (cols > 16)
+		{
+			cols = 16;
+		}
+	}
+	else if (accel_x < -sens)
+	{
+		cols = cols >> 1;
+		if (cols < 1)
+		{
+			cols = 1;
+		}
+	}
+	matrix_put_pattern(rows, ~cols);
+	int delay = abs(accel_x) > abs(accel_y) ? abs(accel_x) : abs(accel_y);
+	if (delay < 100)
+	{
+		delay = 100;
+	}
+	else if (delay > 500)
+	{
+		delay = 500;
+	}
+	sched_job_set_period(job, a * exp(b * (600 - delay)));
+}
 
 void main(void)
 {
@@ -31,61 +91,11 @@ void main(void)
 		while (1)
 			;
 	}
-	int rows = 0b00100;
-	int cols = 0b00100;
-	int accel_x;
-	int accel_y;
-	int sens = 70;
 	float upperLim = 600, lowerLim = 100;
-	double b = log10(upperLim / lowerLim) / (upperLim - lowerLim);
-	double a = upperLim / pow(10, b * upperLim);
-	while (1)
-	{
-		accel_x = lsm303_ll_readAccelX();
-		accel_y = lsm303_ll_readAccelY();
-		if (accel_y > sens)
-		{
-			rows = rows >> 1;
-			if (rows < 1)
-			{
-				rows = 1;
-			}
-		}
-		else if (accel_y < -sens)
-		{
-			rows = rows << 1;
-			if (rows > 16)
-			{
-				rows = 16;
-			}
-		}
-		if (accel_x > sens)
-		{
-			cols = cols << 1;
-			if (cols > 16)
-			{
-				cols = 16;
-			}
-		}
-		else if (accel_x < -sens)
-		{
-			cols = cols >> 1;
-			if (cols < 1)
-			{
-				cols = 1;
-			}
-		}
-		matrix_put_pattern(rows, ~cols);
-		int delay = abs(accel_x) > abs(accel_y) ? abs(accel_x) : abs(accel_y);
-		if (delay < 100)
-		{
-			delay = 100;
-		}
-		else if (delay > 500)
-		{
-			delay = 500;
-		}
-		int sleepTime = a * exp(b * (600 - delay));
-		k_msleep(sleepTime);
-	}
+	b = log10(upperLim / lowerLim) / (upperLim - lowerLim);
+	a = upperLim / pow(10, b * upperLim);
+	// the job adjusts its own period after each run, main returns and the CPU idles in between
+	sched_begin();
+	sched_job_init(&tilt_job, "tilt", tilt_fn, upperLim);
+	sched_job_start(&tilt_job);
 }